@@ -0,0 +1,121 @@
+#ifndef COM_GITHUB_JEFFMANZIONE_INTERN_BENCHMARKS_BENCHMARK_STATS_H_
+#define COM_GITHUB_JEFFMANZIONE_INTERN_BENCHMARKS_BENCHMARK_STATS_H_
+
+/**
+ * @file benchmark_stats.h
+ * @brief Counters reported by the benchmarks beyond wall time.
+ *
+ * Probe lengths are read from the table layout directly, so they describe the
+ * configuration (build flags) the benchmark was compiled with.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+extern "C" {
+#include "intern/internal/hash_set.h"
+}
+
+namespace intern_benchmarks {
+
+// Returns the number of probes a successful find makes for each stored value:
+// slots probed for classic tables, groups probed with control bytes.
+template <typename HashSet>
+std::vector<uint32_t> ProbeLengths(const HashSet &hash_set) {
+  std::vector<uint32_t> probe_lengths;
+  if (hash_set.table == nullptr) {
+    return probe_lengths;
+  }
+#if defined(HASH_SET_CONTROL_BYTES)
+  const int8_t *ctrl = CTRL_BYTES(hash_set.table, hash_set.table_size);
+  const uint32_t num_groups = hash_set.table_size / CTRL_GROUP_WIDTH;
+  for (uint32_t i = 0; i < hash_set.table_size; ++i) {
+    if (!IS_CTRL_FULL(ctrl[i])) {
+      continue;
+    }
+    const uint32_t hval = hash_set.table[i].hash_value;
+    uint32_t num_probes = 0;
+    while (LOOKUP_HASH_POSITION(hval, num_probes, num_groups) !=
+           i / CTRL_GROUP_WIDTH) {
+      num_probes++;
+    }
+    probe_lengths.push_back(num_probes + 1);
+  }
+#else
+  for (uint32_t i = 0; i < hash_set.table_size; ++i) {
+    if (hash_set.table[i].num_probes > 0) {
+      probe_lengths.push_back((uint32_t)hash_set.table[i].num_probes);
+    }
+  }
+#endif
+  return probe_lengths;
+}
+
+// Bytes held by the table of hash_set, including control bytes.
+template <typename HashSet>
+size_t TableBytes(const HashSet &hash_set) {
+  if (hash_set.table == nullptr) {
+    return 0;
+  }
+  size_t slot_bytes = sizeof(*hash_set.table);
+#if defined(HASH_SET_CONTROL_BYTES)
+  slot_bytes += 1;
+#endif
+  return hash_set.table_size * slot_bytes;
+}
+
+// Reports the median, 90th and 99th percentile and maximum probe length.
+inline void ReportProbeLengths(benchmark::State &state,
+                               std::vector<uint32_t> probe_lengths) {
+  if (probe_lengths.empty()) {
+    return;
+  }
+  std::sort(probe_lengths.begin(), probe_lengths.end());
+  const auto percentile = [&](double p) {
+    return (double)probe_lengths[(size_t)(p * (probe_lengths.size() - 1))];
+  };
+  state.counters["probes_p50"] = percentile(0.50);
+  state.counters["probes_p90"] = percentile(0.90);
+  state.counters["probes_p99"] = percentile(0.99);
+  state.counters["probes_max"] = (double)probe_lengths.back();
+}
+
+// Reports the median, 99th and 99.9th percentile and maximum of the given
+// per-operation latencies, in nanoseconds.
+inline void ReportLatencies(benchmark::State &state,
+                            std::vector<int64_t> latencies_ns) {
+  if (latencies_ns.empty()) {
+    return;
+  }
+  std::sort(latencies_ns.begin(), latencies_ns.end());
+  const auto percentile = [&](double p) {
+    return (double)latencies_ns[(size_t)(p * (latencies_ns.size() - 1))];
+  };
+  state.counters["latency_p50_ns"] = percentile(0.50);
+  state.counters["latency_p99_ns"] = percentile(0.99);
+  state.counters["latency_p999_ns"] = percentile(0.999);
+  state.counters["latency_max_ns"] = (double)latencies_ns.back();
+}
+
+// Reports time per operation, given the number of operations per iteration.
+inline void ReportTimePerOp(benchmark::State &state, size_t ops_per_iteration) {
+  state.SetItemsProcessed((int64_t)(state.iterations() * ops_per_iteration));
+  state.counters["time/op"] = benchmark::Counter(
+      (double)ops_per_iteration,
+      benchmark::Counter::kIsIterationInvariantRate |
+          benchmark::Counter::kInvert);
+}
+
+inline void ReportBytesPerEntry(benchmark::State &state, size_t bytes,
+                                size_t num_entries) {
+  if (num_entries > 0) {
+    state.counters["bytes/entry"] = (double)bytes / num_entries;
+  }
+}
+
+}  // namespace intern_benchmarks
+
+#endif /* COM_GITHUB_JEFFMANZIONE_INTERN_BENCHMARKS_BENCHMARK_STATS_H_ */
@@ -0,0 +1,117 @@
+#include "intern/benchmarks/corpora.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <unordered_set>
+
+namespace intern_benchmarks {
+
+std::vector<std::string> Words(size_t num_words, uint64_t seed) {
+  std::mt19937_64 rng(seed);
+  std::uniform_int_distribution<int> length(2, 12);
+  std::uniform_int_distribution<int> letter('a', 'z');
+  std::unordered_set<std::string> seen;
+  std::vector<std::string> words;
+  words.reserve(num_words);
+  while (words.size() < num_words) {
+    std::string word(length(rng), ' ');
+    for (char &c : word) {
+      c = (char)letter(rng);
+    }
+    if (seen.insert(word).second) {
+      words.push_back(std::move(word));
+    }
+  }
+  return words;
+}
+
+std::vector<uint32_t> ZipfianIndices(size_t num_samples,
+                                     size_t vocabulary_size, double exponent,
+                                     uint64_t seed) {
+  std::vector<double> cdf(vocabulary_size);
+  double total = 0;
+  for (size_t i = 0; i < vocabulary_size; ++i) {
+    total += 1.0 / std::pow((double)(i + 1), exponent);
+    cdf[i] = total;
+  }
+  std::mt19937_64 rng(seed);
+  std::uniform_real_distribution<double> uniform(0, total);
+  std::vector<uint32_t> indices;
+  indices.reserve(num_samples);
+  for (size_t i = 0; i < num_samples; ++i) {
+    const auto it = std::lower_bound(cdf.begin(), cdf.end(), uniform(rng));
+    indices.push_back(
+        (uint32_t)std::min<size_t>(it - cdf.begin(), vocabulary_size - 1));
+  }
+  return indices;
+}
+
+std::vector<std::string> ZipfianTokens(size_t num_tokens,
+                                       size_t vocabulary_size, uint64_t seed) {
+  const std::vector<std::string> words = Words(vocabulary_size, seed);
+  std::vector<std::string> tokens;
+  tokens.reserve(num_tokens);
+  for (uint32_t index :
+       ZipfianIndices(num_tokens, vocabulary_size, /*exponent=*/1, seed + 1)) {
+    tokens.push_back(words[index]);
+  }
+  return tokens;
+}
+
+std::vector<std::string> Urls(size_t num_urls, uint64_t seed) {
+  static const char *const kSchemes[] = {"https://", "http://"};
+  static const char *const kTlds[] = {".com", ".org", ".net", ".io"};
+  const std::vector<std::string> hosts = Words(64, seed);
+  const std::vector<std::string> segments = Words(512, seed + 1);
+  std::mt19937_64 rng(seed + 2);
+  std::unordered_set<std::string> seen;
+  std::vector<std::string> urls;
+  urls.reserve(num_urls);
+  while (urls.size() < num_urls) {
+    std::string url = kSchemes[rng() % 2];
+    url += "www." + hosts[rng() % hosts.size()] + kTlds[rng() % 4];
+    for (uint64_t depth = 1 + rng() % 4; depth > 0; --depth) {
+      url += "/" + segments[rng() % segments.size()];
+    }
+    url += "?id=" + std::to_string(rng() % 1000000);
+    if (seen.insert(url).second) {
+      urls.push_back(std::move(url));
+    }
+  }
+  return urls;
+}
+
+std::vector<std::string> Uuids(size_t num_uuids, uint64_t seed) {
+  std::mt19937_64 rng(seed);
+  std::vector<std::string> uuids;
+  uuids.reserve(num_uuids);
+  for (size_t i = 0; i < num_uuids; ++i) {
+    const uint64_t high = rng(), low = rng();
+    char uuid[37];
+    snprintf(uuid, sizeof(uuid), "%08x-%04x-4%03x-%04x-%012llx",
+             (unsigned)(high >> 32), (unsigned)(high >> 16) & 0xffff,
+             (unsigned)high & 0xfff,
+             0x8000 | ((unsigned)(low >> 48) & 0x3fff),
+             (unsigned long long)(low & 0xffffffffffffull));
+    uuids.push_back(uuid);
+  }
+  return uuids;
+}
+
+std::vector<int32_t> Int32Keys(size_t num_keys, uint64_t seed) {
+  std::mt19937_64 rng(seed);
+  std::unordered_set<int32_t> seen;
+  std::vector<int32_t> keys;
+  keys.reserve(num_keys);
+  while (keys.size() < num_keys) {
+    const int32_t key = (int32_t)(uint32_t)rng();
+    if (seen.insert(key).second) {
+      keys.push_back(key);
+    }
+  }
+  return keys;
+}
+
+}  // namespace intern_benchmarks
@@ -0,0 +1,45 @@
+#ifndef COM_GITHUB_JEFFMANZIONE_INTERN_BENCHMARKS_CORPORA_H_
+#define COM_GITHUB_JEFFMANZIONE_INTERN_BENCHMARKS_CORPORA_H_
+
+/**
+ * @file corpora.h
+ * @brief Deterministic synthetic inputs for the benchmarks.
+ *
+ * Every generator is seeded, so a corpus is identical across runs and
+ * configurations and results can be compared directly.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace intern_benchmarks {
+
+// num_words distinct lowercase words of 2 to 12 letters, like a vocabulary.
+std::vector<std::string> Words(size_t num_words, uint64_t seed);
+
+// num_samples indices into a vocabulary of vocabulary_size words, drawn from a
+// Zipfian distribution with the given exponent (about 1 for natural text), so
+// that index 0 is the most frequent.
+std::vector<uint32_t> ZipfianIndices(size_t num_samples,
+                                     size_t vocabulary_size, double exponent,
+                                     uint64_t seed);
+
+// num_tokens words sampled from Words(vocabulary_size) following
+// ZipfianIndices(exponent = 1).
+std::vector<std::string> ZipfianTokens(size_t num_tokens,
+                                       size_t vocabulary_size, uint64_t seed);
+
+// num_urls distinct URLs built from a small set of hosts and path segments.
+std::vector<std::string> Urls(size_t num_urls, uint64_t seed);
+
+// num_uuids distinct random (version 4) UUIDs in canonical text form.
+std::vector<std::string> Uuids(size_t num_uuids, uint64_t seed);
+
+// num_keys distinct uniformly random int32 keys.
+std::vector<int32_t> Int32Keys(size_t num_keys, uint64_t seed);
+
+}  // namespace intern_benchmarks
+
+#endif /* COM_GITHUB_JEFFMANZIONE_INTERN_BENCHMARKS_CORPORA_H_ */
@@ -0,0 +1,168 @@
+#include "intern/fixed_intern.h"
+
+#include <benchmark/benchmark.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <map>
+#include <vector>
+
+#include "intern/benchmarks/benchmark_stats.h"
+#include "intern/benchmarks/corpora.h"
+
+// An IPv6 address and port, as a 16-byte key with no padding.
+typedef struct {
+  uint32_t address[3];
+  uint16_t port, zone;
+} Endpoint;
+
+static uint32_t hash_endpoint(const Endpoint *endpoint, uint32_t size) {
+  return string_hash((const char *)endpoint, size);
+}
+
+static int32_t compare_endpoints(const Endpoint *endpoint1, uint32_t size1,
+                                 const Endpoint *endpoint2, uint32_t size2) {
+  if (size1 != size2) {
+    return (int32_t)size1 - (int32_t)size2;
+  }
+  return memcmp(endpoint1, endpoint2, size1);
+}
+
+// The same values in a pool with sizes passed at run time.
+DEFINE_INTERN_POOL(SizedEndpointPool, Endpoint);
+IMPL_INTERN_POOL_INLINE(SizedEndpointPool, Endpoint, hash_endpoint,
+                        compare_endpoints);
+
+DEFINE_FIXED_INTERN_POOL(FixedEndpointPool, Endpoint);
+IMPL_FIXED_INTERN_POOL(FixedEndpointPool, Endpoint);
+
+namespace intern_benchmarks {
+namespace {
+
+// Maps a pool type to its generated functions.
+template <typename Pool>
+struct PoolOps;
+
+template <>
+struct PoolOps<SizedEndpointPool> {
+  static void Init(SizedEndpointPool *pool) {
+    SizedEndpointPool_init(pool, /*threadsafe=*/false, NULL, NULL);
+  }
+  static void Finalize(SizedEndpointPool *pool) {
+    SizedEndpointPool_finalize(pool);
+  }
+  static const Endpoint *Intern(SizedEndpointPool *pool,
+                                const Endpoint &endpoint) {
+    return SizedEndpointPool_intern(pool, &endpoint, sizeof(endpoint));
+  }
+  static const SizedEndpointPool &Inner(const SizedEndpointPool &pool) {
+    return pool;
+  }
+};
+
+template <>
+struct PoolOps<FixedEndpointPool> {
+  static void Init(FixedEndpointPool *pool) {
+    FixedEndpointPool_init(pool, /*threadsafe=*/false);
+  }
+  static void Finalize(FixedEndpointPool *pool) {
+    FixedEndpointPool_finalize(pool);
+  }
+  static const Endpoint *Intern(FixedEndpointPool *pool,
+                                const Endpoint &endpoint) {
+    return FixedEndpointPool_intern(pool, &endpoint);
+  }
+  static const FixedEndpointPoolPool &Inner(const FixedEndpointPool &pool) {
+    return pool.pool;
+  }
+};
+
+const std::vector<Endpoint> &Endpoints(size_t n) {
+  static std::map<size_t, std::vector<Endpoint>> cache;
+  std::vector<Endpoint> &endpoints = cache[n];
+  if (endpoints.empty()) {
+    for (int32_t key : Int32Keys(n, /*seed=*/1)) {
+      endpoints.push_back({{0x20010db8u, 0, (uint32_t)key},
+                           (uint16_t)(key >> 16),
+                           0});
+    }
+  }
+  return endpoints;
+}
+
+// Bytes held by the pool: hash table, chunks and the ID directory.
+template <typename InnerPool>
+size_t PoolBytes(const InnerPool &pool) {
+  size_t bytes = TableBytes(pool.hash_set);
+  for (auto *chunk = pool.chunk; chunk != nullptr; chunk = chunk->next) {
+    bytes += sizeof(*chunk) + chunk->sz;
+  }
+  for (uint32_t page = 0; page < INTERN_ID_MAX_PAGES; ++page) {
+    if (pool.id_pages[page] != nullptr) {
+      bytes += sizeof(*pool.id_pages[page])
+               << (page + INTERN_ID_FIRST_PAGE_BITS);
+    }
+  }
+  return bytes;
+}
+
+// Interns state.range(0) distinct endpoints into an empty pool per iteration.
+template <typename Pool>
+void BM_InternMiss(benchmark::State &state) {
+  const std::vector<Endpoint> &endpoints = Endpoints(state.range(0));
+  Pool pool;
+  for (auto _ : state) {
+    PoolOps<Pool>::Init(&pool);
+    for (const Endpoint &endpoint : endpoints) {
+      benchmark::DoNotOptimize(PoolOps<Pool>::Intern(&pool, endpoint));
+    }
+    state.PauseTiming();
+    ReportBytesPerEntry(state, PoolBytes(PoolOps<Pool>::Inner(pool)),
+                        endpoints.size());
+    PoolOps<Pool>::Finalize(&pool);
+    state.ResumeTiming();
+  }
+  ReportTimePerOp(state, endpoints.size());
+}
+
+// Interns state.range(0) endpoints that are all in the pool already.
+template <typename Pool>
+void BM_InternHit(benchmark::State &state) {
+  const std::vector<Endpoint> &endpoints = Endpoints(state.range(0));
+  Pool pool;
+  PoolOps<Pool>::Init(&pool);
+  for (const Endpoint &endpoint : endpoints) {
+    PoolOps<Pool>::Intern(&pool, endpoint);
+  }
+  for (auto _ : state) {
+    for (const Endpoint &endpoint : endpoints) {
+      benchmark::DoNotOptimize(PoolOps<Pool>::Intern(&pool, endpoint));
+    }
+  }
+  ReportTimePerOp(state, endpoints.size());
+  PoolOps<Pool>::Finalize(&pool);
+}
+
+BENCHMARK(BM_InternMiss<SizedEndpointPool>)
+    ->Name("BM_InternMiss/sized")
+    ->Arg(1 << 10)
+    ->Arg(1 << 16)
+    ->Arg(1 << 20);
+BENCHMARK(BM_InternMiss<FixedEndpointPool>)
+    ->Name("BM_InternMiss/fixed")
+    ->Arg(1 << 10)
+    ->Arg(1 << 16)
+    ->Arg(1 << 20);
+BENCHMARK(BM_InternHit<SizedEndpointPool>)
+    ->Name("BM_InternHit/sized")
+    ->Arg(1 << 10)
+    ->Arg(1 << 16)
+    ->Arg(1 << 20);
+BENCHMARK(BM_InternHit<FixedEndpointPool>)
+    ->Name("BM_InternHit/fixed")
+    ->Arg(1 << 10)
+    ->Arg(1 << 16)
+    ->Arg(1 << 20);
+
+}  // namespace
+}  // namespace intern_benchmarks
@@ -0,0 +1,267 @@
+extern "C" {
+#include "intern/internal/hash_set.h"
+}
+
+#include <benchmark/benchmark.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "intern/benchmarks/benchmark_stats.h"
+#include "intern/benchmarks/corpora.h"
+
+// https://en.wikipedia.org/wiki/Fowler%E2%80%93Noll%E2%80%93Vo_hash_function
+#define FNV_32_PRIME (0x01000193)
+#define FNV_1A_32_OFFSET (0x811C9DC5)
+
+static uint32_t hash_int32(const int32_t num, uint32_t size) {
+  return (uint32_t)num * 0x9E3779B1u;
+}
+
+static int32_t compare_int32s(const int32_t num1, uint32_t size1,
+                              const int32_t num2, uint32_t size2) {
+  return (num1 > num2) - (num1 < num2);
+}
+
+static uint32_t hash_string(const char *ptr, uint32_t size) {
+  const unsigned char *s = (const unsigned char *)ptr;
+  uint32_t hval = FNV_1A_32_OFFSET;
+  for (uint32_t i = 0; i < size; ++i) {
+    hval ^= (uint32_t)*s++;
+    hval *= FNV_32_PRIME;
+  }
+  return hval;
+}
+
+static int32_t compare_strings(const char *ptr1, uint32_t size1,
+                               const char *ptr2, uint32_t size2) {
+  if (size1 != size2) {
+    return (int32_t)size1 - (int32_t)size2;
+  }
+  return memcmp(ptr1, ptr2, size1);
+}
+
+DEFINE_HASH_SET(Int32Set, int32_t);
+IMPL_HASH_SET_INLINE(Int32Set, int32_t, hash_int32, compare_int32s);
+
+DEFINE_HASH_SET(StringSet, char *);
+IMPL_HASH_SET_INLINE(StringSet, char *, hash_string, compare_strings);
+
+namespace intern_benchmarks {
+namespace {
+
+enum class Corpus { kInt32, kWords, kUrls, kUuids };
+
+template <typename T>
+struct Key {
+  T value;
+  uint32_t size;
+};
+
+// Maps a value type to its generated set and corpus.
+template <typename T>
+struct SetOps;
+
+template <>
+struct SetOps<int32_t> {
+  using Set = Int32Set;
+  static void Init(Set *set) {
+    Int32Set_init(set, DEFAULT_TABLE_SIZE, NULL, NULL);
+  }
+  static void Finalize(Set *set) { Int32Set_finalize(set); }
+  static bool Insert(Set *set, const Key<int32_t> &key) {
+    return Int32Set_insert(set, key.value, key.size);
+  }
+  static int32_t Find(const Set *set, const Key<int32_t> &key) {
+    return Int32Set_find(set, key.value, key.size, 0);
+  }
+  static bool Remove(Set *set, const Key<int32_t> &key) {
+    return Int32Set_remove(set, key.value, key.size);
+  }
+  // Distinct keys. The returned reference stays valid.
+  static const std::vector<Key<int32_t>> &Keys(Corpus corpus, size_t n) {
+    static std::map<size_t, std::vector<Key<int32_t>>> cache;
+    std::vector<Key<int32_t>> &keys = cache[n];
+    if (keys.empty()) {
+      for (int32_t key : Int32Keys(n, /*seed=*/1)) {
+        keys.push_back({key, sizeof(int32_t)});
+      }
+    }
+    return keys;
+  }
+};
+
+template <>
+struct SetOps<char *> {
+  using Set = StringSet;
+  static void Init(Set *set) {
+    StringSet_init(set, DEFAULT_TABLE_SIZE, NULL, NULL);
+  }
+  static void Finalize(Set *set) { StringSet_finalize(set); }
+  static bool Insert(Set *set, const Key<char *> &key) {
+    return StringSet_insert(set, key.value, key.size);
+  }
+  static char *Find(const Set *set, const Key<char *> &key) {
+    return StringSet_find(set, key.value, key.size, NULL);
+  }
+  static bool Remove(Set *set, const Key<char *> &key) {
+    return StringSet_remove(set, key.value, key.size);
+  }
+  static const std::vector<Key<char *>> &Keys(Corpus corpus,
+                                                    size_t n) {
+    static std::map<std::pair<Corpus, size_t>, std::vector<std::string>>
+        strings;
+    static std::map<std::pair<Corpus, size_t>,
+                    std::vector<Key<char *>>>
+        cache;
+    std::vector<Key<char *>> &keys = cache[{corpus, n}];
+    if (keys.empty()) {
+      std::vector<std::string> &values = strings[{corpus, n}];
+      switch (corpus) {
+        case Corpus::kWords:
+          values = Words(n, /*seed=*/1);
+          break;
+        case Corpus::kUrls:
+          values = Urls(n, /*seed=*/1);
+          break;
+        default:
+          values = Uuids(n, /*seed=*/1);
+          break;
+      }
+      for (const std::string &value : values) {
+        keys.push_back({(char *)value.c_str(), (uint32_t)value.size()});
+      }
+    }
+    return keys;
+  }
+};
+
+// The same keys in a fixed random order, so finds do not follow insertion
+// order.
+template <typename T>
+std::vector<Key<T>> Shuffled(const std::vector<Key<T>> &keys) {
+  std::vector<Key<T>> shuffled = keys;
+  std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937_64(2));
+  return shuffled;
+}
+
+template <typename T>
+void ReportTableStats(benchmark::State &state,
+                      const typename SetOps<T>::Set &set) {
+  ReportBytesPerEntry(state, TableBytes(set), set.num_entries);
+  ReportProbeLengths(state, ProbeLengths(set));
+}
+
+template <typename T>
+void BM_HashSetInsert(benchmark::State &state, Corpus corpus) {
+  const std::vector<Key<T>> &keys = SetOps<T>::Keys(corpus, state.range(0));
+  typename SetOps<T>::Set set;
+  for (auto _ : state) {
+    SetOps<T>::Init(&set);
+    for (const Key<T> &key : keys) {
+      benchmark::DoNotOptimize(SetOps<T>::Insert(&set, key));
+    }
+    state.PauseTiming();
+    SetOps<T>::Finalize(&set);
+    state.ResumeTiming();
+  }
+  SetOps<T>::Init(&set);
+  for (const Key<T> &key : keys) {
+    SetOps<T>::Insert(&set, key);
+  }
+  ReportTableStats<T>(state, set);
+  SetOps<T>::Finalize(&set);
+  ReportTimePerOp(state, keys.size());
+}
+
+template <typename T>
+void BM_HashSetFindHit(benchmark::State &state, Corpus corpus) {
+  const std::vector<Key<T>> &keys = SetOps<T>::Keys(corpus, state.range(0));
+  const std::vector<Key<T>> lookups = Shuffled(keys);
+  typename SetOps<T>::Set set;
+  SetOps<T>::Init(&set);
+  for (const Key<T> &key : keys) {
+    SetOps<T>::Insert(&set, key);
+  }
+  for (auto _ : state) {
+    for (const Key<T> &key : lookups) {
+      benchmark::DoNotOptimize(SetOps<T>::Find(&set, key));
+    }
+  }
+  ReportTableStats<T>(state, set);
+  SetOps<T>::Finalize(&set);
+  ReportTimePerOp(state, lookups.size());
+}
+
+template <typename T>
+void BM_HashSetFindMiss(benchmark::State &state, Corpus corpus) {
+  // The first half is stored and the second half is looked up.
+  const std::vector<Key<T>> &keys =
+      SetOps<T>::Keys(corpus, 2 * state.range(0));
+  typename SetOps<T>::Set set;
+  SetOps<T>::Init(&set);
+  for (size_t i = 0; i < keys.size() / 2; ++i) {
+    SetOps<T>::Insert(&set, keys[i]);
+  }
+  for (auto _ : state) {
+    for (size_t i = keys.size() / 2; i < keys.size(); ++i) {
+      benchmark::DoNotOptimize(SetOps<T>::Find(&set, keys[i]));
+    }
+  }
+  ReportTableStats<T>(state, set);
+  SetOps<T>::Finalize(&set);
+  ReportTimePerOp(state, keys.size() - keys.size() / 2);
+}
+
+template <typename T>
+void BM_HashSetRemove(benchmark::State &state, Corpus corpus) {
+  const std::vector<Key<T>> &keys = SetOps<T>::Keys(corpus, state.range(0));
+  const std::vector<Key<T>> removals = Shuffled(keys);
+  typename SetOps<T>::Set set;
+  for (auto _ : state) {
+    state.PauseTiming();
+    SetOps<T>::Init(&set);
+    for (const Key<T> &key : keys) {
+      SetOps<T>::Insert(&set, key);
+    }
+    state.ResumeTiming();
+    for (const Key<T> &key : removals) {
+      benchmark::DoNotOptimize(SetOps<T>::Remove(&set, key));
+    }
+    state.PauseTiming();
+    SetOps<T>::Finalize(&set);
+    state.ResumeTiming();
+  }
+  ReportTimePerOp(state, removals.size());
+}
+
+template <typename T>
+void RegisterHashSetBenchmarks(Corpus corpus, const std::string &corpus_name) {
+  const auto add = [&](const std::string &name,
+                       void (*fn)(benchmark::State &, Corpus)) {
+    benchmark::RegisterBenchmark((name + "/" + corpus_name).c_str(), fn,
+                                 corpus)
+        ->RangeMultiplier(32)
+        ->Range(1 << 10, 1 << 20);
+  };
+  add("BM_HashSetInsert", BM_HashSetInsert<T>);
+  add("BM_HashSetFindHit", BM_HashSetFindHit<T>);
+  add("BM_HashSetFindMiss", BM_HashSetFindMiss<T>);
+  add("BM_HashSetRemove", BM_HashSetRemove<T>);
+}
+
+const bool registered = [] {
+  RegisterHashSetBenchmarks<int32_t>(Corpus::kInt32, "int32");
+  RegisterHashSetBenchmarks<char *>(Corpus::kWords, "words");
+  RegisterHashSetBenchmarks<char *>(Corpus::kUrls, "urls");
+  RegisterHashSetBenchmarks<char *>(Corpus::kUuids, "uuids");
+  return true;
+}();
+
+}  // namespace
+}  // namespace intern_benchmarks
@@ -0,0 +1,251 @@
+#include "intern/intern.h"
+
+#include <benchmark/benchmark.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "intern/benchmarks/benchmark_stats.h"
+#include "intern/benchmarks/corpora.h"
+
+#if defined(INTERN_BENCHMARK_STRING_POOL)
+
+#include "intern/string_intern.h"
+
+DEFINE_STRING_INTERN_POOL(StringInternPool);
+IMPL_STRING_INTERN_POOL(StringInternPool);
+
+#else
+
+// https://en.wikipedia.org/wiki/Fowler%E2%80%93Noll%E2%80%93Vo_hash_function
+#define FNV_32_PRIME (0x01000193)
+#define FNV_1A_32_OFFSET (0x811C9DC5)
+
+static uint32_t hash_string(const char *ptr, uint32_t size) {
+  const unsigned char *s = (const unsigned char *)ptr;
+  uint32_t hval = FNV_1A_32_OFFSET;
+  for (uint32_t i = 0; i < size; ++i) {
+    hval ^= (uint32_t)*s++;
+    hval *= FNV_32_PRIME;
+  }
+  return hval;
+}
+
+static int32_t compare_strings(const char *ptr1, uint32_t size1,
+                               const char *ptr2, uint32_t size2) {
+  if (size1 != size2) {
+    return (int32_t)size1 - (int32_t)size2;
+  }
+  return memcmp(ptr1, ptr2, size1);
+}
+
+DEFINE_INTERN_POOL(StringInternPool, char);
+IMPL_INTERN_POOL_INLINE(StringInternPool, char, hash_string, compare_strings);
+
+#endif
+
+namespace intern_benchmarks {
+namespace {
+
+// Values interned per benchmark iteration.
+constexpr size_t kValuesPerIteration = 1024;
+
+// Length of the Zipfian token streams, cycled through by the benchmarks.
+constexpr size_t kStreamLength = 1 << 20;
+
+// Iterations per thread of the miss-heavy benchmarks, which need a fresh
+// value for every intern and so cannot run for an open-ended time.
+constexpr int64_t kMissIterations = 256;
+
+enum class Corpus { kUrls, kUuids };
+
+// Shared by the threads of the running benchmark, and set up and torn down
+// once per run by the Setup and Teardown functions.
+StringInternPool pool;
+const std::vector<std::string> *values;
+
+// Bytes held by the pool: hash table, chunks and the ID directory.
+size_t PoolBytes(const StringInternPool &pool) {
+  size_t bytes = TableBytes(pool.hash_set);
+  for (const StringInternPoolChunk *chunk = pool.chunk; chunk != nullptr;
+       chunk = chunk->next) {
+    bytes += sizeof(StringInternPoolChunk) + chunk->sz;
+  }
+  for (uint32_t page = 0; page < INTERN_ID_MAX_PAGES; ++page) {
+    if (pool.id_pages[page] != nullptr) {
+      bytes += sizeof(StringInternPoolIdEntry)
+               << (page + INTERN_ID_FIRST_PAGE_BITS);
+    }
+  }
+  return bytes;
+}
+
+const std::vector<std::string> &CachedTokens(size_t vocabulary_size) {
+  static std::map<size_t, std::vector<std::string>> cache;
+  std::vector<std::string> &tokens = cache[vocabulary_size];
+  if (tokens.empty()) {
+    tokens = ZipfianTokens(kStreamLength, vocabulary_size, /*seed=*/1);
+  }
+  return tokens;
+}
+
+// A Zipfian stream over a vocabulary of state.range(0) words, none of which
+// are interned yet.
+void SetUpEmptyPool(const benchmark::State &state) {
+  StringInternPool_init(&pool, /*threadsafe=*/true, NULL, NULL);
+  values = &CachedTokens(state.range(0));
+}
+
+// Like SetUpEmptyPool, but with the whole vocabulary interned.
+void SetUpFullPool(const benchmark::State &state) {
+  SetUpEmptyPool(state);
+  for (const std::string &word : Words(state.range(0), /*seed=*/1)) {
+    StringInternPool_intern(&pool, word.data(), (uint32_t)word.size());
+  }
+}
+
+// kMissIterations * kValuesPerIteration distinct values per thread. If
+// reserved, the pool is initialized with capacity for all of them.
+template <Corpus corpus, bool reserved = false>
+void SetUpDistinctValues(const benchmark::State &state) {
+  static std::map<size_t, std::vector<std::string>> cache;
+  const size_t num_values =
+      kMissIterations * kValuesPerIteration * state.threads();
+  std::vector<std::string> &distinct = cache[num_values];
+  if (distinct.empty()) {
+    distinct = corpus == Corpus::kUrls ? Urls(num_values, /*seed=*/1)
+                                       : Uuids(num_values, /*seed=*/1);
+  }
+  values = &distinct;
+  if (!reserved) {
+    StringInternPool_init(&pool, /*threadsafe=*/true, NULL, NULL);
+    return;
+  }
+  uint64_t num_bytes = 0;
+  for (const std::string &value : distinct) {
+    num_bytes += value.size();
+  }
+  StringInternPool_init_with_capacity(&pool, (uint32_t)num_values, num_bytes,
+                                      /*threadsafe=*/true, NULL, NULL);
+}
+
+void TearDownPool(const benchmark::State &state) {
+  StringInternPool_finalize(&pool);
+}
+
+void ReportPoolStats(benchmark::State &state) {
+  if (state.thread_index() == 0) {
+    ReportBytesPerEntry(state, PoolBytes(pool), pool.num_ids);
+    ReportProbeLengths(state, ProbeLengths(pool.hash_set));
+  }
+  ReportTimePerOp(state, kValuesPerIteration);
+}
+
+// Interns kValuesPerIteration tokens of the stream per iteration, each thread
+// starting at a different point of it.
+//
+// Hit-heavy after SetUpFullPool. Mixed after SetUpEmptyPool: the first
+// occurrence of each token is a miss and the rest are hits, as when interning
+// a document.
+void BM_InternTokens(benchmark::State &state) {
+  const std::vector<std::string> &tokens = *values;
+  size_t i = state.thread_index() * (tokens.size() / state.threads());
+  for (auto _ : state) {
+    for (size_t n = 0; n < kValuesPerIteration; ++n) {
+      const std::string &token = tokens[i];
+      benchmark::DoNotOptimize(StringInternPool_intern(
+          &pool, token.data(), (uint32_t)token.size()));
+      i = i + 1 == tokens.size() ? 0 : i + 1;
+    }
+  }
+  ReportPoolStats(state);
+}
+
+// Miss-heavy: every value is new to the pool. Each thread interns its own
+// slice of the distinct values.
+void BM_InternDistinct(benchmark::State &state) {
+  const std::vector<std::string> &distinct = *values;
+  size_t i = state.thread_index() * kMissIterations * kValuesPerIteration;
+  for (auto _ : state) {
+    for (size_t n = 0; n < kValuesPerIteration; ++n, ++i) {
+      benchmark::DoNotOptimize(StringInternPool_intern(
+          &pool, distinct[i].data(), (uint32_t)distinct[i].size()));
+    }
+  }
+  ReportPoolStats(state);
+}
+
+// Like BM_InternDistinct, but times every intern to expose the latency of the
+// interns that resize the hash set.
+void BM_InternLatency(benchmark::State &state) {
+  const std::vector<std::string> &distinct = *values;
+  std::vector<int64_t> latencies_ns;
+  latencies_ns.reserve(kMissIterations * kValuesPerIteration);
+  size_t i = state.thread_index() * kMissIterations * kValuesPerIteration;
+  for (auto _ : state) {
+    for (size_t n = 0; n < kValuesPerIteration; ++n, ++i) {
+      const auto start = std::chrono::steady_clock::now();
+      benchmark::DoNotOptimize(StringInternPool_intern(
+          &pool, distinct[i].data(), (uint32_t)distinct[i].size()));
+      const auto elapsed = std::chrono::steady_clock::now() - start;
+      latencies_ns.push_back(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+              .count());
+    }
+  }
+  ReportLatencies(state, std::move(latencies_ns));
+  ReportPoolStats(state);
+}
+
+BENCHMARK(BM_InternTokens)
+    ->Name("BM_InternHit")
+    ->Setup(SetUpFullPool)
+    ->Teardown(TearDownPool)
+    ->Arg(1 << 10)
+    ->Arg(1 << 16)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+BENCHMARK(BM_InternTokens)
+    ->Name("BM_InternMixed")
+    ->Setup(SetUpEmptyPool)
+    ->Teardown(TearDownPool)
+    ->Arg(1 << 10)
+    ->Arg(1 << 16)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+BENCHMARK(BM_InternDistinct)
+    ->Name("BM_InternMiss/urls")
+    ->Setup(SetUpDistinctValues<Corpus::kUrls>)
+    ->Teardown(TearDownPool)
+    ->Iterations(kMissIterations)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+BENCHMARK(BM_InternDistinct)
+    ->Name("BM_InternMiss/uuids")
+    ->Setup(SetUpDistinctValues<Corpus::kUuids>)
+    ->Teardown(TearDownPool)
+    ->Iterations(kMissIterations)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+BENCHMARK(BM_InternDistinct)
+    ->Name("BM_InternMiss/urls/reserved")
+    ->Setup(SetUpDistinctValues<Corpus::kUrls, /*reserved=*/true>)
+    ->Teardown(TearDownPool)
+    ->Iterations(kMissIterations)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+BENCHMARK(BM_InternLatency)
+    ->Name("BM_InternLatency/urls")
+    ->Setup(SetUpDistinctValues<Corpus::kUrls>)
+    ->Teardown(TearDownPool)
+    ->Iterations(kMissIterations)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace intern_benchmarks
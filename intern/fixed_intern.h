@@ -0,0 +1,130 @@
+#ifndef COM_GITHUB_JEFFMANZIONE_INTERN_FIXED_INTERN_H_
+#define COM_GITHUB_JEFFMANZIONE_INTERN_FIXED_INTERN_H_
+
+/**
+ * @file fixed_intern.h
+ * @brief Intern pool of fixed-size values such as structs and integers.
+ *
+ * Every value of a fixed pool is sizeof(value_type) bytes, so no function takes
+ * a size and neither hash set entries nor ID directory entries store one.
+ * Values are stored in naturally aligned slots, and are hashed (with
+ * string_hash) and compared as raw bytes of a size known at compile time, so
+ * comparisons compile down to a few word compares.
+ *
+ * Because whole values are hashed and compared, any padding bytes in
+ * value_type must be zeroed (e.g. with memset) before interning.
+ *
+ * Usage:
+ *    DEFINE_FIXED_INTERN_POOL(Endpoints, Endpoint)
+ *    IMPL_FIXED_INTERN_POOL(Endpoints, Endpoint)
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "intern/intern.h"
+#include "intern/internal/string_hash.h"
+
+/**
+ * DEFINE_FIXED_INTERN_POOL(name, value_type)
+ *
+ * Generates:
+ *   - An intern pool type name##Pool holding the values
+ *   - Fixed pool struct wrapping it
+ *   - Functions:
+ *       name_init, name_init_with_capacity, name_finalize, name_intern,
+ *       name_lookup, name_intern_id, name_lookup_id, name_freeze,
+ *       name_get_stats
+ *
+ * value_type must not be over-aligned, i.e. its alignment must not exceed that
+ * of malloc.
+ */
+#define DEFINE_FIXED_INTERN_POOL(name, value_type)                       \
+  DEFINE_INTERN_POOL_SIZE_MODE(name##Pool, value_type, UNSIZED);         \
+                                                                         \
+  typedef struct {                                                       \
+    name##Pool pool;                                                     \
+  } name;                                                                \
+                                                                         \
+  void name##_init(name *pool, bool threadsafe);                         \
+  /* Like name_init, but presizes the pool for expected_values values */ \
+  void name##_init_with_capacity(name *pool, uint32_t expected_values,   \
+                                 bool threadsafe);                       \
+  void name##_finalize(name *pool);                                      \
+  const value_type *name##_intern(name *pool, const value_type *value);  \
+  const value_type *name##_lookup(name *pool, const value_type *value);  \
+  uint32_t name##_intern_id(name *pool, const value_type *value);        \
+  const value_type *name##_lookup_id(const name *pool, uint32_t id);     \
+  bool name##_freeze(name *pool);                                        \
+  void name##_get_stats(name *pool, InternPoolStats *stats);
+
+/**
+ * IMPL_FIXED_INTERN_POOL(name, value_type)
+ *
+ * Defines functions generated by DEFINE_FIXED_INTERN_POOL.
+ */
+#define IMPL_FIXED_INTERN_POOL(name, value_type)                            \
+  /* The size arguments are always sizeof(value_type) */                    \
+  static inline uint32_t name##_hash_value(const value_type *value,         \
+                                           uint32_t value_size) {           \
+    return string_hash((const char *)value, sizeof(value_type));            \
+  }                                                                         \
+                                                                            \
+  /* Only ever tested for equality, so memcmp of a constant size is inlined \
+   * as word compares */                                                    \
+  static inline int32_t name##_compare_values(                              \
+      const value_type *value1, uint32_t size1, const value_type *value2,   \
+      uint32_t size2) {                                                     \
+    return memcmp(value1, value2, sizeof(value_type));                      \
+  }                                                                         \
+                                                                            \
+  IMPL_HASH_SET_FIXED(name##PoolHashSet, value_type *, name##_hash_value,   \
+                      name##_compare_values);                               \
+  IMPL_INTERN_POOL_FUNCTIONS(name##Pool, value_type, name##_compare_values, \
+                             UNSIZED)                                       \
+                                                                            \
+  void name##_init(name *pool, bool threadsafe) {                           \
+    name##_init_with_capacity(pool, 0, threadsafe);                         \
+  }                                                                         \
+                                                                            \
+  void name##_init_with_capacity(name *pool, uint32_t expected_values,      \
+                                 bool threadsafe) {                         \
+    name##Pool_init_with_capacity(                                          \
+        &pool->pool, expected_values,                                       \
+        (uint64_t)expected_values * sizeof(value_type), threadsafe, NULL,   \
+        NULL);                                                              \
+  }                                                                         \
+                                                                            \
+  void name##_finalize(name *pool) { name##Pool_finalize(&pool->pool); }    \
+                                                                            \
+  const value_type *name##_intern(name *pool, const value_type *value) {    \
+    return name##Pool_intern(&pool->pool, value, sizeof(value_type));       \
+  }                                                                         \
+                                                                            \
+  const value_type *name##_lookup(name *pool, const value_type *value) {    \
+    return name##Pool_lookup(&pool->pool, value, sizeof(value_type));       \
+  }                                                                         \
+                                                                            \
+  uint32_t name##_intern_id(name *pool, const value_type *value) {          \
+    return name##Pool_intern_id(&pool->pool, value, sizeof(value_type));    \
+  }                                                                         \
+                                                                            \
+  const value_type *name##_lookup_id(const name *pool, uint32_t id) {       \
+    return name##Pool_lookup_id(&pool->pool, id, NULL);                     \
+  }                                                                         \
+                                                                            \
+  bool name##_freeze(name *pool) { return name##Pool_freeze(&pool->pool); } \
+                                                                            \
+  void name##_get_stats(name *pool, InternPoolStats *stats) {               \
+    name##Pool_get_stats(&pool->pool, stats);                               \
+  }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COM_GITHUB_JEFFMANZIONE_INTERN_FIXED_INTERN_H_ */
@@ -0,0 +1,153 @@
+#include "intern/fixed_intern.h"
+
+#include <gmock/gmock-matchers.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using namespace testing;
+
+// An IPv6 address and port, with trailing padding.
+typedef struct {
+  uint64_t address[2];
+  uint16_t port;
+} Endpoint;
+
+// A 12-byte composite key.
+typedef struct {
+  uint32_t table, row, column;
+} CellKey;
+
+DEFINE_FIXED_INTERN_POOL(EndpointPool, Endpoint);
+IMPL_FIXED_INTERN_POOL(EndpointPool, Endpoint);
+
+DEFINE_FIXED_INTERN_POOL(CellKeyPool, CellKey);
+IMPL_FIXED_INTERN_POOL(CellKeyPool, CellKey);
+
+Endpoint MakeEndpoint(uint64_t address, uint16_t port) {
+  Endpoint endpoint;
+  // Zeroes the padding, which is hashed and compared.
+  memset(&endpoint, 0, sizeof(endpoint));
+  endpoint.address[0] = address;
+  endpoint.address[1] = ~address;
+  endpoint.port = port;
+  return endpoint;
+}
+
+bool IsAligned(const void *ptr, size_t alignment) {
+  return reinterpret_cast<uintptr_t>(ptr) % alignment == 0;
+}
+
+class EndpointPoolTest : public Test {
+ protected:
+  EndpointPoolTest() { EndpointPool_init(&intern_pool, /*threadsafe=*/false); }
+  ~EndpointPoolTest() { EndpointPool_finalize(&intern_pool); }
+  EndpointPool intern_pool;
+};
+
+TEST_F(EndpointPoolTest, InternPoolN) {
+  const Endpoint a = MakeEndpoint(1, 80);
+  const Endpoint b = MakeEndpoint(1, 443);
+  const Endpoint *interned_a = EndpointPool_intern(&intern_pool, &a);
+  const Endpoint *interned_b = EndpointPool_intern(&intern_pool, &b);
+  ASSERT_THAT(interned_a, NotNull());
+  ASSERT_THAT(interned_b, NotNull());
+  EXPECT_NE(interned_a, interned_b);
+  EXPECT_NE(&a, interned_a);
+  EXPECT_EQ(0, memcmp(&a, interned_a, sizeof(a)));
+
+  const Endpoint a_copy = MakeEndpoint(1, 80);
+  EXPECT_EQ(interned_a, EndpointPool_intern(&intern_pool, &a_copy));
+  EXPECT_EQ(interned_a, EndpointPool_lookup(&intern_pool, &a_copy));
+  const Endpoint c = MakeEndpoint(2, 80);
+  EXPECT_THAT(EndpointPool_lookup(&intern_pool, &c), IsNull());
+}
+
+TEST_F(EndpointPoolTest, ValuesAreAligned) {
+  // Enough values to span several chunks.
+  for (uint32_t i = 0; i < 100000; ++i) {
+    const Endpoint endpoint = MakeEndpoint(i, (uint16_t)i);
+    const Endpoint *interned = EndpointPool_intern(&intern_pool, &endpoint);
+    ASSERT_TRUE(IsAligned(interned, alignof(Endpoint))) << i;
+    ASSERT_EQ(interned->address[0], i);
+  }
+  EXPECT_EQ(100000, intern_pool.pool.num_ids);
+}
+
+TEST_F(EndpointPoolTest, Ids) {
+  const Endpoint a = MakeEndpoint(1, 80);
+  const Endpoint b = MakeEndpoint(2, 80);
+  EXPECT_EQ(0, EndpointPool_intern_id(&intern_pool, &a));
+  EXPECT_EQ(1, EndpointPool_intern_id(&intern_pool, &b));
+  EXPECT_EQ(0, EndpointPool_intern_id(&intern_pool, &a));
+  EXPECT_EQ(EndpointPool_lookup(&intern_pool, &b),
+            EndpointPool_lookup_id(&intern_pool, 1));
+  EXPECT_THAT(EndpointPool_lookup_id(&intern_pool, 2), IsNull());
+}
+
+TEST_F(EndpointPoolTest, Freeze) {
+  std::vector<const Endpoint *> interned;
+  for (uint32_t i = 0; i < 1000; ++i) {
+    const Endpoint endpoint = MakeEndpoint(i, 80);
+    interned.push_back(EndpointPool_intern(&intern_pool, &endpoint));
+  }
+  ASSERT_TRUE(EndpointPool_freeze(&intern_pool));
+  for (uint32_t i = 0; i < 1000; ++i) {
+    const Endpoint endpoint = MakeEndpoint(i, 80);
+    EXPECT_EQ(interned[i], EndpointPool_lookup(&intern_pool, &endpoint));
+  }
+  const Endpoint absent = MakeEndpoint(1000, 80);
+  EXPECT_THAT(EndpointPool_intern(&intern_pool, &absent), IsNull());
+}
+
+TEST(FixedInternPoolTest, EntriesHoldNoSizes) {
+  EXPECT_EQ(sizeof(Endpoint *), sizeof(EndpointPoolPoolIdEntry));
+}
+
+TEST(FixedInternPoolTest, InitWithCapacity) {
+  CellKeyPool intern_pool;
+  CellKeyPool_init_with_capacity(&intern_pool, 10000, /*threadsafe=*/false);
+  const uint32_t table_size = intern_pool.pool.hash_set.table_size;
+  for (uint32_t i = 0; i < 10000; ++i) {
+    const CellKey key = {i % 7, i, i * 31};
+    const CellKey *interned = CellKeyPool_intern(&intern_pool, &key);
+    ASSERT_TRUE(IsAligned(interned, alignof(CellKey)));
+    ASSERT_EQ(0, memcmp(&key, interned, sizeof(key)));
+  }
+  EXPECT_EQ(table_size, intern_pool.pool.hash_set.table_size);
+  EXPECT_EQ(intern_pool.pool.chunk, intern_pool.pool.last);
+  CellKeyPool_finalize(&intern_pool);
+}
+
+TEST(FixedInternPoolTest, ConcurrentInterns) {
+  constexpr int kNumThreads = 4;
+  constexpr uint32_t kNumValues = 10000;
+  CellKeyPool intern_pool;
+  CellKeyPool_init(&intern_pool, /*threadsafe=*/true);
+  std::vector<std::vector<const CellKey *>> interned(kNumThreads);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; ++t) {
+    threads.emplace_back([&, t] {
+      for (uint32_t i = 0; i < kNumValues; ++i) {
+        const CellKey key = {1, i, 2};
+        interned[t].push_back(CellKeyPool_intern(&intern_pool, &key));
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  for (int t = 1; t < kNumThreads; ++t) {
+    EXPECT_EQ(interned[0], interned[t]);
+  }
+  EXPECT_EQ(kNumValues, intern_pool.pool.num_ids);
+  CellKeyPool_finalize(&intern_pool);
+}
+
+}  // namespace
@@ -9,6 +9,29 @@
  * chunks and deduplicates them using a hash set. A reader–writer lock
  * optionally guards concurrent access.
  *
+ * Every interned value is also assigned a dense uint32_t ID in interning order.
+ * IDs are stored in a small header in front of each value and resolved back to
+ * values through a directory of geometrically growing pages, so directory
+ * entries never move once written.
+ *
+ * In thread-safe mode, lookups of already interned values take no lock. They
+ * run against the hash set under a sequence counter and fall back to the read
+ * lock only if a writer interferes. Tables replaced by a resize are reclaimed
+ * through epoch-based deferred free (see internal/epoch.h).
+ *
+ * A pool that will no longer grow can be frozen. Freezing replaces the hash set
+ * with a minimal perfect hash index (see internal/perfect_hash.h), after which
+ * lookups never lock and compare against a single candidate, and every intern
+ * call fails.
+ *
+ * A pool can also be saved to a snapshot file (see internal/snapshot.h) and
+ * later opened by memory-mapping it. An opened pool is frozen, and its values
+ * and index are used in place from the mapping.
+ *
+ * Built with INTERN_THREAD_CACHE, name_intern first checks a small per-thread
+ * cache of recently interned values (see internal/thread_cache.h), so hot
+ * values resolve without touching memory shared with other threads.
+ *
  * Usage:
  *    DEFINE_INTERN_POOL(MyStrings, char)
  *    IMPL_INTERN_POOL(MyStrings, char)
@@ -22,13 +45,547 @@
 extern "C" {
 #endif
 
+#include "intern/internal/epoch.h"
 #include "intern/internal/hash_set.h"
 #include "intern/internal/intern_helpers.h"
+#include "intern/internal/pages.h"
+#include "intern/internal/perfect_hash.h"
+#include "intern/internal/platform.h"
 #include "intern/internal/rwlock.h"
+#include "intern/internal/snapshot.h"
+#include "intern/internal/stats.h"
+#include "intern/internal/thread_cache.h"
 
 #define DEFAULT_MAX_VALUES_PER_CHUNK 64
 
+// Chunk growth policy. Chunks start at INTERN_CHUNK_INITIAL_SIZE bytes (or
+// room for DEFAULT_MAX_VALUES_PER_CHUNK values if larger) and each new chunk is
+// INTERN_CHUNK_GROWTH_FACTOR times the previous one, up to
+// INTERN_CHUNK_MAX_SIZE bytes. Each may be overridden at build time.
+#ifndef INTERN_CHUNK_INITIAL_SIZE
+#define INTERN_CHUNK_INITIAL_SIZE 4096
+#endif
+
+#ifndef INTERN_CHUNK_GROWTH_FACTOR
+#define INTERN_CHUNK_GROWTH_FACTOR 2
+#endif
+
+#ifndef INTERN_CHUNK_MAX_SIZE
+#define INTERN_CHUNK_MAX_SIZE (2 * 1024 * 1024)
+#endif
+
+// True if a value should get a dedicated chunk instead of starting a new chunk
+// of chunk_size bytes, which would waste the rest of the active one.
+#define IS_OVERSIZED_VALUE(value_size, chunk_size) \
+  ((value_size) > (chunk_size) / 4)
+
+// log2 of the number of IDs in the first page of the ID directory. Page k holds
+// twice as many IDs as page k - 1.
+#define INTERN_ID_FIRST_PAGE_BITS 8
+
+// Number of pages needed to hold every uint32_t ID.
+#define INTERN_ID_MAX_PAGES (32 - INTERN_ID_FIRST_PAGE_BITS + 1)
+
+// Page of the ID directory holding id.
+#define INTERN_ID_PAGE(id)                                                  \
+  (compute_floor_log2((uint64_t)(id) + (1u << INTERN_ID_FIRST_PAGE_BITS)) - \
+   INTERN_ID_FIRST_PAGE_BITS)
+
+// Position of id within its page of the ID directory.
+#define INTERN_ID_PAGE_OFFSET(id, page)                 \
+  ((uint64_t)(id) + (1u << INTERN_ID_FIRST_PAGE_BITS) - \
+   ((uint64_t)1 << ((page) + INTERN_ID_FIRST_PAGE_BITS)))
+
+// Bytes in front of each stored value that hold its ID, keeping values aligned.
+#define INTERN_ID_HEADER_SIZE(value_type) \
+  MAX_VALUE(sizeof(uint32_t), ALIGN_OF(value_type))
+
+// ID returned by name_intern_id when the value could not be interned.
+#define INTERN_INVALID_ID UINT32_MAX
+
+// Number of values ahead of the current one whose table slots are prefetched by
+// name_intern_batch.
+#define INTERN_BATCH_PREFETCH_DISTANCE 8
+
+// Snapshot of a pool returned by name_get_stats().
+typedef struct {
+  HashSetStats hash_set;  // Empty once the pool is frozen
+  uint32_t num_values;
+  uint32_t num_chunks;
+  uint64_t chunk_bytes_allocated;
+  // Only kept by refcounted pools (see INTERN_REFCOUNTED), and 0 otherwise.
+  uint64_t chunk_bytes_live;       // Values not released and their headers
+  uint64_t chunk_bytes_discarded;  // Returned to the OS by compaction
+  // The counters below are only kept with INTERN_ENABLE_STATS and are 0
+  // otherwise.
+  uint64_t chunk_bytes_used;   // Values and their ID headers
+  uint64_t wasted_tail_bytes;  // Left over at the end of chunks that filled up
+  uint64_t read_locks;
+  uint64_t write_locks;
+  uint64_t read_lock_wait_ns;  // Spent acquiring the read lock
+  uint64_t write_lock_wait_ns;
+  uint64_t thread_cache_hits;  // Interns resolved by a thread cache
+  // Misses looked up again under the write lock because another thread
+  // wrote to the hash set after the first lookup
+  uint64_t miss_reprobes;
+} InternPoolStats;
+
+#if defined(INTERN_ENABLE_STATS)
+// Counters kept by every pool in addition to those of its hash set. Readers
+// take the lock concurrently, so they are striped (see internal/stats.h).
+enum {
+  INTERN_STAT_CHUNK_BYTES_USED,
+  INTERN_STAT_WASTED_TAIL_BYTES,
+  INTERN_STAT_READ_LOCKS,
+  INTERN_STAT_WRITE_LOCKS,
+  INTERN_STAT_READ_LOCK_WAIT_NS,
+  INTERN_STAT_WRITE_LOCK_WAIT_NS,
+  INTERN_STAT_THREAD_CACHE_HITS,
+  INTERN_STAT_MISS_REPROBES,
+};
+
+#define INTERN_STATS_FIELDS StripedCounters stats;
+
+#define INTERN_INIT_STATS(pool) striped_counters_init(&(pool)->stats)
+
+#define INTERN_COUNT(pool, counter, n) \
+  striped_counters_add(&(pool)->stats, INTERN_STAT_##counter, (n))
+
+// Takes the pool lock with lock_fn, counting the time spent waiting for it.
+#define INTERN_LOCK(pool, lock_fn, kind)            \
+  do {                                              \
+    const uint64_t lock_start_ns_ = stats_now_ns(); \
+    lock_fn(&(pool)->rwlock);                       \
+    INTERN_COUNT(pool, kind##_LOCKS, 1);            \
+    INTERN_COUNT(pool, kind##_LOCK_WAIT_NS,         \
+                 stats_now_ns() - lock_start_ns_);  \
+  } while (0)
+
+#define INTERN_READ_STATS(pool, out)                                     \
+  do {                                                                   \
+    const StripedCounters *counters_ = &(pool)->stats;                   \
+    (out)->chunk_bytes_used =                                            \
+        striped_counters_sum(counters_, INTERN_STAT_CHUNK_BYTES_USED);   \
+    (out)->wasted_tail_bytes =                                           \
+        striped_counters_sum(counters_, INTERN_STAT_WASTED_TAIL_BYTES);  \
+    (out)->read_locks =                                                  \
+        striped_counters_sum(counters_, INTERN_STAT_READ_LOCKS);         \
+    (out)->write_locks =                                                 \
+        striped_counters_sum(counters_, INTERN_STAT_WRITE_LOCKS);        \
+    (out)->read_lock_wait_ns =                                           \
+        striped_counters_sum(counters_, INTERN_STAT_READ_LOCK_WAIT_NS);  \
+    (out)->write_lock_wait_ns =                                          \
+        striped_counters_sum(counters_, INTERN_STAT_WRITE_LOCK_WAIT_NS); \
+    (out)->thread_cache_hits =                                           \
+        striped_counters_sum(counters_, INTERN_STAT_THREAD_CACHE_HITS);  \
+    (out)->miss_reprobes =                                               \
+        striped_counters_sum(counters_, INTERN_STAT_MISS_REPROBES);      \
+  } while (0)
+#else
+#define INTERN_STATS_FIELDS
+#define INTERN_INIT_STATS(pool) ((void)0)
+#define INTERN_COUNT(pool, counter, n) ((void)0)
+#define INTERN_LOCK(pool, lock_fn, kind) lock_fn(&(pool)->rwlock)
+#define INTERN_READ_STATS(pool, out) ((void)0)
+#endif
+
+#define INTERN_READ_LOCK(pool) INTERN_LOCK(pool, rwlock_read_lock, READ)
+#define INTERN_WRITE_LOCK(pool) INTERN_LOCK(pool, rwlock_write_lock, WRITE)
+
+#if defined(INTERN_THREAD_CACHE)
+// Entries in each thread's cache, shared by every pool of a type. Must be a
+// power of 2.
+#ifndef INTERN_THREAD_CACHE_SIZE
+#define INTERN_THREAD_CACHE_SIZE 256
+#endif
+
+#define INTERN_THREAD_CACHE_FIELDS uint64_t cache_owner;
+
+#define INTERN_INIT_THREAD_CACHE(pool) \
+  ((pool)->cache_owner = thread_cache_new_owner())
+
+// Expands to a per-thread, direct-mapped cache of interned values indexed by
+// the low bits of their table hash.
+#define IMPL_INTERN_THREAD_CACHE(name, value_type, compare_fn)                \
+  typedef struct {                                                            \
+    uint64_t owner; /* cache_owner of the pool that stored the entry */       \
+    value_type *value;                                                        \
+    uint32_t hash, value_size;                                                \
+  } name##CacheEntry;                                                         \
+                                                                              \
+  static THREAD_LOCAL name##CacheEntry                                        \
+      name##_thread_cache[INTERN_THREAD_CACHE_SIZE];                          \
+                                                                              \
+  /* Returns the interned copy of value if this thread cached it, or NULL */  \
+  static inline value_type *name##_cache_find(name *pool,                     \
+                                              const value_type *value,        \
+                                              uint32_t value_size,            \
+                                              uint32_t hval) {                \
+    const name##CacheEntry *entry =                                           \
+        name##_thread_cache + (hval & (INTERN_THREAD_CACHE_SIZE - 1));        \
+    if (entry->owner != pool->cache_owner || entry->hash != hval ||           \
+        entry->value_size != value_size ||                                    \
+        compare_fn(entry->value, value_size, (value_type *)value,             \
+                   value_size) != 0) {                                        \
+      return NULL;                                                            \
+    }                                                                         \
+    INTERN_COUNT(pool, THREAD_CACHE_HITS, 1);                                 \
+    return entry->value;                                                      \
+  }                                                                           \
+                                                                              \
+  static inline void name##_cache_store(name *pool, value_type *interned,     \
+                                        uint32_t value_size, uint32_t hval) { \
+    name##CacheEntry *entry =                                                 \
+        name##_thread_cache + (hval & (INTERN_THREAD_CACHE_SIZE - 1));        \
+    entry->owner = pool->cache_owner;                                         \
+    entry->value = interned;                                                  \
+    entry->hash = hval;                                                       \
+    entry->value_size = value_size;                                           \
+  }                                                                           \
+                                                                              \
+  /* Drops the calling thread's entries for pool. Entries of other threads    \
+   * can never match again, since owner IDs are not reused. */                \
+  static void name##_cache_purge(name *pool) {                                \
+    for (uint32_t i = 0; i < INTERN_THREAD_CACHE_SIZE; ++i) {                 \
+      if (name##_thread_cache[i].owner == pool->cache_owner) {                \
+        name##_thread_cache[i].owner = THREAD_CACHE_NO_OWNER;                 \
+      }                                                                       \
+    }                                                                         \
+    pool->cache_owner = THREAD_CACHE_NO_OWNER;                                \
+  }
+#else
+#define INTERN_THREAD_CACHE_FIELDS
+#define INTERN_INIT_THREAD_CACHE(pool) ((void)0)
+
+// Expands to a thread cache that never holds a value.
+#define IMPL_INTERN_THREAD_CACHE(name, value_type, compare_fn)                 \
+  static inline value_type *name##_cache_find(name *pool,                      \
+                                              const value_type *value,         \
+                                              uint32_t value_size,             \
+                                              uint32_t hval) {                 \
+    return NULL;                                                               \
+  }                                                                            \
+                                                                               \
+  static inline void name##_cache_store(name *pool, value_type *interned,      \
+                                        uint32_t value_size, uint32_t hval) {} \
+                                                                               \
+  static inline void name##_cache_purge(name *pool) {}
+#endif
+
+// Rounds size up to a multiple of alignment, which must be a power of 2.
+#define INTERN_ALIGN_UP(size, alignment) \
+  (((size) + (alignment)-1) & ~((size_t)(alignment)-1))
+
+#if defined(INTERN_REFCOUNTED)
+#if defined(INTERN_THREAD_CACHE)
+#error "INTERN_THREAD_CACHE cannot be combined with INTERN_REFCOUNTED"
+#endif
+
+// Bytes of values released from a pool between automatic compaction steps, and
+// the number of chunks each step visits (see name_compact).
+#ifndef INTERN_COMPACT_INTERVAL_BYTES
+#define INTERN_COMPACT_INTERVAL_BYTES (64 * 1024)
+#endif
+
+#ifndef INTERN_COMPACT_CHUNKS_PER_STEP
+#define INTERN_COMPACT_CHUNKS_PER_STEP 4
+#endif
+
+// A chunk is mostly empty once at most 1 / INTERN_COMPACT_LIVE_FRACTION of its
+// bytes hold values that were not released.
+#define INTERN_COMPACT_LIVE_FRACTION 4
+
+// Reference count of a value that was acquired so often that its count
+// saturated. Such values are never released.
+#define INTERN_REFCOUNT_PINNED UINT32_MAX
+
+// Header in front of the ID header of each stored value. Records of released
+// values stay in their chunk until compaction, which merges runs of them into
+// the first one.
+typedef struct {
+  void *chunk; /* Chunk holding the record */
+  uint32_t refcount;
+  uint32_t record_size; /* Including headers and padding */
+} InternRefHeader;
+
+// Bytes in front of the ID header of each value, keeping values aligned.
+#define INTERN_REF_HEADER_SIZE(value_type) \
+  INTERN_ALIGN_UP(sizeof(InternRefHeader), ALIGN_OF(value_type))
+
+// Bytes taken by a value and its headers. Records are padded so that the next
+// one starts aligned.
+#define INTERN_RECORD_SIZE(value_type, value_size)                   \
+  ((uint32_t)INTERN_ALIGN_UP(INTERN_REF_HEADER_SIZE(value_type) +    \
+                                 INTERN_ID_HEADER_SIZE(value_type) + \
+                                 (value_size),                       \
+                             MAX_VALUE(ALIGN_OF(InternRefHeader),    \
+                                       ALIGN_OF(value_type))))
+
+#define INTERN_REFCOUNT_CHUNK_FIELDS                                     \
+  uint32_t used;            /* Bytes allocated, once no longer active */ \
+  uint32_t live_bytes;      /* Bytes of records not released */          \
+  uint32_t released_bytes;  /* Released since the last compaction */     \
+  uint32_t discarded_bytes; /* Pages returned to the OS */
+
+#define INTERN_INIT_CHUNK_REFCOUNT(chunk)                          \
+  ((chunk)->used = (chunk)->live_bytes = (chunk)->released_bytes = \
+       (chunk)->discarded_bytes = 0)
+
+#define INTERN_SET_CHUNK_USED(chunk, bytes) ((chunk)->used = (bytes))
+
+#define INTERN_REFCOUNT_FIELDS(name)                                  \
+  /* IDs of released values, reused by later ones */                  \
+  uint32_t *free_ids;                                                 \
+  uint32_t num_free_ids, free_ids_capacity;                           \
+  name##Chunk **compact_link; /* Link to the next chunk to compact */ \
+  uint64_t compact_debt; /* Bytes released since the last compaction step */
+
+#define INTERN_INIT_REFCOUNT(pool)                       \
+  ((pool)->free_ids = NULL,                              \
+   (pool)->num_free_ids = (pool)->free_ids_capacity = 0, \
+   (pool)->compact_link = &(pool)->chunk, (pool)->compact_debt = 0)
+
+#define INTERN_NUM_FREE_IDS(pool) ((pool)->num_free_ids)
+
+#define INTERN_READ_CHUNK_REFCOUNT(chunk, stats)     \
+  ((stats)->chunk_bytes_live += (chunk)->live_bytes, \
+   (stats)->chunk_bytes_discarded += (chunk)->discarded_bytes)
+
+#define INTERN_REFCOUNT_DECLS(name, value_type)                          \
+  /* Drops a reference to a value returned by name_intern. Returns false \
+   * if the pool is frozen */                                            \
+  bool name##_release(name *pool, const value_type *value);              \
+  /* Reclaims space of released values from up to max_chunks chunks */   \
+  uint64_t name##_compact(name *pool, uint32_t max_chunks);
+
+// Expands to reference counting of values and compaction of chunks.
+#define IMPL_INTERN_REFCOUNT(name, value_type, size_mode)                     \
+  static inline InternRefHeader *name##_ref_header(const value_type *value) { \
+    return (InternRefHeader *)((char *)value -                                \
+                               INTERN_ID_HEADER_SIZE(value_type) -            \
+                               INTERN_REF_HEADER_SIZE(value_type));           \
+  }                                                                           \
+                                                                              \
+  /* Adds a reference to value. Fails once its last one was dropped, after    \
+   * which it can never be acquired again */                                  \
+  static inline bool name##_acquire(const value_type *value) {                \
+    InternRefHeader *header = name##_ref_header(value);                       \
+    uint32_t count = ATOMIC_LOAD_RELAXED(&header->refcount);                  \
+    while (count != 0 && count != INTERN_REFCOUNT_PINNED) {                   \
+      if (ATOMIC_CAS_U32(&header->refcount, count, count + 1)) {              \
+        return true;                                                          \
+      }                                                                       \
+      count = ATOMIC_LOAD_RELAXED(&header->refcount);                         \
+    }                                                                         \
+    return count != 0;                                                        \
+  }                                                                           \
+                                                                              \
+  /* Sets up the header of a record just allocated in chunk, holding one      \
+   * reference */                                                             \
+  static inline void name##_init_record(name##Chunk *chunk, char *record,     \
+                                        uint32_t record_size) {               \
+    InternRefHeader *header = (InternRefHeader *)record;                      \
+    header->chunk = chunk;                                                    \
+    header->refcount = 1;                                                     \
+    header->record_size = record_size;                                        \
+    chunk->live_bytes += record_size;                                         \
+  }                                                                           \
+                                                                              \
+  /* Returns an ID for a new value, reusing those of released values */       \
+  static inline uint32_t name##_take_id(name *pool) {                         \
+    return pool->num_free_ids > 0 ? pool->free_ids[--pool->num_free_ids]      \
+                                  : pool->num_ids;                            \
+  }                                                                           \
+                                                                              \
+  /* Discards the pages of chunk that only hold released records. Each run of \
+   * released records is merged into its first record, whose header is kept   \
+   * so that later walks skip the run */                                      \
+  static void name##_discard_released(name##Chunk *chunk) {                   \
+    const size_t header_size = sizeof(InternRefHeader);                       \
+    char *const end = chunk->block + chunk->used;                             \
+    char *run = NULL; /* First record of the current run */                   \
+    uint32_t discarded = 0;                                                   \
+    char *record = chunk->block;                                              \
+    while (true) {                                                            \
+      InternRefHeader *header = (InternRefHeader *)record;                    \
+      const bool released =                                                   \
+          record < end && ATOMIC_LOAD_RELAXED(&header->refcount) == 0;        \
+      if (released && run == NULL) {                                          \
+        run = record;                                                         \
+      } else if (!released && run != NULL) {                                  \
+        ((InternRefHeader *)run)->record_size = (uint32_t)(record - run);     \
+        /* The unused end of the chunk goes with a run reaching it */         \
+        char *const run_end =                                                 \
+            record < end ? record : chunk->block + chunk->sz;                 \
+        discarded += (uint32_t)discard_pages(                                 \
+            run + header_size, (size_t)(run_end - run) - header_size);        \
+        run = NULL;                                                           \
+      }                                                                       \
+      if (record >= end) {                                                    \
+        break;                                                                \
+      }                                                                       \
+      record += header->record_size;                                          \
+    }                                                                         \
+    chunk->discarded_bytes = discarded;                                       \
+    chunk->released_bytes = 0;                                                \
+  }                                                                           \
+                                                                              \
+  /* Visits up to max_chunks chunks, resuming after the last one visited.     \
+   * Frees chunks left without live values and discards the released pages    \
+   * of mostly empty ones. Returns the number of bytes reclaimed */           \
+  static uint64_t name##_compact_chunks(name *pool, uint32_t max_chunks) {    \
+    uint64_t reclaimed = 0;                                                   \
+    /* Wraps around once so that chunks before the cursor are visited too */  \
+    bool wrapped = pool->compact_link == &pool->chunk;                        \
+    for (uint32_t i = 0; i < max_chunks; ++i) {                               \
+      name##Chunk *chunk = *pool->compact_link;                               \
+      if (chunk == NULL) {                                                    \
+        pool->compact_link = &pool->chunk;                                    \
+        if (wrapped) {                                                        \
+          break;                                                              \
+        }                                                                     \
+        wrapped = true;                                                       \
+        continue;                                                             \
+      }                                                                       \
+      /* The active chunk is still being filled */                            \
+      if (chunk == pool->last) {                                              \
+        pool->compact_link = &chunk->next;                                    \
+        continue;                                                             \
+      }                                                                       \
+      if (chunk->live_bytes == 0) {                                           \
+        *pool->compact_link = chunk->next;                                    \
+        reclaimed += chunk->sz - chunk->discarded_bytes;                      \
+        name##_retire_chunk(pool, chunk);                                     \
+        continue;                                                             \
+      }                                                                       \
+      if (chunk->released_bytes >= page_size() &&                             \
+          chunk->live_bytes <= chunk->used / INTERN_COMPACT_LIVE_FRACTION) {  \
+        const uint32_t discarded = chunk->discarded_bytes;                    \
+        name##_discard_released(chunk);                                       \
+        reclaimed += chunk->discarded_bytes - discarded;                      \
+      }                                                                       \
+      pool->compact_link = &chunk->next;                                      \
+    }                                                                         \
+    return reclaimed;                                                         \
+  }                                                                           \
+                                                                              \
+  /* Removes value, whose last reference was dropped, from the pool. Its ID   \
+   * and record space are reused or reclaimed later */                        \
+  static void name##_drop(name *pool, value_type *value,                      \
+                          InternRefHeader *header) {                          \
+    const uint32_t id = name##_id_of(value);                                  \
+    name##IdEntry *entry = name##_id_entry(pool, id);                         \
+    name##HashSet_remove(&pool->hash_set, value,                              \
+                         ENTRY_SIZE_##size_mode(entry, sizeof(value_type)));  \
+    ATOMIC_STORE_RELEASE(&entry->value, (value_type *)NULL);                  \
+    if (pool->num_free_ids == pool->free_ids_capacity) {                      \
+      const uint32_t capacity = MAX_VALUE(2 * pool->free_ids_capacity, 64);   \
+      uint32_t *free_ids =                                                    \
+          (uint32_t *)realloc(pool->free_ids, capacity * sizeof(uint32_t));   \
+      if (free_ids != NULL) {                                                 \
+        pool->free_ids = free_ids;                                            \
+        pool->free_ids_capacity = capacity;                                   \
+      }                                                                       \
+    }                                                                         \
+    /* The ID is never reused if the list could not grow */                   \
+    if (pool->num_free_ids < pool->free_ids_capacity) {                       \
+      pool->free_ids[pool->num_free_ids++] = id;                              \
+    }                                                                         \
+    name##Chunk *chunk = (name##Chunk *)header->chunk;                        \
+    chunk->live_bytes -= header->record_size;                                 \
+    chunk->released_bytes += header->record_size;                             \
+    pool->compact_debt += header->record_size;                                \
+    if (pool->compact_debt >= INTERN_COMPACT_INTERVAL_BYTES) {                \
+      pool->compact_debt = 0;                                                 \
+      name##_compact_chunks(pool, INTERN_COMPACT_CHUNKS_PER_STEP);            \
+    }                                                                         \
+  }                                                                           \
+                                                                              \
+  /* Drops a reference to value. The value is removed from the pool with its  \
+   * last reference, and must not be used afterwards. Only dropping the last  \
+   * reference takes the write lock */                                        \
+  bool name##_release(name *pool, const value_type *value) {                  \
+    if (ATOMIC_LOAD_ACQUIRE(&pool->frozen)) {                                 \
+      return false;                                                           \
+    }                                                                         \
+    InternRefHeader *header = name##_ref_header(value);                       \
+    uint32_t count = ATOMIC_LOAD_RELAXED(&header->refcount);                  \
+    while (count > 1) {                                                       \
+      if (count == INTERN_REFCOUNT_PINNED ||                                  \
+          ATOMIC_CAS_U32(&header->refcount, count, count - 1)) {              \
+        return true;                                                          \
+      }                                                                       \
+      count = ATOMIC_LOAD_RELAXED(&header->refcount);                         \
+    }                                                                         \
+    if (pool->threadsafe) {                                                   \
+      INTERN_WRITE_LOCK(pool);                                                \
+    }                                                                         \
+    const bool released = !pool->frozen;                                      \
+    if (released) {                                                           \
+      /* Lock-free interns may still add references meanwhile */              \
+      do {                                                                    \
+        count = ATOMIC_LOAD_RELAXED(&header->refcount);                       \
+      } while (count != INTERN_REFCOUNT_PINNED &&                             \
+               !ATOMIC_CAS_U32(&header->refcount, count, count - 1));         \
+      if (count == 1) {                                                       \
+        name##_drop(pool, (value_type *)value, header);                       \
+      }                                                                       \
+    }                                                                         \
+    if (pool->threadsafe) {                                                   \
+      rwlock_write_unlock(&pool->rwlock);                                     \
+    }                                                                         \
+    return released;                                                          \
+  }                                                                           \
+                                                                              \
+  /* Frees chunks left without live values and discards the pages of mostly   \
+   * empty chunks that only hold released values, visiting up to max_chunks   \
+   * chunks from where the previous call stopped. Released values are also    \
+   * compacted automatically every INTERN_COMPACT_INTERVAL_BYTES bytes.       \
+   * Returns the number of bytes reclaimed */                                 \
+  uint64_t name##_compact(name *pool, uint32_t max_chunks) {                  \
+    if (pool->threadsafe) {                                                   \
+      INTERN_WRITE_LOCK(pool);                                                \
+    }                                                                         \
+    const uint64_t reclaimed = name##_compact_chunks(pool, max_chunks);       \
+    if (pool->threadsafe) {                                                   \
+      rwlock_write_unlock(&pool->rwlock);                                     \
+    }                                                                         \
+    return reclaimed;                                                         \
+  }                                                                           \
+                                                                              \
+  static void name##_finalize_refcount(name *pool) { free(pool->free_ids); }
+
+// Generations would drop values whose IDs were reused by other generations.
+#define INTERN_GENERATIONS 0
+#else
+#define INTERN_REF_HEADER_SIZE(value_type) 0
+#define INTERN_RECORD_SIZE(value_type, value_size) \
+  (INTERN_ID_HEADER_SIZE(value_type) + (value_size))
+#define INTERN_REFCOUNT_CHUNK_FIELDS
+#define INTERN_INIT_CHUNK_REFCOUNT(chunk) ((void)0)
+#define INTERN_SET_CHUNK_USED(chunk, bytes) ((void)0)
+#define INTERN_REFCOUNT_FIELDS(name)
+#define INTERN_INIT_REFCOUNT(pool) ((void)0)
+#define INTERN_NUM_FREE_IDS(pool) 0
+#define INTERN_READ_CHUNK_REFCOUNT(chunk, stats) ((void)0)
+#define INTERN_REFCOUNT_DECLS(name, value_type)
+
+// Expands to reference counting that keeps every value forever.
+#define IMPL_INTERN_REFCOUNT(name, value_type, size_mode)                     \
+  static inline bool name##_acquire(const value_type *value) { return true; } \
+                                                                              \
+  static inline void name##_init_record(name##Chunk *chunk, char *record,     \
+                                        uint32_t record_size) {}              \
+                                                                              \
+  static inline uint32_t name##_take_id(name *pool) { return pool->num_ids; } \
+                                                                              \
+  static inline void name##_finalize_refcount(name *pool) {}
+
+#define INTERN_GENERATIONS 1
+#endif
+
 #define MAX_VALUE(a, b) (((a) > (b)) ? (a) : (b))
+#define MIN_VALUE(a, b) (((a) < (b)) ? (a) : (b))
 
 /**
  * DEFINE_INTERN_POOL(name, value_type)
@@ -36,51 +593,172 @@ extern "C" {
  * Generates:
  *   - Hash set types for storing value_type*
  *   - Chunk struct for contiguous allocation
+ *   - ID directory entry struct mapping IDs to values
+ *   - Frozen index slot struct
  *   - Intern pool struct containing:
  *       threadsafe flag
  *       contiguous chunk list
  *       hash set
  *       optional RWLock
+ *       ID directory
+ *       frozen index
+ *       snapshot mapping
  *   - Functions:
- *       name_init, name_finalize, name_intern
+ *       name_init, name_init_with_capacity, name_finalize, name_intern,
+ *       name_intern_prehashed, name_lookup, name_intern_batch,
+ *       name_intern_id, name_lookup_id, name_push_generation,
+ *       name_pop_generation, name_freeze, name_save, name_open_mmap,
+ *       name_get_stats
  *
  * Internally, values are copied into a chain of chunks for compact storage.
+ * Chunks grow geometrically (see INTERN_CHUNK_GROWTH_FACTOR) and oversized
+ * values are stored in chunks of their own.
+ */
+#define DEFINE_INTERN_POOL(name, value_type) \
+  DEFINE_INTERN_POOL_SIZE_MODE(name, value_type, SIZED)
+
+/**
+ * DEFINE_INTERN_POOL_SIZE_MODE(name, value_type, size_mode)
+ *
+ * Declarations shared by DEFINE_INTERN_POOL and pools of fixed-size values
+ * (see fixed_intern.h). With size_mode UNSIZED, ID directory entries do not
+ * store sizes and every value is sizeof(value_type) bytes.
  */
-#define DEFINE_INTERN_POOL(name, value_type)                           \
-  DEFINE_HASH_SET(name##HashSet, value_type *);                        \
-                                                                       \
-  typedef name##HashSetHashFn name##HashFn;                            \
-  typedef name##HashSetCompareFn name##CompareFn;                      \
-  typedef struct name##Chunk_ name##Chunk;                             \
-                                                                       \
-  typedef struct {                                                     \
-    bool threadsafe;                                                   \
-    char *tail; /* Current write cursor in the active chunk */         \
-    char *end;  /* End pointer of the active chunk */                  \
-    name##Chunk *chunk;                                                \
-    name##Chunk *last; /* Tail of the chunk chain */                   \
-    name##HashSet hash_set;                                            \
-    RWLock rwlock;                                                     \
-  } name;                                                              \
-                                                                       \
-  void name##_init(name *pool, bool threadsafe, name##HashFn hash,     \
-                   name##CompareFn compare);                           \
-  void name##_finalize(name *pool);                                    \
-  const value_type *name##_intern(name *pool, const value_type *value, \
-                                  uint32_t value_size);
+#define DEFINE_INTERN_POOL_SIZE_MODE(name, value_type, size_mode)        \
+  DEFINE_HASH_SET(name##HashSet, value_type *);                          \
+                                                                         \
+  typedef name##HashSetHashFn name##HashFn;                              \
+  typedef name##HashSetCompareFn name##CompareFn;                        \
+  typedef struct name##Chunk_ name##Chunk;                               \
+                                                                         \
+  typedef struct {                                                       \
+    value_type *value;                                                   \
+    ENTRY_SIZE_FIELD_##size_mode                                         \
+  } name##IdEntry;                                                       \
+                                                                         \
+  /* Position of the pool when a generation was pushed */                \
+  typedef struct {                                                       \
+    name##Chunk *chunk; /* Head of the chunk chain */                    \
+    name##Chunk *last;                                                   \
+    char *tail;                                                          \
+    uint32_t next_chunk_size;                                            \
+    uint32_t num_ids;                                                    \
+  } name##Generation;                                                    \
+                                                                         \
+  /* Refers to values by ID so that snapshots can store it verbatim */   \
+  typedef struct {                                                       \
+    uint32_t id;                                                         \
+    uint32_t hash; /* Table hash, checked before comparing values */     \
+  } name##FrozenSlot;                                                    \
+                                                                         \
+  typedef struct {                                                       \
+    bool threadsafe;                                                     \
+    char *tail; /* Current write cursor in the active chunk */           \
+    char *end;  /* End pointer of the active chunk */                    \
+    name##Chunk *chunk;                                                  \
+    name##Chunk *last; /* Tail of the chunk chain */                     \
+    uint32_t next_chunk_size; /* Size of the next chunk to allocate */   \
+    name##HashSet hash_set;                                              \
+    RWLock rwlock;                                                       \
+    /* Page k holds 2^(k + INTERN_ID_FIRST_PAGE_BITS) ID entries */      \
+    name##IdEntry *id_pages[INTERN_ID_MAX_PAGES];                        \
+    uint32_t num_ids;                                                    \
+    /* Stack of generations pushed and not popped yet */                 \
+    name##Generation *generations;                                       \
+    uint32_t num_generations, generations_capacity;                      \
+    /* Set once by name_freeze, which replaces hash_set */               \
+    bool frozen;                                                         \
+    PerfectHash frozen_index;                                            \
+    name##FrozenSlot *frozen_slots; /* Indexed by frozen_index */        \
+    /* Values whose table hash equals another's, sorted by hash */       \
+    name##FrozenSlot *frozen_overflow;                                   \
+    uint32_t num_frozen_overflow;                                        \
+    /* Set by name_open_mmap. The mapping holds the values and the       \
+     * frozen index, and mapped_ids replaces the ID directory */         \
+    MappedFile mapping;                                                  \
+    const SnapshotId *mapped_ids;                                        \
+    INTERN_STATS_FIELDS                                                  \
+    INTERN_THREAD_CACHE_FIELDS                                           \
+    INTERN_REFCOUNT_FIELDS(name)                                         \
+  } name;                                                                \
+                                                                         \
+  void name##_init(name *pool, bool threadsafe, name##HashFn hash,       \
+                   name##CompareFn compare);                             \
+  /* Like name_init, but presizes the hash set for expected_values       \
+   * values and the first chunk for expected_bytes bytes of them */      \
+  void name##_init_with_capacity(                                        \
+      name *pool, uint32_t expected_values, uint64_t expected_bytes,     \
+      bool threadsafe, name##HashFn hash, name##CompareFn compare);      \
+  void name##_finalize(name *pool);                                      \
+  const value_type *name##_intern(name *pool, const value_type *value,   \
+                                  uint32_t value_size);                  \
+  const value_type *name##_intern_prehashed(                             \
+      name *pool, const value_type *value, uint32_t value_size,          \
+      uint32_t hash);                                                    \
+  const value_type *name##_lookup(name *pool, const value_type *value,   \
+                                  uint32_t value_size);                  \
+  void name##_intern_batch(name *pool, const value_type *const *values,  \
+                           const uint32_t *value_sizes, size_t n,        \
+                           const value_type **out);                      \
+  uint32_t name##_intern_id(name *pool, const value_type *value,         \
+                            uint32_t value_size);                        \
+  const value_type *name##_lookup_id(const name *pool, uint32_t id,      \
+                                     uint32_t *value_size);              \
+  bool name##_push_generation(name *pool);                               \
+  bool name##_pop_generation(name *pool);                                \
+  bool name##_freeze(name *pool);                                        \
+  bool name##_save(name *pool, const char *path);                        \
+  bool name##_open_mmap(name *pool, const char *path, name##HashFn hash, \
+                        name##CompareFn compare);                        \
+  void name##_get_stats(name *pool, InternPoolStats *stats);             \
+  INTERN_REFCOUNT_DECLS(name, value_type)
 
 /**
  * IMPL_INTERN_POOL(name, value_type)
  *
  * Defines structures and functions generated by DEFINE_INTERN_POOL.
  */
-#define IMPL_INTERN_POOL(name, value_type)                                     \
-  IMPL_HASH_SET(name##HashSet, value_type *);                                  \
-                                                                               \
+#define IMPL_INTERN_POOL(name, value_type)                             \
+  IMPL_HASH_SET(name##HashSet, value_type *);                          \
+  IMPL_INTERN_POOL_FUNCTIONS(name, value_type, pool->hash_set.compare, \
+                             SIZED)
+
+/**
+ * IMPL_INTERN_POOL_INLINE(name, value_type, hash_fn, compare_fn)
+ *
+ * Like IMPL_INTERN_POOL, but binds hash_fn and compare_fn at expansion time so
+ * that hash set probes can inline them. The hash and compare arguments of
+ * name_init are ignored and may be NULL.
+ */
+#define IMPL_INTERN_POOL_INLINE(name, value_type, hash_fn, compare_fn)    \
+  IMPL_HASH_SET_INLINE(name##HashSet, value_type *, hash_fn, compare_fn); \
+  IMPL_INTERN_POOL_FUNCTIONS(name, value_type, compare_fn, SIZED)
+
+/**
+ * IMPL_INTERN_POOL_SMALL_VALUES(name, value_type, hash_fn, compare_fn)
+ *
+ * Like IMPL_INTERN_POOL_INLINE, but hash set slots also hold a copy of values
+ * of up to SMALL_VALUE_MAX_SIZE bytes (see IMPL_HASH_SET_SMALL_VALUES), so
+ * interning a small value never reads interned values it collides with.
+ * compare_fn must find values equal exactly when their sizes and bytes are.
+ */
+#define IMPL_INTERN_POOL_SMALL_VALUES(name, value_type, hash_fn, compare_fn) \
+  IMPL_HASH_SET_SMALL_VALUES(name##HashSet, value_type *, hash_fn,           \
+                             compare_fn);                                    \
+  IMPL_INTERN_POOL_FUNCTIONS(name, value_type, compare_fn, SIZED)
+
+/**
+ * IMPL_INTERN_POOL_FUNCTIONS(name, value_type, compare_fn, size_mode)
+ *
+ * Pool functions shared by IMPL_INTERN_POOL, IMPL_INTERN_POOL_INLINE and
+ * fixed-size pools. size_mode must match DEFINE_INTERN_POOL_SIZE_MODE.
+ */
+#define IMPL_INTERN_POOL_FUNCTIONS(name, value_type, compare_fn, size_mode)    \
   struct name##Chunk_ {                                                        \
     char *block; /* Raw memory storage */                                      \
     name##Chunk *next;                                                         \
     uint32_t sz; /* Size in bytes */                                           \
+    INTERN_REFCOUNT_CHUNK_FIELDS                                               \
   };                                                                           \
                                                                                \
   /* Allocate a new chunk to store value bytes contiguously */                 \
@@ -94,82 +772,839 @@ extern "C" {
       return NULL;                                                             \
     }                                                                          \
     chunk->next = NULL;                                                        \
+    INTERN_INIT_CHUNK_REFCOUNT(chunk);                                         \
     return chunk;                                                              \
   }                                                                            \
                                                                                \
+  /* Deletes chunk and every chunk after it */                                 \
   static void name##Chunk_delete(name##Chunk *chunk) {                         \
-    if (chunk->next) {                                                         \
-      name##Chunk_delete(chunk->next);                                         \
+    while (chunk != NULL) {                                                    \
+      name##Chunk *next = chunk->next;                                         \
+      free(chunk->block);                                                      \
+      free(chunk);                                                             \
+      chunk = next;                                                            \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  /* Frees chunk, which must be unlinked, once concurrent readers are done     \
+   * with it */                                                                \
+  static void name##_retire_chunk(name *pool, name##Chunk *chunk) {            \
+    if (pool->threadsafe) {                                                    \
+      epoch_retire(pool, chunk->block);                                        \
+      epoch_retire(pool, chunk);                                               \
+    } else {                                                                   \
+      free(chunk->block);                                                      \
+      free(chunk);                                                             \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  /* Returns the size of the next chunk and advances the growth policy */      \
+  static uint32_t name##_grow_chunk_size(name *pool) {                         \
+    const uint32_t chunk_size = pool->next_chunk_size;                         \
+    pool->next_chunk_size = (uint32_t)MIN_VALUE(                               \
+        (uint64_t)chunk_size * INTERN_CHUNK_GROWTH_FACTOR,                     \
+        MAX_VALUE(INTERN_CHUNK_MAX_SIZE, chunk_size));                         \
+    return chunk_size;                                                         \
+  }                                                                            \
+                                                                               \
+  /* Reserves value_size bytes of chunk storage in *chunk */                   \
+  static char *name##_allocate(name *pool, uint32_t value_size,                \
+                               name##Chunk **chunk) {                          \
+    INTERN_COUNT(pool, CHUNK_BYTES_USED, value_size);                          \
+    if (value_size <= (uint32_t)(pool->end - pool->tail)) {                    \
+      char *stored = pool->tail;                                               \
+      pool->tail += value_size;                                                \
+      *chunk = pool->last;                                                     \
+      return stored;                                                           \
+    }                                                                          \
+    if (IS_OVERSIZED_VALUE(value_size, pool->next_chunk_size)) {               \
+      /* Linked at the head so the active chunk keeps its free space */        \
+      *chunk = name##Chunk_create(value_size);                                 \
+      INTERN_SET_CHUNK_USED(*chunk, value_size);                               \
+      (*chunk)->next = pool->chunk;                                            \
+      pool->chunk = *chunk;                                                    \
+      return (*chunk)->block;                                                  \
+    }                                                                          \
+    INTERN_COUNT(pool, WASTED_TAIL_BYTES, pool->end - pool->tail);             \
+    INTERN_SET_CHUNK_USED(pool->last,                                          \
+                          (uint32_t)(pool->tail - pool->last->block));         \
+    pool->last->next = name##Chunk_create(name##_grow_chunk_size(pool));       \
+    pool->last = pool->last->next;                                             \
+    pool->tail = pool->last->block + value_size;                               \
+    pool->end = pool->last->block + pool->last->sz;                            \
+    *chunk = pool->last;                                                       \
+    return pool->last->block;                                                  \
+  }                                                                            \
+                                                                               \
+  /* Returns the directory entry for id. Its page must already exist */        \
+  static name##IdEntry *name##_id_entry(const name *pool, uint32_t id) {       \
+    const uint32_t page = INTERN_ID_PAGE(id);                                  \
+    return ATOMIC_LOAD_RELAXED(&pool->id_pages[page]) +                        \
+           INTERN_ID_PAGE_OFFSET(id, page);                                    \
+  }                                                                            \
+                                                                               \
+  /* Returns the value with the given ID, which must have been assigned */     \
+  static value_type *name##_value_of(const name *pool, uint32_t id,            \
+                                     uint32_t *value_size) {                   \
+    if (pool->mapped_ids != NULL) {                                            \
+      const SnapshotId *mapped = pool->mapped_ids + id;                        \
+      *value_size = mapped->value_size;                                        \
+      /* IDs of released values are saved with offset 0 */                     \
+      return mapped->offset == 0                                               \
+                 ? NULL                                                        \
+                 : (value_type *)(pool->mapping.data + mapped->offset);        \
+    }                                                                          \
+    const name##IdEntry *entry = name##_id_entry(pool, id);                    \
+    *value_size = ENTRY_SIZE_##size_mode(entry, sizeof(value_type));           \
+    return entry->value;                                                       \
+  }                                                                            \
+                                                                               \
+  static void name##_allocate_id_page(name *pool, uint32_t page) {             \
+    if (pool->id_pages[page] == NULL) {                                        \
+      pool->id_pages[page] = (name##IdEntry *)malloc(                          \
+          sizeof(name##IdEntry) << (page + INTERN_ID_FIRST_PAGE_BITS));        \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  static uint32_t name##_id_of(const value_type *interned) {                   \
+    uint32_t id;                                                               \
+    memcpy(&id, (const char *)interned - INTERN_ID_HEADER_SIZE(value_type),    \
+           sizeof(id));                                                        \
+    return id;                                                                 \
+  }                                                                            \
+                                                                               \
+  IMPL_INTERN_REFCOUNT(name, value_type, size_mode)                            \
+                                                                               \
+  /* Copies value into chunk storage behind a header holding its new ID */     \
+  static value_type *name##_store(name *pool, const value_type *value,         \
+                                  uint32_t value_size) {                       \
+    const uint32_t id = name##_take_id(pool);                                  \
+    const uint32_t record_size = INTERN_RECORD_SIZE(value_type, value_size);   \
+    name##Chunk *chunk;                                                        \
+    char *record = name##_allocate(pool, record_size, &chunk);                 \
+    name##_init_record(chunk, record, record_size);                            \
+    char *header = record + INTERN_REF_HEADER_SIZE(value_type);                \
+    memcpy(header, &id, sizeof(id));                                           \
+    value_type *stored =                                                       \
+        (value_type *)(header + INTERN_ID_HEADER_SIZE(value_type));            \
+    memmove(stored, value, value_size);                                        \
+                                                                               \
+    name##_allocate_id_page(pool, INTERN_ID_PAGE(id));                         \
+    name##IdEntry *entry = name##_id_entry(pool, id);                          \
+    SET_ENTRY_SIZE_##size_mode(entry, stored, value_size);                     \
+    ATOMIC_STORE_RELEASE(&entry->value, stored);                               \
+    /* Publishes the entry to name_lookup_id, unless the ID was reused */      \
+    if (id == pool->num_ids) {                                                 \
+      ATOMIC_STORE_RELEASE(&pool->num_ids, id + 1);                            \
     }                                                                          \
-    free(chunk->block);                                                        \
-    free(chunk);                                                               \
+    return stored;                                                             \
   }                                                                            \
                                                                                \
+  IMPL_INTERN_THREAD_CACHE(name, value_type, compare_fn)                       \
+                                                                               \
   void name##_init(name *pool, bool threadsafe, name##HashFn hash,             \
                    name##CompareFn compare) {                                  \
+    name##_init_with_capacity(pool, 0, 0, threadsafe, hash, compare);          \
+  }                                                                            \
+                                                                               \
+  /* Initializes pool without any chunk, ID page or hash set table */          \
+  static void name##_init_empty(name *pool, bool threadsafe,                   \
+                                name##HashFn hash, name##CompareFn compare) {  \
     pool->threadsafe = threadsafe;                                             \
     if (threadsafe) {                                                          \
       rwlock_init(&pool->rwlock);                                              \
     }                                                                          \
+    pool->tail = pool->end = NULL;                                             \
+    pool->chunk = pool->last = NULL;                                           \
+    pool->next_chunk_size = 0;                                                 \
+    name##HashSet_init(&pool->hash_set, DEFAULT_TABLE_SIZE, hash, compare);    \
+    memset(pool->id_pages, 0, sizeof(pool->id_pages));                         \
+    pool->num_ids = 0;                                                         \
+    pool->generations = NULL;                                                  \
+    pool->num_generations = pool->generations_capacity = 0;                    \
+    pool->frozen = false;                                                      \
+    pool->frozen_slots = pool->frozen_overflow = NULL;                         \
+    pool->num_frozen_overflow = 0;                                             \
+    memset(&pool->mapping, 0, sizeof(pool->mapping));                          \
+    pool->mapped_ids = NULL;                                                   \
+    INTERN_INIT_STATS(pool);                                                   \
+    INTERN_INIT_THREAD_CACHE(pool);                                            \
+    INTERN_INIT_REFCOUNT(pool);                                                \
+    if (threadsafe) {                                                          \
+      name##HashSet_enable_concurrent_reads(&pool->hash_set);                  \
+    }                                                                          \
+  }                                                                            \
                                                                                \
-    /* Initial chunk allocation */                                             \
+  void name##_init_with_capacity(name *pool, uint32_t expected_values,         \
+                                 uint64_t expected_bytes, bool threadsafe,     \
+                                 name##HashFn hash, name##CompareFn compare) { \
+    name##_init_empty(pool, threadsafe, hash, compare);                        \
+                                                                               \
+    /* Initial chunk allocation, large enough for the expected values and      \
+     * their ID headers */                                                     \
+    const uint32_t initial_chunk_size =                                        \
+        MAX_VALUE(INTERN_CHUNK_INITIAL_SIZE,                                   \
+                  DEFAULT_MAX_VALUES_PER_CHUNK * sizeof(value_type));          \
+    const uint64_t expected_chunk_bytes =                                      \
+        expected_bytes +                                                       \
+        (uint64_t)expected_values * INTERN_RECORD_SIZE(value_type, 0);         \
+    pool->next_chunk_size = (uint32_t)MIN_VALUE(                               \
+        MAX_VALUE(expected_chunk_bytes, initial_chunk_size), UINT32_MAX);      \
     pool->chunk = pool->last =                                                 \
-        name##Chunk_create(DEFAULT_MAX_VALUES_PER_CHUNK * sizeof(value_type)); \
+        name##Chunk_create(name##_grow_chunk_size(pool));                      \
     pool->tail = pool->chunk->block;                                           \
     pool->end = pool->tail + pool->chunk->sz;                                  \
+    /* Values beyond the expected ones go to chunks of the usual sizes */      \
+    pool->next_chunk_size = (uint32_t)MIN_VALUE(                               \
+        pool->next_chunk_size,                                                 \
+        MAX_VALUE(INTERN_CHUNK_MAX_SIZE, initial_chunk_size));                 \
                                                                                \
-    name##HashSet_init(&pool->hash_set, DEFAULT_TABLE_SIZE, hash, compare);    \
+    name##HashSet_reserve(&pool->hash_set, expected_values);                   \
+    if (expected_values > 0) {                                                 \
+      for (uint32_t page = 0; page <= INTERN_ID_PAGE(expected_values - 1);     \
+           ++page) {                                                           \
+        name##_allocate_id_page(pool, page);                                   \
+      }                                                                        \
+    }                                                                          \
   }                                                                            \
                                                                                \
   void name##_finalize(name *pool) {                                           \
+    name##_cache_purge(pool);                                                  \
     name##HashSet_finalize(&pool->hash_set);                                   \
+    name##_finalize_refcount(pool);                                            \
+    if (pool->threadsafe) {                                                    \
+      epoch_drain(pool);                                                       \
+    }                                                                          \
     name##Chunk_delete(pool->chunk);                                           \
+    free(pool->generations);                                                   \
+    for (uint32_t i = 0; i < INTERN_ID_MAX_PAGES; ++i) {                       \
+      free(pool->id_pages[i]);                                                 \
+    }                                                                          \
+    if (pool->mapping.data != NULL) {                                          \
+      /* The frozen index lives in the mapping */                              \
+      mapped_file_close(&pool->mapping);                                       \
+    } else if (pool->frozen) {                                                 \
+      perfect_hash_finalize(&pool->frozen_index);                              \
+      free(pool->frozen_slots);                                                \
+      free(pool->frozen_overflow);                                             \
+    }                                                                          \
   }                                                                            \
                                                                                \
-  const value_type *name##_intern(name *pool, const value_type *value,         \
-                                  uint32_t value_size) {                       \
-    if (pool->threadsafe) {                                                    \
-      rwlock_read_lock(&pool->rwlock);                                         \
+  /* Looks up value in the index built by name_freeze. Never locks */          \
+  static value_type *name##_lookup_frozen(const name *pool,                    \
+                                          const value_type *value,             \
+                                          uint32_t value_size,                 \
+                                          uint32_t hval) {                     \
+    if (pool->frozen_index.num_keys == 0) {                                    \
+      return NULL;                                                             \
     }                                                                          \
+    const name##FrozenSlot *slot =                                             \
+        pool->frozen_slots + perfect_hash_lookup(&pool->frozen_index, hval);   \
+    if (slot->hash != hval) {                                                  \
+      return NULL;                                                             \
+    }                                                                          \
+    uint32_t candidate_size;                                                   \
+    value_type *candidate = name##_value_of(pool, slot->id, &candidate_size);  \
+    if (compare_fn(candidate, candidate_size, (value_type *)value,             \
+                   value_size) == 0) {                                         \
+      return candidate;                                                        \
+    }                                                                          \
+    /* Only values sharing a table hash with another value get here */         \
+    uint32_t low = 0, high = pool->num_frozen_overflow;                        \
+    while (low < high) {                                                       \
+      const uint32_t mid = low + (high - low) / 2;                             \
+      if (pool->frozen_overflow[mid].hash < hval) {                            \
+        low = mid + 1;                                                         \
+      } else {                                                                 \
+        high = mid;                                                            \
+      }                                                                        \
+    }                                                                          \
+    for (; low < pool->num_frozen_overflow &&                                  \
+           pool->frozen_overflow[low].hash == hval;                            \
+         ++low) {                                                              \
+      candidate = name##_value_of(pool, pool->frozen_overflow[low].id,         \
+                                  &candidate_size);                            \
+      if (compare_fn(candidate, candidate_size, (value_type *)value,           \
+                     value_size) == 0) {                                       \
+        return candidate;                                                      \
+      }                                                                        \
+    }                                                                          \
+    return NULL;                                                               \
+  }                                                                            \
                                                                                \
-    /* Lookup existing interned value */                                       \
-    value_type *existing =                                                     \
-        name##HashSet_find(&pool->hash_set, value, value_size, NULL);          \
+  /* Looks up value without taking the lock, adding a reference to it if       \
+   * acquire is set. Returns false if the lookup could not complete because of \
+   * a concurrent writer. */                                                   \
+  static bool name##_find_lock_free(name *pool, const value_type *value,       \
+                                    uint32_t value_size, uint32_t hval,        \
+                                    bool acquire, value_type **existing) {     \
+    if (!epoch_enter()) {                                                      \
+      return false;                                                            \
+    }                                                                          \
+    const bool completed = name##HashSet_try_find_concurrent_hashed(           \
+        &pool->hash_set, value, value_size, hval, NULL, existing);             \
+    /* Found values are only freed after the epoch is exited. A value whose    \
+     * last reference was dropped is being removed, so counts as a miss */     \
+    if (completed && acquire && *existing != NULL &&                           \
+        !name##_acquire(*existing)) {                                          \
+      *existing = NULL;                                                        \
+    }                                                                          \
+    epoch_exit();                                                              \
+    return completed;                                                          \
+  }                                                                            \
                                                                                \
-    if (pool->threadsafe) {                                                    \
+  /* Finds the interned copy of value given its table hash, taking at most the \
+   * read lock. If acquire is set, adds a reference to it unless the pool is   \
+   * frozen. Returns NULL if value is not interned. */                         \
+  static value_type *name##_find_existing(name *pool,                          \
+                                          const value_type *value,             \
+                                          uint32_t value_size, uint32_t hval,  \
+                                          bool acquire) {                      \
+    if (ATOMIC_LOAD_ACQUIRE(&pool->frozen)) {                                  \
+      return name##_lookup_frozen(pool, value, value_size, hval);              \
+    }                                                                          \
+    value_type *existing = NULL;                                               \
+    if (!pool->threadsafe) {                                                   \
+      existing = name##HashSet_find_hashed(&pool->hash_set, value, value_size, \
+                                           hval, NULL);                        \
+      if (existing != NULL && acquire) {                                       \
+        name##_acquire(existing);                                              \
+      }                                                                        \
+    } else if (!name##_find_lock_free(pool, value, value_size, hval, acquire,  \
+                                      &existing)) {                            \
+      INTERN_READ_LOCK(pool);                                                  \
+      if (pool->frozen) {                                                      \
+        existing = name##_lookup_frozen(pool, value, value_size, hval);        \
+      } else {                                                                 \
+        existing = name##HashSet_find_hashed(&pool->hash_set, value,           \
+                                             value_size, hval, NULL);          \
+        /* Last references are only dropped under the write lock */            \
+        if (existing != NULL && acquire) {                                     \
+          name##_acquire(existing);                                            \
+        }                                                                      \
+      }                                                                        \
       rwlock_read_unlock(&pool->rwlock);                                       \
+    } else if (existing == NULL && ATOMIC_LOAD_ACQUIRE(&pool->frozen)) {       \
+      /* The pool was frozen and its hash set cleared since the check above */ \
+      existing = name##_lookup_frozen(pool, value, value_size, hval);          \
     }                                                                          \
+    return existing;                                                           \
+  }                                                                            \
+                                                                               \
+  /* Finds the interned copy of value given its table hash, taking at most the \
+   * read lock. Returns NULL if value is not interned. */                      \
+  static value_type *name##_lookup_hashed(name *pool,                          \
+                                          const value_type *value,             \
+                                          uint32_t value_size,                 \
+                                          uint32_t hval) {                     \
+    return name##_find_existing(pool, value, value_size, hval,                 \
+                                /*acquire=*/false);                            \
+  }                                                                            \
                                                                                \
+  /* Interns value given its table hash (see name##HashSet_hash), so the hash  \
+   * function is called at most once per value. Returns NULL if the pool is    \
+   * frozen. */                                                                \
+  static const value_type *name##_intern_hashed(name *pool,                    \
+                                                const value_type *value,       \
+                                                uint32_t value_size,           \
+                                                uint32_t hval) {               \
+    if (ATOMIC_LOAD_ACQUIRE(&pool->frozen)) {                                  \
+      return NULL;                                                             \
+    }                                                                          \
+    value_type *existing = name##_cache_find(pool, value, value_size, hval);   \
     if (existing) return existing;                                             \
                                                                                \
+    /* Lookup existing interned value */                                       \
+    const uint32_t write_seq = name##HashSet_write_seq(&pool->hash_set);       \
+    existing =                                                                 \
+        name##_find_existing(pool, value, value_size, hval, /*acquire=*/true); \
+    if (existing) {                                                            \
+      name##_cache_store(pool, existing, value_size, hval);                    \
+      return existing;                                                         \
+    }                                                                          \
+                                                                               \
+    if (pool->threadsafe) {                                                    \
+      INTERN_WRITE_LOCK(pool);                                                 \
+      if (pool->frozen) {                                                      \
+        rwlock_write_unlock(&pool->rwlock);                                    \
+        return NULL;                                                           \
+      }                                                                        \
+      /* Another thread may have interned value between the lookup and taking  \
+       * the lock. Only then has the hash set been written since. */           \
+      if (pool->hash_set.seq != write_seq) {                                   \
+        existing = name##HashSet_find_hashed(&pool->hash_set, value,           \
+                                             value_size, hval, NULL);          \
+        if (existing != NULL) {                                                \
+          name##_acquire(existing);                                            \
+        }                                                                      \
+        INTERN_COUNT(pool, MISS_REPROBES, 1);                                  \
+      }                                                                        \
+    }                                                                          \
+                                                                               \
+    /* Copy value into chunk */                                                \
+    value_type *stored = existing;                                             \
+    if (stored == NULL) {                                                      \
+      stored = name##_store(pool, value, value_size);                          \
+      name##HashSet_insert_hashed(&pool->hash_set, stored, value_size, hval);  \
+    }                                                                          \
+                                                                               \
     if (pool->threadsafe) {                                                    \
-      rwlock_write_lock(&pool->rwlock);                                        \
+      rwlock_write_unlock(&pool->rwlock);                                      \
+    }                                                                          \
+                                                                               \
+    name##_cache_store(pool, stored, value_size, hval);                        \
+    return stored;                                                             \
+  }                                                                            \
+                                                                               \
+  const value_type *name##_intern(name *pool, const value_type *value,         \
+                                  uint32_t value_size) {                       \
+    return name##_intern_hashed(                                               \
+        pool, value, value_size,                                               \
+        name##HashSet_hash(&pool->hash_set, value, value_size));               \
+  }                                                                            \
+                                                                               \
+  /* hash must be the value returned by the pool's hash function for value */  \
+  const value_type *name##_intern_prehashed(name *pool,                        \
+                                            const value_type *value,           \
+                                            uint32_t value_size,               \
+                                            uint32_t hash) {                   \
+    return name##_intern_hashed(pool, value, value_size, MIX_HASH(hash));      \
+  }                                                                            \
+                                                                               \
+  /* Never allocates or takes the write lock, so it is safe to call with       \
+   * untrusted input */                                                        \
+  const value_type *name##_lookup(name *pool, const value_type *value,         \
+                                  uint32_t value_size) {                       \
+    return name##_lookup_hashed(                                               \
+        pool, value, value_size,                                               \
+        name##HashSet_hash(&pool->hash_set, value, value_size));               \
+  }                                                                            \
+                                                                               \
+  /* Interns values[0..n) into out[0..n). All values are hashed first, then    \
+   * hits are resolved in one pass under the read lock while upcoming table    \
+   * slots are prefetched, and misses are inserted under one write lock. */    \
+  void name##_intern_batch(name *pool, const value_type *const *values,        \
+                           const uint32_t *value_sizes, size_t n,              \
+                           const value_type **out) {                           \
+    if (ATOMIC_LOAD_ACQUIRE(&pool->frozen)) {                                  \
+      memset(out, 0, n * sizeof(*out));                                        \
+      return;                                                                  \
+    }                                                                          \
+    uint32_t *hvals = (uint32_t *)malloc(n * sizeof(uint32_t));                \
+    if (hvals == NULL) {                                                       \
+      for (size_t i = 0; i < n; ++i) {                                         \
+        out[i] = name##_intern(pool, values[i], value_sizes[i]);               \
+      }                                                                        \
+      return;                                                                  \
+    }                                                                          \
+    for (size_t i = 0; i < n; ++i) {                                           \
+      hvals[i] = name##HashSet_hash(&pool->hash_set, values[i],                \
+                                    value_sizes[i]);                           \
     }                                                                          \
                                                                                \
-    /* Allocate new chunk if needed */                                         \
-    if (pool->tail + value_size >= pool->end) {                                \
-      uint32_t new_chunk_size =                                                \
-          MAX_VALUE(DEFAULT_MAX_VALUES_PER_CHUNK * sizeof(value_type),         \
-                    compute_nearest_pow2_gte(value_size * 16));                \
+    if (pool->threadsafe) {                                                    \
+      INTERN_READ_LOCK(pool);                                                  \
+    }                                                                          \
+    for (size_t i = 0; i < n && i < INTERN_BATCH_PREFETCH_DISTANCE; ++i) {     \
+      name##HashSet_prefetch(&pool->hash_set, hvals[i]);                       \
+    }                                                                          \
+    size_t num_misses = 0;                                                     \
+    for (size_t i = 0; i < n; ++i) {                                           \
+      if (i + INTERN_BATCH_PREFETCH_DISTANCE < n) {                            \
+        name##HashSet_prefetch(&pool->hash_set,                                \
+                               hvals[i + INTERN_BATCH_PREFETCH_DISTANCE]);     \
+      }                                                                        \
+      value_type *existing = name##HashSet_find_hashed(                        \
+          &pool->hash_set, values[i], value_sizes[i], hvals[i], NULL);         \
+      if (existing != NULL) {                                                  \
+        name##_acquire(existing);                                              \
+      } else {                                                                 \
+        num_misses++;                                                          \
+      }                                                                        \
+      out[i] = existing;                                                       \
+    }                                                                          \
+    if (pool->threadsafe) {                                                    \
+      rwlock_read_unlock(&pool->rwlock);                                       \
+    }                                                                          \
                                                                                \
-      pool->last->next = name##Chunk_create(new_chunk_size);                   \
-      pool->last = pool->last->next;                                           \
-      pool->tail = pool->last->block;                                          \
-      pool->end = pool->tail + pool->last->sz;                                 \
+    if (num_misses > 0) {                                                      \
+      if (pool->threadsafe) {                                                  \
+        INTERN_WRITE_LOCK(pool);                                               \
+      }                                                                        \
+      /* Misses stay NULL if the pool was frozen since the read pass */        \
+      for (size_t i = 0; i < n && !pool->frozen; ++i) {                        \
+        if (out[i] != NULL) {                                                  \
+          continue;                                                            \
+        }                                                                      \
+        /* Another thread or an earlier duplicate in the batch may have        \
+         * interned it since the read pass. */                                 \
+        value_type *stored = name##HashSet_find_hashed(                        \
+            &pool->hash_set, values[i], value_sizes[i], hvals[i], NULL);       \
+        if (stored == NULL) {                                                  \
+          stored = name##_store(pool, values[i], value_sizes[i]);              \
+          name##HashSet_insert_hashed(&pool->hash_set, stored, value_sizes[i], \
+                                      hvals[i]);                               \
+        } else {                                                               \
+          name##_acquire(stored);                                              \
+        }                                                                      \
+        out[i] = stored;                                                       \
+      }                                                                        \
+      if (pool->threadsafe) {                                                  \
+        rwlock_write_unlock(&pool->rwlock);                                    \
+      }                                                                        \
     }                                                                          \
+    free(hvals);                                                               \
+  }                                                                            \
                                                                                \
-    /* Copy value into chunk */                                                \
-    value_type *stored = (value_type *)pool->tail;                             \
-    memmove(pool->tail, value, value_size);                                    \
-    pool->tail += value_size;                                                  \
+  uint32_t name##_intern_id(name *pool, const value_type *value,               \
+                            uint32_t value_size) {                             \
+    const value_type *interned = name##_intern(pool, value, value_size);       \
+    return interned == NULL ? INTERN_INVALID_ID : name##_id_of(interned);      \
+  }                                                                            \
                                                                                \
-    name##HashSet_insert(&pool->hash_set, stored, value_size);                 \
+  /* Returns the value with the given ID, or NULL if no value has it. Never    \
+   * takes the lock */                                                         \
+  const value_type *name##_lookup_id(const name *pool, uint32_t id,            \
+                                     uint32_t *value_size) {                   \
+    if (id >= ATOMIC_LOAD_ACQUIRE(&pool->num_ids)) {                           \
+      return NULL;                                                             \
+    }                                                                          \
+    uint32_t size;                                                             \
+    const value_type *value = name##_value_of(pool, id, &size);                \
+    if (value_size != NULL) {                                                  \
+      *value_size = size;                                                      \
+    }                                                                          \
+    return value;                                                              \
+  }                                                                            \
                                                                                \
+  /* Starts a generation nested in the current one. Every value interned       \
+   * from then on, by any thread, belongs to it until it is popped. Returns    \
+   * false if the pool is frozen or built with INTERN_REFCOUNTED */            \
+  bool name##_push_generation(name *pool) {                                    \
+    if (!INTERN_GENERATIONS || ATOMIC_LOAD_ACQUIRE(&pool->frozen)) {           \
+      return false;                                                            \
+    }                                                                          \
+    if (pool->threadsafe) {                                                    \
+      INTERN_WRITE_LOCK(pool);                                                 \
+    }                                                                          \
+    bool pushed = !pool->frozen;                                               \
+    if (pushed && pool->num_generations == pool->generations_capacity) {       \
+      const uint32_t capacity = MAX_VALUE(2 * pool->generations_capacity, 8);  \
+      name##Generation *generations = (name##Generation *)realloc(             \
+          pool->generations, capacity * sizeof(name##Generation));             \
+      pushed = generations != NULL;                                            \
+      if (pushed) {                                                            \
+        pool->generations = generations;                                       \
+        pool->generations_capacity = capacity;                                 \
+      }                                                                        \
+    }                                                                          \
+    if (pushed) {                                                              \
+      name##Generation *generation =                                           \
+          pool->generations + pool->num_generations++;                         \
+      generation->chunk = pool->chunk;                                         \
+      generation->last = pool->last;                                           \
+      generation->tail = pool->tail;                                           \
+      generation->next_chunk_size = pool->next_chunk_size;                     \
+      generation->num_ids = pool->num_ids;                                     \
+    }                                                                          \
     if (pool->threadsafe) {                                                    \
       rwlock_write_unlock(&pool->rwlock);                                      \
     }                                                                          \
+    return pushed;                                                             \
+  }                                                                            \
                                                                                \
-    return stored;                                                             \
+  /* Drops every value interned since the matching name_push_generation. Its   \
+   * values hold the IDs from the generation's first one on, so their hash     \
+   * set entries are removed by ID. The chunks allocated since are freed and   \
+   * the active chunk is rewound, without visiting values. Values and IDs of   \
+   * the generation must not be used afterwards. Returns false if no           \
+   * generation was pushed or the pool is frozen */                            \
+  bool name##_pop_generation(name *pool) {                                     \
+    if (pool->threadsafe) {                                                    \
+      INTERN_WRITE_LOCK(pool);                                                 \
+    }                                                                          \
+    const bool popped = !pool->frozen && pool->num_generations > 0;            \
+    if (popped) {                                                              \
+      const name##Generation *generation =                                     \
+          pool->generations + --pool->num_generations;                         \
+      for (uint32_t id = generation->num_ids; id < pool->num_ids; ++id) {      \
+        uint32_t value_size;                                                   \
+        value_type *value = name##_value_of(pool, id, &value_size);            \
+        name##HashSet_remove(&pool->hash_set, value, value_size);              \
+      }                                                                        \
+      ATOMIC_STORE_RELEASE(&pool->num_ids, generation->num_ids);               \
+      /* Oversized chunks of the generation are in front of the chain, and     \
+       * the others after the chunk that was active when it was pushed */      \
+      while (pool->chunk != generation->chunk) {                               \
+        name##Chunk *chunk = pool->chunk;                                      \
+        pool->chunk = chunk->next;                                             \
+        name##_retire_chunk(pool, chunk);                                      \
+      }                                                                        \
+      for (name##Chunk *chunk = generation->last->next; chunk != NULL;) {      \
+        name##Chunk *next = chunk->next;                                       \
+        name##_retire_chunk(pool, chunk);                                      \
+        chunk = next;                                                          \
+      }                                                                        \
+      generation->last->next = NULL;                                           \
+      pool->last = generation->last;                                           \
+      pool->tail = generation->tail;                                           \
+      pool->end = pool->last->block + pool->last->sz;                          \
+      pool->next_chunk_size = generation->next_chunk_size;                     \
+      /* Entries cached by other threads never match a new owner */            \
+      name##_cache_purge(pool);                                                \
+      INTERN_INIT_THREAD_CACHE(pool);                                          \
+    }                                                                          \
+    if (pool->threadsafe) {                                                    \
+      rwlock_write_unlock(&pool->rwlock);                                      \
+    }                                                                          \
+    return popped;                                                             \
+  }                                                                            \
+                                                                               \
+  static int name##_compare_keyed_ids(const void *a, const void *b) {          \
+    const uint64_t keyed_a = *(const uint64_t *)a;                             \
+    const uint64_t keyed_b = *(const uint64_t *)b;                             \
+    return (keyed_a > keyed_b) - (keyed_a < keyed_b);                          \
+  }                                                                            \
+                                                                               \
+  /* Builds a frozen index over every interned value. On success the caller    \
+   * owns *slots and *overflow */                                              \
+  static bool name##_build_index(const name *pool, PerfectHash *index,         \
+                                 name##FrozenSlot **slots,                     \
+                                 name##FrozenSlot **overflow,                  \
+                                 uint32_t *num_overflow) {                     \
+    const uint32_t num_ids = pool->num_ids;                                    \
+    /* Table hash in the high bits, ID in the low bits, so sorting groups      \
+     * values sharing a hash */                                                \
+    uint64_t *keyed_ids =                                                      \
+        (uint64_t *)malloc((num_ids + 1) * sizeof(uint64_t));                  \
+    uint32_t *keys = (uint32_t *)malloc((num_ids + 1) * sizeof(uint32_t));     \
+    if (keyed_ids == NULL || keys == NULL) {                                   \
+      free(keyed_ids);                                                         \
+      free(keys);                                                              \
+      return false;                                                            \
+    }                                                                          \
+    uint32_t num_values = 0;                                                   \
+    for (uint32_t id = 0; id < num_ids; ++id) {                                \
+      uint32_t value_size;                                                     \
+      value_type *value = name##_value_of(pool, id, &value_size);              \
+      if (value == NULL) {                                                     \
+        continue; /* Released */                                               \
+      }                                                                        \
+      keyed_ids[num_values++] =                                                \
+          ((uint64_t)name##HashSet_hash(&pool->hash_set, value, value_size)    \
+           << 32) |                                                            \
+          id;                                                                  \
+    }                                                                          \
+    qsort(keyed_ids, num_values, sizeof(uint64_t), name##_compare_keyed_ids);  \
+    uint32_t num_keys = 0;                                                     \
+    for (uint32_t i = 0; i < num_values; ++i) {                                \
+      const uint32_t hval = (uint32_t)(keyed_ids[i] >> 32);                    \
+      if (num_keys == 0 || keys[num_keys - 1] != hval) {                       \
+        keys[num_keys++] = hval;                                               \
+      }                                                                        \
+    }                                                                          \
+    *num_overflow = num_values - num_keys;                                     \
+    *slots = (name##FrozenSlot *)malloc((num_keys + 1) *                       \
+                                        sizeof(name##FrozenSlot));             \
+    *overflow = (name##FrozenSlot *)malloc((*num_overflow + 1) *               \
+                                           sizeof(name##FrozenSlot));          \
+    const bool built = *slots != NULL && *overflow != NULL &&                  \
+                       perfect_hash_build(index, keys, num_keys);              \
+    if (built) {                                                               \
+      uint32_t num_placed_overflow = 0;                                        \
+      for (uint32_t i = 0; i < num_values; ++i) {                              \
+        const uint32_t hval = (uint32_t)(keyed_ids[i] >> 32);                  \
+        const bool is_first = i == 0 || (keyed_ids[i - 1] >> 32) != hval;      \
+        name##FrozenSlot *slot =                                               \
+            is_first ? *slots + perfect_hash_lookup(index, hval)               \
+                     : *overflow + num_placed_overflow++;                      \
+        slot->id = (uint32_t)keyed_ids[i];                                     \
+        slot->hash = hval;                                                     \
+      }                                                                        \
+    } else {                                                                   \
+      free(*slots);                                                            \
+      free(*overflow);                                                         \
+    }                                                                          \
+    free(keyed_ids);                                                           \
+    free(keys);                                                                \
+    return built;                                                              \
+  }                                                                            \
+                                                                               \
+  /* Makes the pool immutable. Returns false, leaving the pool unfrozen, if    \
+   * the index could not be allocated */                                       \
+  bool name##_freeze(name *pool) {                                             \
+    if (pool->threadsafe) {                                                    \
+      INTERN_WRITE_LOCK(pool);                                                 \
+    }                                                                          \
+    const bool frozen =                                                        \
+        pool->frozen ||                                                        \
+        name##_build_index(pool, &pool->frozen_index, &pool->frozen_slots,     \
+                           &pool->frozen_overflow,                             \
+                           &pool->num_frozen_overflow);                        \
+    if (frozen && !pool->frozen) {                                             \
+      /* Lookups switch to the index before the hash set is released */        \
+      ATOMIC_STORE_RELEASE(&pool->frozen, true);                               \
+      name##HashSet_clear(&pool->hash_set);                                    \
+    }                                                                          \
+    if (pool->threadsafe) {                                                    \
+      rwlock_write_unlock(&pool->rwlock);                                      \
+    }                                                                          \
+    return frozen;                                                             \
+  }                                                                            \
+                                                                               \
+  /* Writes every interned value and a frozen index to a snapshot file */      \
+  static bool name##_write_snapshot(const name *pool, const char *path) {      \
+    PerfectHash index;                                                         \
+    name##FrozenSlot *slots, *overflow;                                        \
+    uint32_t num_overflow;                                                     \
+    if (!name##_build_index(pool, &index, &slots, &overflow, &num_overflow)) { \
+      return false;                                                            \
+    }                                                                          \
+    SnapshotHeader header;                                                     \
+    memset(&header, 0, sizeof(header));                                        \
+    header.magic = SNAPSHOT_MAGIC;                                             \
+    header.version = SNAPSHOT_VERSION;                                         \
+    header.value_type_size = sizeof(value_type);                               \
+    header.hash_mix_check = MIX_HASH(1);                                       \
+    header.num_values = pool->num_ids;                                         \
+    header.num_keys = index.num_keys;                                          \
+    header.num_buckets = index.num_buckets;                                    \
+    header.num_overflow = num_overflow;                                        \
+    header.slot_size = sizeof(name##FrozenSlot);                               \
+    header.seed = index.seed;                                                  \
+    header.ids_offset =                                                        \
+        SNAPSHOT_ALIGN_UP(sizeof(SnapshotHeader), SNAPSHOT_ALIGNMENT);         \
+    header.pilots_offset = SNAPSHOT_ALIGN_UP(                                  \
+        header.ids_offset + header.num_values * sizeof(SnapshotId),            \
+        SNAPSHOT_ALIGNMENT);                                                   \
+    header.slots_offset = SNAPSHOT_ALIGN_UP(                                   \
+        header.pilots_offset + header.num_buckets * sizeof(uint32_t),          \
+        SNAPSHOT_ALIGNMENT);                                                   \
+    header.overflow_offset = SNAPSHOT_ALIGN_UP(                                \
+        header.slots_offset + header.num_keys * sizeof(name##FrozenSlot),      \
+        SNAPSHOT_ALIGNMENT);                                                   \
+    uint64_t offset = SNAPSHOT_ALIGN_UP(                                       \
+        header.overflow_offset + num_overflow * sizeof(name##FrozenSlot),      \
+        SNAPSHOT_ALIGNMENT);                                                   \
+                                                                               \
+    /* Values keep the layout they have in chunks: aligned, behind an ID */    \
+    SnapshotId *ids =                                                          \
+        (SnapshotId *)calloc(header.num_values + 1, sizeof(SnapshotId));       \
+    for (uint32_t id = 0; ids != NULL && id < header.num_values; ++id) {       \
+      uint32_t value_size;                                                     \
+      if (name##_value_of(pool, id, &value_size) == NULL) {                    \
+        continue; /* Released, so saved with offset 0 */                       \
+      }                                                                        \
+      ids[id].value_size = value_size;                                         \
+      ids[id].offset = SNAPSHOT_ALIGN_UP(offset, ALIGN_OF(value_type)) +       \
+                       INTERN_ID_HEADER_SIZE(value_type);                      \
+      offset = ids[id].offset + ids[id].value_size;                            \
+    }                                                                          \
+    header.size = offset;                                                      \
+                                                                               \
+    SnapshotWriter writer;                                                     \
+    bool written = ids != NULL && snapshot_writer_open(&writer, path);         \
+    if (written) {                                                             \
+      snapshot_write_at(&writer, 0, &header, sizeof(header));                  \
+      snapshot_write_at(&writer, header.ids_offset, ids,                       \
+                        header.num_values * sizeof(SnapshotId));               \
+      snapshot_write_at(&writer, header.pilots_offset, index.pilots,           \
+                        header.num_buckets * sizeof(uint32_t));                \
+      snapshot_write_at(&writer, header.slots_offset, slots,                   \
+                        header.num_keys * sizeof(name##FrozenSlot));           \
+      snapshot_write_at(&writer, header.overflow_offset, overflow,             \
+                        num_overflow * sizeof(name##FrozenSlot));              \
+      for (uint32_t id = 0; id < header.num_values; ++id) {                    \
+        uint32_t value_size;                                                   \
+        const value_type *value = name##_value_of(pool, id, &value_size);      \
+        if (value == NULL) {                                                   \
+          continue;                                                            \
+        }                                                                      \
+        snapshot_write_at(&writer,                                             \
+                          ids[id].offset - INTERN_ID_HEADER_SIZE(value_type),  \
+                          &id, sizeof(id));                                    \
+        snapshot_write_at(&writer, ids[id].offset, value, value_size);         \
+      }                                                                        \
+      /* Pads the file to header.size if the last values are empty */          \
+      snapshot_write_at(&writer, header.size, NULL, 0);                        \
+      written = snapshot_writer_close(&writer);                                \
+    }                                                                          \
+    free(ids);                                                                 \
+    perfect_hash_finalize(&index);                                             \
+    free(slots);                                                               \
+    free(overflow);                                                            \
+    return written;                                                            \
+  }                                                                            \
+                                                                               \
+  /* Saves the pool to a snapshot at path. Lookups and interning may continue  \
+   * meanwhile, but values interned after the call starts are not saved */     \
+  bool name##_save(name *pool, const char *path) {                             \
+    if (pool->threadsafe) {                                                    \
+      INTERN_READ_LOCK(pool);                                                  \
+    }                                                                          \
+    const bool saved = name##_write_snapshot(pool, path);                      \
+    if (pool->threadsafe) {                                                    \
+      rwlock_read_unlock(&pool->rwlock);                                       \
+    }                                                                          \
+    return saved;                                                              \
+  }                                                                            \
+                                                                               \
+  /* Initializes a frozen pool whose values and index are used in place from   \
+   * the snapshot at path. hash and compare must match those of the pool that  \
+   * saved it. Returns false, leaving the pool uninitialized, if the file      \
+   * cannot be mapped or is not a snapshot of this value type */               \
+  bool name##_open_mmap(name *pool, const char *path, name##HashFn hash,       \
+                        name##CompareFn compare) {                             \
+    MappedFile mapping;                                                        \
+    if (!mapped_file_open(&mapping, path)) {                                   \
+      return false;                                                            \
+    }                                                                          \
+    if (!snapshot_header_valid(&mapping, sizeof(value_type), MIX_HASH(1),      \
+                               sizeof(name##FrozenSlot))) {                    \
+      mapped_file_close(&mapping);                                             \
+      return false;                                                            \
+    }                                                                          \
+    /* Never written, so lookups need no lock. Values and the index live in    \
+     * the mapping, so no chunk or hash set table is allocated */              \
+    name##_init_empty(pool, /*threadsafe=*/false, hash, compare);              \
+    const SnapshotHeader *header = (const SnapshotHeader *)mapping.data;       \
+    pool->mapping = mapping;                                                   \
+    pool->mapped_ids =                                                         \
+        (const SnapshotId *)(mapping.data + header->ids_offset);               \
+    pool->num_ids = header->num_values;                                        \
+    pool->frozen_index.seed = header->seed;                                    \
+    pool->frozen_index.num_keys = header->num_keys;                            \
+    pool->frozen_index.num_buckets = header->num_buckets;                      \
+    pool->frozen_index.pilots =                                                \
+        (uint32_t *)(mapping.data + header->pilots_offset);                    \
+    pool->frozen_slots =                                                       \
+        (name##FrozenSlot *)(mapping.data + header->slots_offset);             \
+    pool->frozen_overflow =                                                    \
+        (name##FrozenSlot *)(mapping.data + header->overflow_offset);          \
+    pool->num_frozen_overflow = header->num_overflow;                          \
+    pool->frozen = true;                                                       \
+    return true;                                                               \
+  }                                                                            \
+                                                                               \
+  /* Walks the chunk chain and the hash set table, so takes time linear in     \
+   * their size under the read lock */                                         \
+  void name##_get_stats(name *pool, InternPoolStats *stats) {                  \
+    memset(stats, 0, sizeof(InternPoolStats));                                 \
+    if (pool->threadsafe) {                                                    \
+      INTERN_READ_LOCK(pool);                                                  \
+    }                                                                          \
+    name##HashSet_get_stats(&pool->hash_set, &stats->hash_set);                \
+    stats->num_values = pool->num_ids - INTERN_NUM_FREE_IDS(pool);             \
+    for (const name##Chunk *chunk = pool->chunk; chunk != NULL;                \
+         chunk = chunk->next) {                                                \
+      stats->num_chunks++;                                                     \
+      stats->chunk_bytes_allocated += chunk->sz;                               \
+      INTERN_READ_CHUNK_REFCOUNT(chunk, stats);                                \
+    }                                                                          \
+    INTERN_READ_STATS(pool, stats);                                            \
+    if (pool->threadsafe) {                                                    \
+      rwlock_read_unlock(&pool->rwlock);                                       \
+    }                                                                          \
   }
 
 #ifdef __cplusplus
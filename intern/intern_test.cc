@@ -4,6 +4,12 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
 namespace {
 
 using namespace testing;
@@ -44,6 +50,10 @@ int32_t compare_strings(const char *ptr1, uint32_t size1, const char *ptr2,
   return memcmp(ptr1, ptr2, std::max(size1, size2));
 }
 
+DEFINE_INTERN_POOL(InlineStringInternPool, char);
+IMPL_INTERN_POOL_INLINE(InlineStringInternPool, char, hash_string,
+                        compare_strings);
+
 class StringInternPoolTest : public Test {
  protected:
   StringInternPoolTest() {
@@ -91,4 +101,949 @@ TEST_F(StringInternPoolTest, InternPoolN) {
   ASSERT_EQ(hat, StringInternPool_intern(&intern_pool, hat, sizeof("hat")));
 }
 
+TEST_F(StringInternPoolTest, Lookup) {
+  const char *cat = StringInternPool_intern(&intern_pool, "cat", sizeof("cat"));
+  const char *tail = intern_pool.tail;
+
+  EXPECT_EQ(cat, StringInternPool_lookup(&intern_pool, "cat", sizeof("cat")));
+  EXPECT_THAT(StringInternPool_lookup(&intern_pool, "hat", sizeof("hat")),
+              IsNull());
+
+  // Misses neither store the value nor assign it an ID.
+  EXPECT_EQ(tail, intern_pool.tail);
+  EXPECT_EQ(1, StringInternPool_intern_id(&intern_pool, "hat", sizeof("hat")));
+  EXPECT_THAT(StringInternPool_lookup(&intern_pool, "hat", sizeof("hat")),
+              NotNull());
+}
+
+TEST_F(StringInternPoolTest, Freeze) {
+  std::vector<const char *> interned;
+  for (int i = 0; i < 1000; ++i) {
+    const std::string value = std::to_string(i);
+    interned.push_back(StringInternPool_intern(&intern_pool, value.c_str(),
+                                               value.size() + 1));
+  }
+  ASSERT_TRUE(StringInternPool_freeze(&intern_pool));
+  ASSERT_TRUE(StringInternPool_freeze(&intern_pool));
+
+  for (int i = 0; i < 1000; ++i) {
+    const std::string value = std::to_string(i);
+    ASSERT_EQ(interned[i], StringInternPool_lookup(
+                               &intern_pool, value.c_str(), value.size() + 1));
+    ASSERT_EQ(interned[i], StringInternPool_lookup_id(&intern_pool, i, NULL));
+  }
+  EXPECT_THAT(StringInternPool_lookup(&intern_pool, "cat", sizeof("cat")),
+              IsNull());
+
+  // Interning fails, even for values that are already interned.
+  EXPECT_THAT(StringInternPool_intern(&intern_pool, "cat", sizeof("cat")),
+              IsNull());
+  EXPECT_THAT(StringInternPool_intern(&intern_pool, "1", sizeof("1")),
+              IsNull());
+  EXPECT_EQ(INTERN_INVALID_ID,
+            StringInternPool_intern_id(&intern_pool, "1", sizeof("1")));
+  const char *values[] = {"1", "cat"};
+  const uint32_t value_sizes[] = {sizeof("1"), sizeof("cat")};
+  const char *out[] = {"", ""};
+  StringInternPool_intern_batch(&intern_pool, values, value_sizes, 2, out);
+  EXPECT_THAT(out, Each(IsNull()));
+}
+
+TEST_F(StringInternPoolTest, FreezeEmpty) {
+  ASSERT_TRUE(StringInternPool_freeze(&intern_pool));
+  EXPECT_THAT(StringInternPool_lookup(&intern_pool, "cat", sizeof("cat")),
+              IsNull());
+}
+
+// Collides for values of the same size and first byte.
+uint32_t hash_prefix(const char *ptr, uint32_t size) {
+  return (size << 8) | (unsigned char)ptr[0];
+}
+
+TEST(FrozenStringInternPoolTest, CollidingHashes) {
+  StringInternPool intern_pool;
+  StringInternPool_init(&intern_pool, /*threadsafe=*/false, hash_prefix,
+                        compare_strings);
+  std::vector<const char *> interned;
+  for (int i = 0; i < 100; ++i) {
+    const std::string value = std::to_string(i);
+    interned.push_back(StringInternPool_intern(&intern_pool, value.c_str(),
+                                               value.size() + 1));
+  }
+  ASSERT_TRUE(StringInternPool_freeze(&intern_pool));
+
+  for (int i = 0; i < 100; ++i) {
+    const std::string value = std::to_string(i);
+    ASSERT_EQ(interned[i], StringInternPool_lookup(
+                               &intern_pool, value.c_str(), value.size() + 1));
+  }
+  EXPECT_THAT(StringInternPool_lookup(&intern_pool, "ab", sizeof("ab")),
+              IsNull());
+
+  StringInternPool_finalize(&intern_pool);
+}
+
+TEST_F(StringInternPoolTest, SaveAndOpenMmap) {
+  for (int i = 0; i < 1000; ++i) {
+    const std::string value = std::to_string(i);
+    StringInternPool_intern(&intern_pool, value.c_str(), value.size() + 1);
+  }
+  const std::string path = TempDir() + "intern_test_snapshot";
+  ASSERT_TRUE(StringInternPool_save(&intern_pool, path.c_str()));
+
+  StringInternPool mapped_pool;
+  ASSERT_TRUE(StringInternPool_open_mmap(&mapped_pool, path.c_str(),
+                                         hash_string, compare_strings));
+  for (int i = 0; i < 1000; ++i) {
+    const std::string value = std::to_string(i);
+    const char *mapped = StringInternPool_lookup(&mapped_pool, value.c_str(),
+                                                 value.size() + 1);
+    ASSERT_STREQ(value.c_str(), mapped);
+    // Values are used in place and keep their IDs.
+    ASSERT_GE(mapped, mapped_pool.mapping.data);
+    ASSERT_LT(mapped, mapped_pool.mapping.data + mapped_pool.mapping.size);
+    ASSERT_EQ(mapped, StringInternPool_lookup_id(&mapped_pool, i, NULL));
+  }
+  EXPECT_THAT(StringInternPool_lookup(&mapped_pool, "cat", sizeof("cat")),
+              IsNull());
+  EXPECT_THAT(StringInternPool_intern(&mapped_pool, "cat", sizeof("cat")),
+              IsNull());
+
+  // Nothing is allocated beside the mapping.
+  InternPoolStats stats;
+  StringInternPool_get_stats(&mapped_pool, &stats);
+  EXPECT_EQ(0, stats.num_chunks);
+  EXPECT_EQ(0, stats.chunk_bytes_allocated);
+  EXPECT_TRUE(mapped_pool.hash_set.table == NULL);
+
+  StringInternPool_finalize(&mapped_pool);
+  std::remove(path.c_str());
+}
+
+TEST_F(StringInternPoolTest, OpenMmapRejectsInvalidFiles) {
+  StringInternPool mapped_pool;
+  const std::string path = TempDir() + "intern_test_not_a_snapshot";
+  EXPECT_FALSE(StringInternPool_open_mmap(&mapped_pool, path.c_str(),
+                                          hash_string, compare_strings));
+
+  FILE *file = fopen(path.c_str(), "wb");
+  ASSERT_THAT(file, NotNull());
+  fputs("not a snapshot", file);
+  fclose(file);
+  EXPECT_FALSE(StringInternPool_open_mmap(&mapped_pool, path.c_str(),
+                                          hash_string, compare_strings));
+  std::remove(path.c_str());
+}
+
+TEST_F(StringInternPoolTest, ChunksGrowGeometrically) {
+  for (int i = 0; i < 100000; ++i) {
+    const std::string value = "value" + std::to_string(i);
+    ASSERT_THAT(StringInternPool_intern(&intern_pool, value.c_str(),
+                                        value.size() + 1),
+                NotNull());
+  }
+
+  // ~1.2 MB of values fit in a handful of doubling chunks.
+  int num_chunks = 0;
+  for (StringInternPoolChunk *chunk = intern_pool.chunk; chunk != NULL;
+       chunk = chunk->next) {
+    ++num_chunks;
+  }
+  EXPECT_LE(num_chunks, 10);
+  EXPECT_LE(intern_pool.next_chunk_size, INTERN_CHUNK_MAX_SIZE);
+}
+
+#if !defined(INTERN_REFCOUNTED)
+TEST_F(StringInternPoolTest, PopGenerationDropsItsValues) {
+  const char *cat = StringInternPool_intern(&intern_pool, "cat", sizeof("cat"));
+  ASSERT_TRUE(StringInternPool_push_generation(&intern_pool));
+  EXPECT_EQ(1, StringInternPool_intern_id(&intern_pool, "dog", sizeof("dog")));
+  EXPECT_EQ(2, StringInternPool_intern_id(&intern_pool, "cow", sizeof("cow")));
+  EXPECT_EQ(cat, StringInternPool_intern(&intern_pool, "cat", sizeof("cat")));
+  ASSERT_TRUE(StringInternPool_pop_generation(&intern_pool));
+
+  EXPECT_EQ(cat, StringInternPool_lookup(&intern_pool, "cat", sizeof("cat")));
+  EXPECT_THAT(StringInternPool_lookup(&intern_pool, "dog", sizeof("dog")),
+              IsNull());
+  EXPECT_THAT(StringInternPool_lookup(&intern_pool, "cow", sizeof("cow")),
+              IsNull());
+  EXPECT_THAT(StringInternPool_lookup_id(&intern_pool, 1, NULL), IsNull());
+  EXPECT_EQ(1, intern_pool.num_ids);
+
+  // IDs and chunk space of the generation are handed out again.
+  EXPECT_EQ(cat + 8,
+            StringInternPool_intern(&intern_pool, "cow", sizeof("cow")));
+  EXPECT_EQ(1, StringInternPool_intern_id(&intern_pool, "cow", sizeof("cow")));
+  EXPECT_FALSE(StringInternPool_pop_generation(&intern_pool));
+}
+
+TEST_F(StringInternPoolTest, NestedGenerations) {
+  ASSERT_TRUE(StringInternPool_push_generation(&intern_pool));
+  StringInternPool_intern(&intern_pool, "cat", sizeof("cat"));
+  ASSERT_TRUE(StringInternPool_push_generation(&intern_pool));
+  StringInternPool_intern(&intern_pool, "dog", sizeof("dog"));
+
+  ASSERT_TRUE(StringInternPool_pop_generation(&intern_pool));
+  EXPECT_THAT(StringInternPool_lookup(&intern_pool, "cat", sizeof("cat")),
+              NotNull());
+  EXPECT_THAT(StringInternPool_lookup(&intern_pool, "dog", sizeof("dog")),
+              IsNull());
+  ASSERT_TRUE(StringInternPool_pop_generation(&intern_pool));
+  EXPECT_THAT(StringInternPool_lookup(&intern_pool, "cat", sizeof("cat")),
+              IsNull());
+  EXPECT_EQ(0, intern_pool.num_ids);
+}
+
+TEST_F(StringInternPoolTest, PopGenerationFreesItsChunks) {
+  StringInternPool_intern(&intern_pool, "cat", sizeof("cat"));
+  InternPoolStats before;
+  StringInternPool_get_stats(&intern_pool, &before);
+  const char *tail = intern_pool.tail;
+
+  const std::string oversized(INTERN_CHUNK_MAX_SIZE, 'x');
+  for (int round = 0; round < 3; ++round) {
+    ASSERT_TRUE(StringInternPool_push_generation(&intern_pool));
+    for (int i = 0; i < 100000; ++i) {
+      const std::string value = "value" + std::to_string(i);
+      ASSERT_THAT(StringInternPool_intern(&intern_pool, value.c_str(),
+                                          value.size() + 1),
+                  NotNull());
+    }
+    ASSERT_THAT(StringInternPool_intern(&intern_pool, oversized.c_str(),
+                                        oversized.size() + 1),
+                NotNull());
+    ASSERT_TRUE(StringInternPool_pop_generation(&intern_pool));
+
+    InternPoolStats after;
+    StringInternPool_get_stats(&intern_pool, &after);
+    ASSERT_EQ(before.num_values, after.num_values);
+    ASSERT_EQ(before.num_chunks, after.num_chunks);
+    ASSERT_EQ(before.chunk_bytes_allocated, after.chunk_bytes_allocated);
+    ASSERT_EQ(1, after.hash_set.num_entries);
+    ASSERT_EQ(tail, intern_pool.tail);
+  }
+  EXPECT_THAT(StringInternPool_lookup(&intern_pool, "cat", sizeof("cat")),
+              NotNull());
+}
+
+TEST_F(StringInternPoolTest, PopGenerationFailsOnceFrozen) {
+  ASSERT_TRUE(StringInternPool_push_generation(&intern_pool));
+  const char *cat = StringInternPool_intern(&intern_pool, "cat", sizeof("cat"));
+  ASSERT_TRUE(StringInternPool_freeze(&intern_pool));
+
+  EXPECT_FALSE(StringInternPool_pop_generation(&intern_pool));
+  EXPECT_FALSE(StringInternPool_push_generation(&intern_pool));
+  EXPECT_EQ(cat, StringInternPool_lookup(&intern_pool, "cat", sizeof("cat")));
+}
+#else
+TEST_F(StringInternPoolTest, GenerationsNeedUncountedPools) {
+  EXPECT_FALSE(StringInternPool_push_generation(&intern_pool));
+  EXPECT_FALSE(StringInternPool_pop_generation(&intern_pool));
+}
+#endif
+
+TEST(StringInternPoolCapacityTest, InitWithCapacity) {
+  std::vector<std::string> values;
+  uint64_t num_bytes = 0;
+  for (int i = 0; i < 10000; ++i) {
+    values.push_back("value" + std::to_string(i));
+    num_bytes += values.back().size() + 1;
+  }
+
+  StringInternPool intern_pool;
+  StringInternPool_init_with_capacity(&intern_pool, values.size(), num_bytes,
+                                      /*threadsafe=*/false, hash_string,
+                                      compare_strings);
+  const uint32_t table_size = intern_pool.hash_set.table_size;
+  for (const std::string &value : values) {
+    ASSERT_THAT(StringInternPool_intern(&intern_pool, value.c_str(),
+                                        value.size() + 1),
+                NotNull());
+  }
+
+  // Neither the table nor the chunk chain grew.
+  EXPECT_EQ(table_size, intern_pool.hash_set.table_size);
+  EXPECT_EQ(intern_pool.chunk, intern_pool.last);
+  EXPECT_EQ(values.size(), intern_pool.num_ids);
+
+  // Further values go to chunks of the usual sizes.
+  EXPECT_THAT(StringInternPool_intern(&intern_pool, "cat", sizeof("cat")),
+              NotNull());
+  EXPECT_LE(intern_pool.next_chunk_size, INTERN_CHUNK_MAX_SIZE);
+  StringInternPool_finalize(&intern_pool);
+}
+
+TEST_F(StringInternPoolTest, OversizedValueGetsOwnChunk) {
+  const char *small =
+      StringInternPool_intern(&intern_pool, "cat", sizeof("cat"));
+  StringInternPoolChunk *active = intern_pool.last;
+  char *tail = intern_pool.tail;
+
+  const std::string large(INTERN_CHUNK_INITIAL_SIZE * 4, 'x');
+  const char *interned_large =
+      StringInternPool_intern(&intern_pool, large.c_str(), large.size() + 1);
+  ASSERT_THAT(interned_large, NotNull());
+  EXPECT_EQ(interned_large, StringInternPool_intern(&intern_pool, large.c_str(),
+                                                    large.size() + 1));
+
+  // The active chunk and its free space are untouched.
+  EXPECT_EQ(active, intern_pool.last);
+  EXPECT_EQ(tail, intern_pool.tail);
+  EXPECT_EQ(small, StringInternPool_intern(&intern_pool, "cat", sizeof("cat")));
+}
+
+TEST_F(StringInternPoolTest, Stats) {
+  for (int i = 0; i < 1000; ++i) {
+    const std::string value = "value" + std::to_string(i);
+    ASSERT_THAT(StringInternPool_intern(&intern_pool, value.c_str(),
+                                        value.size() + 1),
+                NotNull());
+  }
+  StringInternPool_intern(&intern_pool, "value1", sizeof("value1"));
+
+  InternPoolStats stats;
+  StringInternPool_get_stats(&intern_pool, &stats);
+  EXPECT_EQ(1000, stats.num_values);
+  EXPECT_EQ(1000, stats.hash_set.num_entries);
+  EXPECT_GE(stats.num_chunks, 2);
+  EXPECT_GE(stats.chunk_bytes_allocated, 1000 * sizeof("value0"));
+#if defined(INTERN_ENABLE_STATS)
+  // The repeated value is found in the thread cache unless a later value
+  // evicted it.
+  EXPECT_EQ(1, stats.hash_set.hits + stats.thread_cache_hits);
+  EXPECT_EQ(1000, stats.hash_set.misses);
+  EXPECT_EQ(1000, stats.hash_set.inserts);
+  EXPECT_GT(stats.chunk_bytes_used, 1000 * sizeof("value0"));
+  EXPECT_EQ(stats.chunk_bytes_allocated,
+            stats.chunk_bytes_used + stats.wasted_tail_bytes +
+                (intern_pool.end - intern_pool.tail));
+#else
+  EXPECT_EQ(0, stats.chunk_bytes_used);
+#endif
+  // Not threadsafe, so no lock is taken.
+  EXPECT_EQ(0, stats.read_locks);
+  EXPECT_EQ(0, stats.write_locks);
+}
+
+#if defined(INTERN_THREAD_CACHE) && defined(INTERN_ENABLE_STATS)
+TEST_F(StringInternPoolTest, ThreadCacheHits) {
+  const char *cat = StringInternPool_intern(&intern_pool, "cat", sizeof("cat"));
+  for (int i = 0; i < 10; ++i) {
+    ASSERT_EQ(cat, StringInternPool_intern(&intern_pool, "cat", sizeof("cat")));
+  }
+
+  InternPoolStats stats;
+  StringInternPool_get_stats(&intern_pool, &stats);
+  EXPECT_EQ(10, stats.thread_cache_hits);
+  EXPECT_EQ(0, stats.hash_set.hits);
+}
+#endif
+
+TEST_F(StringInternPoolTest, InternBatch) {
+  const char *cat = StringInternPool_intern(&intern_pool, "cat", sizeof("cat"));
+
+  // Mixes values already in the pool, new values and duplicates within the
+  // batch.
+  const char *values[] = {"cat", "in", "the", "hat", "in", "cat"};
+  const uint32_t value_sizes[] = {sizeof("cat"), sizeof("in"), sizeof("the"),
+                                  sizeof("hat"), sizeof("in"), sizeof("cat")};
+  const char *out[6];
+  StringInternPool_intern_batch(&intern_pool, values, value_sizes, 6, out);
+
+  EXPECT_EQ(cat, out[0]);
+  EXPECT_EQ(cat, out[5]);
+  EXPECT_EQ(out[1], out[4]);
+  EXPECT_EQ(out[1], StringInternPool_intern(&intern_pool, "in", sizeof("in")));
+  EXPECT_EQ(out[2],
+            StringInternPool_intern(&intern_pool, "the", sizeof("the")));
+  EXPECT_EQ(out[3],
+            StringInternPool_intern(&intern_pool, "hat", sizeof("hat")));
+  EXPECT_EQ(4, StringInternPoolHashSet_size(&intern_pool.hash_set));
+}
+
+TEST_F(StringInternPoolTest, InternId) {
+  const uint32_t cat = StringInternPool_intern_id(&intern_pool, "cat", 4);
+  const uint32_t hat = StringInternPool_intern_id(&intern_pool, "hat", 4);
+  const char *in = StringInternPool_intern(&intern_pool, "in", 3);
+
+  // IDs are dense and follow interning order.
+  EXPECT_EQ(0, cat);
+  EXPECT_EQ(1, hat);
+  EXPECT_EQ(cat, StringInternPool_intern_id(&intern_pool, "cat", 4));
+  EXPECT_EQ(2, StringInternPool_intern_id(&intern_pool, in, 3));
+
+  uint32_t value_size = 0;
+  EXPECT_STREQ("hat",
+               StringInternPool_lookup_id(&intern_pool, hat, &value_size));
+  EXPECT_EQ(4, value_size);
+  EXPECT_EQ(in, StringInternPool_lookup_id(&intern_pool, 2, NULL));
+  EXPECT_THAT(StringInternPool_lookup_id(&intern_pool, 3, NULL), IsNull());
+}
+
+TEST_F(StringInternPoolTest, LookupIdAcrossPages) {
+  std::vector<const char *> interned;
+  for (int i = 0; i < 100000; ++i) {
+    const std::string value = std::to_string(i);
+    ASSERT_EQ(i, StringInternPool_intern_id(&intern_pool, value.c_str(),
+                                            value.size() + 1));
+    interned.push_back(
+        StringInternPool_intern(&intern_pool, value.c_str(), value.size() + 1));
+  }
+  for (int i = 0; i < 100000; ++i) {
+    uint32_t value_size = 0;
+    ASSERT_EQ(interned[i],
+              StringInternPool_lookup_id(&intern_pool, i, &value_size));
+    ASSERT_EQ(std::to_string(i).size() + 1, value_size);
+  }
+}
+
+int num_hash_calls = 0;
+
+uint32_t counting_hash_string(const char *ptr, uint32_t size) {
+  ++num_hash_calls;
+  return hash_string(ptr, size);
+}
+
+TEST(ThreadsafeStringInternPoolTest, InternPrehashed) {
+  StringInternPool intern_pool;
+  StringInternPool_init(&intern_pool, /*threadsafe=*/true,
+                        counting_hash_string, compare_strings);
+  num_hash_calls = 0;
+
+  std::vector<const char *> interned;
+  for (int i = 0; i < 1000; ++i) {
+    const std::string value = std::to_string(i);
+    interned.push_back(StringInternPool_intern_prehashed(
+        &intern_pool, value.c_str(), value.size() + 1,
+        hash_string(value.c_str(), value.size() + 1)));
+  }
+  // Neither lookups, inserts nor resizes call the pool's hash function.
+  EXPECT_EQ(0, num_hash_calls);
+
+  for (int i = 0; i < 1000; ++i) {
+    const std::string value = std::to_string(i);
+    ASSERT_STREQ(value.c_str(), interned[i]);
+    ASSERT_EQ(interned[i], StringInternPool_intern(&intern_pool, value.c_str(),
+                                                   value.size() + 1));
+  }
+
+  StringInternPool_finalize(&intern_pool);
+}
+
+TEST(InlineStringInternPoolTest, InternPoolN) {
+  InlineStringInternPool intern_pool;
+  InlineStringInternPool_init(&intern_pool, /*threadsafe=*/false, NULL, NULL);
+
+  const char *cat =
+      InlineStringInternPool_intern(&intern_pool, "cat", sizeof("cat"));
+  const char *hat =
+      InlineStringInternPool_intern(&intern_pool, "hat", sizeof("hat"));
+
+  ASSERT_THAT(cat, NotNull());
+  ASSERT_THAT(hat, NotNull());
+  ASSERT_NE(cat, hat);
+  ASSERT_EQ(cat,
+            InlineStringInternPool_intern(&intern_pool, "cat", sizeof("cat")));
+  ASSERT_EQ(hat,
+            InlineStringInternPool_intern(&intern_pool, "hat", sizeof("hat")));
+
+  InlineStringInternPool_finalize(&intern_pool);
+}
+
+TEST(ThreadsafeStringInternPoolTest, InternBatchFromManyThreads) {
+  StringInternPool intern_pool;
+  StringInternPool_init(&intern_pool, /*threadsafe=*/true, hash_string,
+                        compare_strings);
+
+  // Every thread interns the same values, so batches race on each insert.
+  constexpr int kNumValues = 1000;
+  std::vector<std::string> values;
+  std::vector<const char *> value_ptrs;
+  std::vector<uint32_t> value_sizes;
+  for (int i = 0; i < kNumValues; ++i) {
+    values.push_back("value" + std::to_string(i));
+  }
+  for (const std::string &value : values) {
+    value_ptrs.push_back(value.c_str());
+    value_sizes.push_back(value.size() + 1);
+  }
+
+  std::vector<std::vector<const char *>> results(4);
+  std::vector<std::thread> threads;
+  for (auto &result : results) {
+    result.resize(kNumValues);
+    threads.emplace_back([&]() {
+      StringInternPool_intern_batch(&intern_pool, value_ptrs.data(),
+                                    value_sizes.data(), kNumValues,
+                                    result.data());
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  for (const auto &result : results) {
+    EXPECT_EQ(results[0], result);
+  }
+  EXPECT_EQ(kNumValues, StringInternPoolHashSet_size(&intern_pool.hash_set));
+
+  StringInternPool_finalize(&intern_pool);
+}
+
+TEST(ThreadsafeStringInternPoolTest, ConcurrentMissesShareOneCopy) {
+  StringInternPool intern_pool;
+  StringInternPool_init(&intern_pool, /*threadsafe=*/true, hash_string,
+                        compare_strings);
+
+  // Every thread interns the same new values in the same order, so most
+  // misses race with another thread's insert of the same value.
+  constexpr int kNumValues = 10000;
+  std::vector<std::string> values;
+  for (int i = 0; i < kNumValues; ++i) {
+    values.push_back("value" + std::to_string(i));
+  }
+  std::vector<std::vector<const char *>> results(4);
+  std::vector<std::thread> threads;
+  for (auto &result : results) {
+    threads.emplace_back([&]() {
+      for (const std::string &value : values) {
+        result.push_back(StringInternPool_intern(&intern_pool, value.c_str(),
+                                                 value.size() + 1));
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  for (const auto &result : results) {
+    EXPECT_EQ(results[0], result);
+  }
+  // No value was stored twice.
+  EXPECT_EQ(kNumValues, intern_pool.num_ids);
+
+  StringInternPool_finalize(&intern_pool);
+}
+
+#if defined(INTERN_ENABLE_STATS)
+TEST(ThreadsafeStringInternPoolTest, UncontendedMissesAreNotReprobed) {
+  StringInternPool intern_pool;
+  StringInternPool_init(&intern_pool, /*threadsafe=*/true, hash_string,
+                        compare_strings);
+  for (int i = 0; i < 1000; ++i) {
+    const std::string value = "value" + std::to_string(i);
+    ASSERT_THAT(StringInternPool_intern(&intern_pool, value.c_str(),
+                                        value.size() + 1),
+                NotNull());
+  }
+
+  InternPoolStats stats;
+  StringInternPool_get_stats(&intern_pool, &stats);
+  EXPECT_EQ(1000, stats.write_locks);
+  EXPECT_EQ(0, stats.miss_reprobes);
+
+  StringInternPool_finalize(&intern_pool);
+}
+#endif
+
+TEST(ThreadsafeStringInternPoolTest, HitsDuringConcurrentInserts) {
+  StringInternPool intern_pool;
+  StringInternPool_init(&intern_pool, /*threadsafe=*/true, hash_string,
+                        compare_strings);
+
+  constexpr int kNumHotValues = 100;
+  std::vector<std::string> hot_values;
+  std::vector<const char *> hot_interned;
+  for (int i = 0; i < kNumHotValues; ++i) {
+    hot_values.push_back("hot" + std::to_string(i));
+    hot_interned.push_back(StringInternPool_intern(
+        &intern_pool, hot_values[i].c_str(), hot_values[i].size() + 1));
+  }
+
+  // One writer keeps growing the pool, forcing resizes, while readers only
+  // intern values that are already present.
+  std::thread writer([&]() {
+    for (int i = 0; i < 20000; ++i) {
+      std::string value = "cold" + std::to_string(i);
+      ASSERT_THAT(StringInternPool_intern(&intern_pool, value.c_str(),
+                                          value.size() + 1),
+                  NotNull());
+    }
+  });
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; ++t) {
+    readers.emplace_back([&]() {
+      for (int round = 0; round < 200; ++round) {
+        for (int i = 0; i < kNumHotValues; ++i) {
+          ASSERT_EQ(hot_interned[i], StringInternPool_intern(
+                                         &intern_pool, hot_values[i].c_str(),
+                                         hot_values[i].size() + 1));
+        }
+      }
+    });
+  }
+  writer.join();
+  for (std::thread &reader : readers) {
+    reader.join();
+  }
+
+  StringInternPool_finalize(&intern_pool);
+}
+
+TEST(ThreadsafeStringInternPoolTest, PoolsDoNotShareInternedValues) {
+  StringInternPool pool1, pool2;
+  StringInternPool_init(&pool1, /*threadsafe=*/true, hash_string,
+                        compare_strings);
+  StringInternPool_init(&pool2, /*threadsafe=*/true, hash_string,
+                        compare_strings);
+
+  const char *cat1 = StringInternPool_intern(&pool1, "cat", sizeof("cat"));
+  const char *cat2 = StringInternPool_intern(&pool2, "cat", sizeof("cat"));
+  EXPECT_NE(cat1, cat2);
+  EXPECT_EQ(cat1, StringInternPool_intern(&pool1, "cat", sizeof("cat")));
+  EXPECT_EQ(cat2, StringInternPool_intern(&pool2, "cat", sizeof("cat")));
+
+  StringInternPool_finalize(&pool1);
+  StringInternPool_finalize(&pool2);
+}
+
+TEST(ThreadsafeStringInternPoolTest, ReinitAfterFinalizeOnAnotherThread) {
+  StringInternPool intern_pool;
+  StringInternPool_init(&intern_pool, /*threadsafe=*/true, hash_string,
+                        compare_strings);
+  ASSERT_THAT(StringInternPool_intern(&intern_pool, "cat", sizeof("cat")),
+              NotNull());
+  std::thread([&]() { StringInternPool_finalize(&intern_pool); }).join();
+
+  // Nothing interned by the finalized pool is returned by the new one.
+  StringInternPool_init(&intern_pool, /*threadsafe=*/true, hash_string,
+                        compare_strings);
+  const char *cat = StringInternPool_intern(&intern_pool, "cat", sizeof("cat"));
+  EXPECT_EQ(cat, StringInternPool_lookup_id(&intern_pool, 0, NULL));
+
+  StringInternPool_finalize(&intern_pool);
+}
+
+TEST(ThreadsafeStringInternPoolTest, LockStats) {
+  StringInternPool pool;
+  StringInternPool_init(&pool, /*threadsafe=*/true, hash_string,
+                        compare_strings);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&pool, t]() {
+      for (int i = 0; i < 1000; ++i) {
+        const std::string value = std::to_string(t) + "/" + std::to_string(i);
+        StringInternPool_intern(&pool, value.c_str(), value.size() + 1);
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  InternPoolStats stats;
+  StringInternPool_get_stats(&pool, &stats);
+  EXPECT_EQ(4000, stats.num_values);
+#if defined(INTERN_ENABLE_STATS)
+  EXPECT_EQ(4000, stats.write_locks);
+  EXPECT_EQ(4000, stats.hash_set.inserts);
+  // Includes the read lock taken by StringInternPool_get_stats.
+  EXPECT_GE(stats.read_locks, 1);
+#else
+  EXPECT_EQ(0, stats.write_locks);
+#endif
+
+  StringInternPool_finalize(&pool);
+}
+
+#if !defined(INTERN_REFCOUNTED)
+TEST(ThreadsafeStringInternPoolTest, LookupsDuringPopGeneration) {
+  StringInternPool intern_pool;
+  StringInternPool_init(&intern_pool, /*threadsafe=*/true, hash_string,
+                        compare_strings);
+  const char *cat = StringInternPool_intern(&intern_pool, "cat", sizeof("cat"));
+
+  // Lookups of values outside the generations run while they are popped.
+  std::atomic<bool> done(false);
+  std::thread reader([&]() {
+    while (!done) {
+      ASSERT_EQ(cat,
+                StringInternPool_lookup(&intern_pool, "cat", sizeof("cat")));
+      ASSERT_EQ(cat,
+                StringInternPool_intern(&intern_pool, "cat", sizeof("cat")));
+    }
+  });
+  for (int round = 0; round < 20; ++round) {
+    ASSERT_TRUE(StringInternPool_push_generation(&intern_pool));
+    for (int i = 0; i < 5000; ++i) {
+      const std::string value = "value" + std::to_string(i);
+      ASSERT_THAT(StringInternPool_intern(&intern_pool, value.c_str(),
+                                          value.size() + 1),
+                  NotNull());
+    }
+    ASSERT_TRUE(StringInternPool_pop_generation(&intern_pool));
+  }
+  done = true;
+  reader.join();
+
+  EXPECT_EQ(1, intern_pool.num_ids);
+  StringInternPool_finalize(&intern_pool);
+}
+#endif
+
+TEST(ThreadsafeStringInternPoolTest, LookupsDuringFreeze) {
+  StringInternPool intern_pool;
+  StringInternPool_init(&intern_pool, /*threadsafe=*/true, hash_string,
+                        compare_strings);
+
+  constexpr int kNumValues = 10000;
+  std::vector<std::string> values;
+  std::vector<const char *> interned;
+  for (int i = 0; i < kNumValues; ++i) {
+    values.push_back("value" + std::to_string(i));
+    interned.push_back(StringInternPool_intern(
+        &intern_pool, values[i].c_str(), values[i].size() + 1));
+  }
+
+  // Readers must find every value before, during and after the switch from
+  // the hash set to the frozen index.
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; ++t) {
+    readers.emplace_back([&]() {
+      for (int i = 0; i < kNumValues; ++i) {
+        ASSERT_EQ(interned[i],
+                  StringInternPool_lookup(&intern_pool, values[i].c_str(),
+                                          values[i].size() + 1));
+      }
+    });
+  }
+  ASSERT_TRUE(StringInternPool_freeze(&intern_pool));
+  for (std::thread &reader : readers) {
+    reader.join();
+  }
+
+  StringInternPool_finalize(&intern_pool);
+}
+
+#if defined(INTERN_REFCOUNTED)
+TEST_F(StringInternPoolTest, ReleaseDropsLastReference) {
+  const char *cat = StringInternPool_intern(&intern_pool, "cat", sizeof("cat"));
+  ASSERT_EQ(cat, StringInternPool_intern(&intern_pool, "cat", sizeof("cat")));
+
+  // Two references, so the first release keeps the value.
+  EXPECT_TRUE(StringInternPool_release(&intern_pool, cat));
+  EXPECT_EQ(cat, StringInternPool_lookup(&intern_pool, "cat", sizeof("cat")));
+  EXPECT_TRUE(StringInternPool_release(&intern_pool, cat));
+  EXPECT_THAT(StringInternPool_lookup(&intern_pool, "cat", sizeof("cat")),
+              IsNull());
+  EXPECT_THAT(StringInternPool_lookup_id(&intern_pool, 0, NULL), IsNull());
+
+  InternPoolStats stats;
+  StringInternPool_get_stats(&intern_pool, &stats);
+  EXPECT_EQ(0, stats.num_values);
+  EXPECT_EQ(0, stats.chunk_bytes_live);
+  EXPECT_EQ(0, stats.hash_set.num_entries);
+}
+
+TEST_F(StringInternPoolTest, ReleasedIdsAreReused) {
+  const char *cat = StringInternPool_intern(&intern_pool, "cat", sizeof("cat"));
+  EXPECT_EQ(1, StringInternPool_intern_id(&intern_pool, "dog", sizeof("dog")));
+  ASSERT_TRUE(StringInternPool_release(&intern_pool, cat));
+
+  EXPECT_EQ(0, StringInternPool_intern_id(&intern_pool, "cow", sizeof("cow")));
+  EXPECT_STREQ("cow", StringInternPool_lookup_id(&intern_pool, 0, NULL));
+  EXPECT_EQ(2, StringInternPool_intern_id(&intern_pool, "cat", sizeof("cat")));
+  EXPECT_EQ(3, intern_pool.num_ids);
+}
+
+TEST_F(StringInternPoolTest, InternBatchAddsReferences) {
+  const char *values[] = {"cat", "dog", "cat"};
+  const uint32_t value_sizes[] = {sizeof("cat"), sizeof("dog"), sizeof("cat")};
+  const char *out[3];
+  StringInternPool_intern_batch(&intern_pool, values, value_sizes, 3, out);
+  StringInternPool_intern_batch(&intern_pool, values, value_sizes, 3, out);
+
+  // One reference per value of each batch.
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_TRUE(StringInternPool_release(&intern_pool, out[0]));
+    EXPECT_EQ(i < 3 ? out[0] : NULL,
+              StringInternPool_lookup(&intern_pool, "cat", sizeof("cat")));
+  }
+  ASSERT_TRUE(StringInternPool_release(&intern_pool, out[1]));
+  EXPECT_EQ(out[1],
+            StringInternPool_lookup(&intern_pool, "dog", sizeof("dog")));
+  ASSERT_TRUE(StringInternPool_release(&intern_pool, out[1]));
+  EXPECT_THAT(StringInternPool_lookup(&intern_pool, "dog", sizeof("dog")),
+              IsNull());
+}
+
+TEST_F(StringInternPoolTest, EmptyChunksAreFreed) {
+  std::vector<const char *> interned;
+  for (int i = 0; i < 100000; ++i) {
+    const std::string value = "value" + std::to_string(i);
+    interned.push_back(StringInternPool_intern(&intern_pool, value.c_str(),
+                                               value.size() + 1));
+  }
+  const char *kept = interned.back();
+  interned.pop_back();
+  for (const char *value : interned) {
+    ASSERT_TRUE(StringInternPool_release(&intern_pool, value));
+  }
+  StringInternPool_compact(&intern_pool, UINT32_MAX);
+
+  // Only the active chunk, holding the kept value, is left.
+  EXPECT_EQ(intern_pool.chunk, intern_pool.last);
+  EXPECT_STREQ("value99999", kept);
+  EXPECT_EQ(kept, StringInternPool_lookup(&intern_pool, "value99999",
+                                          sizeof("value99999")));
+  InternPoolStats stats;
+  StringInternPool_get_stats(&intern_pool, &stats);
+  EXPECT_EQ(1, stats.num_values);
+  EXPECT_EQ(1, stats.num_chunks);
+}
+
+TEST_F(StringInternPoolTest, MostlyEmptyChunksAreDiscarded) {
+  std::vector<std::string> values;
+  std::vector<const char *> interned;
+  for (int i = 0; i < 200000; ++i) {
+    values.push_back("value" + std::to_string(i));
+    interned.push_back(StringInternPool_intern(
+        &intern_pool, values[i].c_str(), values[i].size() + 1));
+  }
+  // Keeps one value per few pages, so no chunk is left empty.
+  for (size_t i = 0; i < values.size(); ++i) {
+    if (i % 1000 != 0) {
+      ASSERT_TRUE(StringInternPool_release(&intern_pool, interned[i]));
+    }
+  }
+  StringInternPool_compact(&intern_pool, UINT32_MAX);
+
+  InternPoolStats stats;
+  StringInternPool_get_stats(&intern_pool, &stats);
+  EXPECT_EQ(200, stats.num_values);
+  EXPECT_GT(stats.chunk_bytes_discarded, stats.chunk_bytes_allocated / 2);
+
+  // Kept values are untouched and can still be found and released, and
+  // released ones can be interned again.
+  for (size_t i = 0; i < values.size(); i += 1000) {
+    ASSERT_STREQ(values[i].c_str(), interned[i]);
+    ASSERT_EQ(interned[i],
+              StringInternPool_intern(&intern_pool, values[i].c_str(),
+                                      values[i].size() + 1));
+  }
+  for (size_t i = 1; i < values.size(); i += 1000) {
+    ASSERT_STREQ(values[i].c_str(),
+                 StringInternPool_intern(&intern_pool, values[i].c_str(),
+                                         values[i].size() + 1));
+  }
+  StringInternPool_compact(&intern_pool, UINT32_MAX);
+  for (size_t i = 0; i < values.size(); i += 1000) {
+    ASSERT_STREQ(values[i].c_str(), interned[i]);
+  }
+}
+
+TEST_F(StringInternPoolTest, ChurnKeepsMemoryProportionalToLiveValues) {
+  constexpr int kNumRounds = 500;
+  constexpr int kValuesPerRound = 1000;
+  const char *long_lived =
+      StringInternPool_intern(&intern_pool, "long-lived", sizeof("long-lived"));
+  uint64_t max_resident_bytes = 0;
+  for (int round = 0; round < kNumRounds; ++round) {
+    std::vector<const char *> interned;
+    for (int i = 0; i < kValuesPerRound; ++i) {
+      const std::string value =
+          "user" + std::to_string(round) + "-" + std::to_string(i);
+      interned.push_back(StringInternPool_intern(&intern_pool, value.c_str(),
+                                                 value.size() + 1));
+    }
+    for (const char *value : interned) {
+      ASSERT_TRUE(StringInternPool_release(&intern_pool, value));
+    }
+    InternPoolStats stats;
+    StringInternPool_get_stats(&intern_pool, &stats);
+    max_resident_bytes =
+        std::max(max_resident_bytes,
+                 stats.chunk_bytes_allocated - stats.chunk_bytes_discarded);
+  }
+
+  // About 20 MB of values were interned over time, but memory never held
+  // more than the chunks of a few rounds.
+  EXPECT_LT(max_resident_bytes, 3 * INTERN_CHUNK_MAX_SIZE);
+  EXPECT_LT(intern_pool.num_ids, 2 * kValuesPerRound);
+  EXPECT_STREQ("long-lived", long_lived);
+  EXPECT_EQ(long_lived, StringInternPool_lookup(&intern_pool, "long-lived",
+                                                sizeof("long-lived")));
+}
+
+TEST_F(StringInternPoolTest, ReleaseFailsOnceFrozen) {
+  const char *cat = StringInternPool_intern(&intern_pool, "cat", sizeof("cat"));
+  const char *dog = StringInternPool_intern(&intern_pool, "dog", sizeof("dog"));
+  ASSERT_TRUE(StringInternPool_release(&intern_pool, dog));
+  ASSERT_TRUE(StringInternPool_freeze(&intern_pool));
+
+  EXPECT_FALSE(StringInternPool_release(&intern_pool, cat));
+  EXPECT_EQ(cat, StringInternPool_lookup(&intern_pool, "cat", sizeof("cat")));
+  EXPECT_THAT(StringInternPool_lookup(&intern_pool, "dog", sizeof("dog")),
+              IsNull());
+  EXPECT_THAT(StringInternPool_lookup_id(&intern_pool, 1, NULL), IsNull());
+}
+
+TEST_F(StringInternPoolTest, SaveAfterRelease) {
+  const char *cat = StringInternPool_intern(&intern_pool, "cat", sizeof("cat"));
+  StringInternPool_intern(&intern_pool, "dog", sizeof("dog"));
+  ASSERT_TRUE(StringInternPool_release(&intern_pool, cat));
+  const std::string path = TempDir() + "intern_test_refcounted_snapshot";
+  ASSERT_TRUE(StringInternPool_save(&intern_pool, path.c_str()));
+
+  StringInternPool mapped_pool;
+  ASSERT_TRUE(StringInternPool_open_mmap(&mapped_pool, path.c_str(),
+                                         hash_string, compare_strings));
+  EXPECT_THAT(StringInternPool_lookup(&mapped_pool, "cat", sizeof("cat")),
+              IsNull());
+  EXPECT_THAT(StringInternPool_lookup_id(&mapped_pool, 0, NULL), IsNull());
+  EXPECT_STREQ("dog", StringInternPool_lookup_id(&mapped_pool, 1, NULL));
+  StringInternPool_finalize(&mapped_pool);
+  std::remove(path.c_str());
+}
+
+TEST(ThreadsafeStringInternPoolTest, ConcurrentInternAndRelease) {
+  StringInternPool intern_pool;
+  StringInternPool_init(&intern_pool, /*threadsafe=*/true, hash_string,
+                        compare_strings);
+
+  // Threads share values, so references are often dropped while other
+  // threads acquire them.
+  constexpr int kNumValues = 1000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&, t]() {
+      for (int round = 0; round < 50; ++round) {
+        std::vector<const char *> interned;
+        for (int i = 0; i < kNumValues; ++i) {
+          const std::string value =
+              "value" + std::to_string((i + t * round) % kNumValues);
+          interned.push_back(StringInternPool_intern(
+              &intern_pool, value.c_str(), value.size() + 1));
+          ASSERT_STREQ(value.c_str(), interned.back());
+        }
+        for (const char *value : interned) {
+          ASSERT_TRUE(StringInternPool_release(&intern_pool, value));
+        }
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  InternPoolStats stats;
+  StringInternPool_get_stats(&intern_pool, &stats);
+  EXPECT_EQ(0, stats.num_values);
+  EXPECT_EQ(0, stats.chunk_bytes_live);
+  EXPECT_EQ(0, stats.hash_set.num_entries);
+  StringInternPool_finalize(&intern_pool);
+}
+#endif
+
 }  // namespace
\ No newline at end of file
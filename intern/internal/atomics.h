@@ -0,0 +1,81 @@
+#ifndef COM_GITHUB_JEFFMANZIONE_INTERN_INTERNAL_ATOMICS_H_
+#define COM_GITHUB_JEFFMANZIONE_INTERN_INTERNAL_ATOMICS_H_
+
+/**
+ * @file atomics.h
+ * @brief Minimal atomic operations usable from both C and C++ translation
+ * units.
+ *
+ * The macro-generated data structures are expanded inside C++ code as well as
+ * C code, so neither <stdatomic.h> nor <atomic> can be used directly. GCC and
+ * Clang builtins are used where available. MSVC relies on volatile accesses
+ * having acquire/release semantics (/volatile:ms, the default on x86 and x64).
+ */
+
+#include <stdint.h>
+
+#include "intern/internal/platform.h"
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#include <windows.h>
+
+#define ATOMIC_LOAD_RELAXED(ptr) (*(ptr))
+#define ATOMIC_LOAD_ACQUIRE(ptr) (*(ptr))
+#define ATOMIC_STORE_RELAXED(ptr, value) (*(ptr) = (value))
+#define ATOMIC_STORE_RELEASE(ptr, value) \
+  do {                                   \
+    _ReadWriteBarrier();                 \
+    *(ptr) = (value);                    \
+  } while (0)
+#define ATOMIC_FETCH_ADD_U64(ptr, value) \
+  ((uint64_t)InterlockedExchangeAdd64((volatile LONG64 *)(ptr), (value)))
+#define ATOMIC_ADD_RELAXED_U64(ptr, value) \
+  ((void)InterlockedExchangeAddNoFence64((volatile LONG64 *)(ptr), (value)))
+#define ATOMIC_CAS_U32(ptr, expected, desired)                  \
+  ((uint32_t)InterlockedCompareExchange((volatile LONG *)(ptr), \
+                                        (desired), (expected)) == (expected))
+#define ATOMIC_FENCE_ACQUIRE() _ReadWriteBarrier()
+#define ATOMIC_FENCE_RELEASE() _ReadWriteBarrier()
+#define ATOMIC_FENCE_SEQ_CST() MemoryBarrier()
+
+#else
+
+// Loads the value at ptr with no ordering guarantees.
+#define ATOMIC_LOAD_RELAXED(ptr) __atomic_load_n((ptr), __ATOMIC_RELAXED)
+
+// Loads the value at ptr. Subsequent accesses cannot be reordered before it.
+#define ATOMIC_LOAD_ACQUIRE(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+
+// Stores value at ptr with no ordering guarantees.
+#define ATOMIC_STORE_RELAXED(ptr, value) \
+  __atomic_store_n((ptr), (value), __ATOMIC_RELAXED)
+
+// Stores value at ptr. Prior accesses cannot be reordered after it.
+#define ATOMIC_STORE_RELEASE(ptr, value) \
+  __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+
+// Adds value to the uint64_t at ptr and returns the previous value.
+#define ATOMIC_FETCH_ADD_U64(ptr, value) \
+  __atomic_fetch_add((ptr), (uint64_t)(value), __ATOMIC_SEQ_CST)
+
+// Adds value to the uint64_t at ptr with no ordering guarantees.
+#define ATOMIC_ADD_RELAXED_U64(ptr, value) \
+  ((void)__atomic_fetch_add((ptr), (uint64_t)(value), __ATOMIC_RELAXED))
+
+// Replaces the uint32_t at ptr with desired if it equals expected. True if the
+// value was replaced.
+#define ATOMIC_CAS_U32(ptr, expected, desired)                       \
+  __extension__({                                                    \
+    uint32_t expected_ = (expected);                                 \
+    __atomic_compare_exchange_n((ptr), &expected_, (desired), false, \
+                                __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST); \
+  })
+
+#define ATOMIC_FENCE_ACQUIRE() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define ATOMIC_FENCE_RELEASE() __atomic_thread_fence(__ATOMIC_RELEASE)
+#define ATOMIC_FENCE_SEQ_CST() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+#endif
+
+#endif /* COM_GITHUB_JEFFMANZIONE_INTERN_INTERNAL_ATOMICS_H_ */
@@ -0,0 +1,188 @@
+#include "intern/internal/epoch.h"
+
+#include <stdlib.h>
+
+#include "intern/internal/atomics.h"
+#include "intern/internal/platform.h"
+#include "intern/internal/rwlock.h"
+
+#if defined(SYSTEM_WINDOWS)
+#include <windows.h>
+#elif defined(SYSTEM_POSIX)
+#include <pthread.h>
+#endif
+
+/* Announced epoch of a thread that is not inside a read section */
+#define EPOCH_IDLE 0
+
+typedef struct CACHE_ALIGNED {
+  uint64_t epoch;   /* Global epoch observed on entry, or EPOCH_IDLE */
+  uint32_t claimed; /* Non-zero while owned by a live thread */
+} EpochSlot;
+
+typedef struct EpochRetired_ {
+  const void *owner;
+  void *ptr;
+  uint64_t epoch; /* Global epoch at the time ptr was retired */
+  struct EpochRetired_ *next;
+} EpochRetired;
+
+static EpochSlot epoch_slots[EPOCH_MAX_THREADS];
+static uint64_t global_epoch = 1;
+
+static RWLock retired_lock = RWLOCK_INIT;
+static EpochRetired *retired = NULL;
+static size_t num_retired = 0;
+
+static THREAD_LOCAL EpochSlot *thread_slot = NULL;
+static THREAD_LOCAL bool thread_slot_unavailable = false;
+
+static void release_slot(void *slot) {
+  ATOMIC_STORE_RELEASE(&((EpochSlot *)slot)->epoch, EPOCH_IDLE);
+  ATOMIC_STORE_RELEASE(&((EpochSlot *)slot)->claimed, 0);
+}
+
+/* Returns the slot to the pool when its thread exits */
+#if defined(SYSTEM_WINDOWS)
+static INIT_ONCE slot_key_once = INIT_ONCE_STATIC_INIT;
+static DWORD slot_key;
+
+static VOID WINAPI release_slot_fls(PVOID slot) {
+  if (slot != NULL) {
+    release_slot(slot);
+  }
+}
+
+static BOOL CALLBACK create_slot_key(PINIT_ONCE once, PVOID param,
+                                     PVOID *context) {
+  slot_key = FlsAlloc(release_slot_fls);
+  return TRUE;
+}
+
+static void register_slot_release(EpochSlot *slot) {
+  InitOnceExecuteOnce(&slot_key_once, create_slot_key, NULL, NULL);
+  FlsSetValue(slot_key, slot);
+}
+#elif defined(SYSTEM_POSIX)
+static pthread_once_t slot_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t slot_key;
+
+static void create_slot_key(void) { pthread_key_create(&slot_key, release_slot); }
+
+static void register_slot_release(EpochSlot *slot) {
+  pthread_once(&slot_key_once, create_slot_key);
+  pthread_setspecific(slot_key, slot);
+}
+#else
+static void register_slot_release(EpochSlot *slot) {
+  /* Slots are never returned on unknown platforms. */
+}
+#endif
+
+static EpochSlot *epoch_thread_slot(void) {
+  if (thread_slot != NULL || thread_slot_unavailable) {
+    return thread_slot;
+  }
+  for (int i = 0; i < EPOCH_MAX_THREADS; ++i) {
+    EpochSlot *slot = epoch_slots + i;
+    if (ATOMIC_LOAD_RELAXED(&slot->claimed) == 0 &&
+        ATOMIC_CAS_U32(&slot->claimed, 0, 1)) {
+      register_slot_release(slot);
+      thread_slot = slot;
+      return slot;
+    }
+  }
+  thread_slot_unavailable = true;
+  return NULL;
+}
+
+bool epoch_enter(void) {
+  EpochSlot *slot = epoch_thread_slot();
+  if (slot == NULL) {
+    return false;
+  }
+  ATOMIC_STORE_RELAXED(&slot->epoch, ATOMIC_LOAD_ACQUIRE(&global_epoch));
+  /* The announcement must be visible before any shared pointer is loaded. */
+  ATOMIC_FENCE_SEQ_CST();
+  return true;
+}
+
+void epoch_exit(void) { ATOMIC_STORE_RELEASE(&thread_slot->epoch, EPOCH_IDLE); }
+
+/* Returns the oldest epoch announced by a reader, or UINT64_MAX if none. */
+static uint64_t min_active_epoch(void) {
+  ATOMIC_FENCE_SEQ_CST();
+  uint64_t min_epoch = UINT64_MAX;
+  for (int i = 0; i < EPOCH_MAX_THREADS; ++i) {
+    const uint64_t epoch = ATOMIC_LOAD_RELAXED(&epoch_slots[i].epoch);
+    if (epoch != EPOCH_IDLE && epoch < min_epoch) {
+      min_epoch = epoch;
+    }
+  }
+  return min_epoch;
+}
+
+static void free_retired_where(bool (*should_free)(const EpochRetired *,
+                                                   const void *),
+                               const void *arg) {
+  EpochRetired **it = &retired;
+  while (*it != NULL) {
+    EpochRetired *node = *it;
+    if (should_free(node, arg)) {
+      *it = node->next;
+      free(node->ptr);
+      free(node);
+      num_retired--;
+    } else {
+      it = &node->next;
+    }
+  }
+}
+
+static bool retired_before(const EpochRetired *node, const void *min_epoch) {
+  return node->epoch < *(const uint64_t *)min_epoch;
+}
+
+static bool retired_by(const EpochRetired *node, const void *owner) {
+  return node->owner == owner;
+}
+
+void epoch_retire(const void *owner, void *ptr) {
+  EpochRetired *node = (EpochRetired *)malloc(sizeof(EpochRetired));
+  if (node == NULL) {
+    /* Leaking is the only safe option if the block cannot be tracked. */
+    return;
+  }
+  node->owner = owner;
+  node->ptr = ptr;
+
+  rwlock_write_lock(&retired_lock);
+  node->epoch = ATOMIC_FETCH_ADD_U64(&global_epoch, 1);
+  node->next = retired;
+  retired = node;
+  num_retired++;
+
+  const uint64_t min_epoch = min_active_epoch();
+  free_retired_where(retired_before, &min_epoch);
+  rwlock_write_unlock(&retired_lock);
+}
+
+void epoch_reclaim(void) {
+  rwlock_write_lock(&retired_lock);
+  const uint64_t min_epoch = min_active_epoch();
+  free_retired_where(retired_before, &min_epoch);
+  rwlock_write_unlock(&retired_lock);
+}
+
+void epoch_drain(const void *owner) {
+  rwlock_write_lock(&retired_lock);
+  free_retired_where(retired_by, owner);
+  rwlock_write_unlock(&retired_lock);
+}
+
+size_t epoch_num_pending(void) {
+  rwlock_read_lock(&retired_lock);
+  const size_t pending = num_retired;
+  rwlock_read_unlock(&retired_lock);
+  return pending;
+}
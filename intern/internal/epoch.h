@@ -0,0 +1,50 @@
+#ifndef COM_GITHUB_JEFFMANZIONE_INTERN_INTERNAL_EPOCH_H_
+#define COM_GITHUB_JEFFMANZIONE_INTERN_INTERNAL_EPOCH_H_
+
+/**
+ * @file epoch.h
+ * @brief Process-wide epoch-based reclamation for lock-free readers.
+ *
+ * Readers bracket lock-free accesses to shared memory with epoch_enter() and
+ * epoch_exit(). Writers that unpublish a block of memory hand it to
+ * epoch_retire(), which frees it once every reader that could still observe it
+ * has exited.
+ *
+ * Each reading thread claims a private, cache-line aligned announcement slot
+ * on first use, so entering and exiting never write to memory shared with
+ * other readers. Slots are returned when their thread exits.
+ *
+ * Usage assumptions:
+ *   - Read sections must not be nested.
+ *   - epoch_enter() returns false when all EPOCH_MAX_THREADS slots are in use;
+ *     callers must then fall back to a locking read path.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Maximum number of threads that may be inside a read section at once.
+#define EPOCH_MAX_THREADS 256
+
+/* Reader-side operations */
+bool epoch_enter(void);
+void epoch_exit(void);
+
+/* Writer-side operations */
+
+// Frees ptr once no reader that entered before this call remains. owner
+// identifies the structure ptr was unpublished from.
+void epoch_retire(const void *owner, void *ptr);
+
+// Frees any retired memory that is no longer observable by readers.
+void epoch_reclaim(void);
+
+// Frees all memory retired by owner regardless of readers. The caller must
+// guarantee no reader can still access owner.
+void epoch_drain(const void *owner);
+
+// Returns the number of retired blocks not yet freed.
+size_t epoch_num_pending(void);
+
+#endif /* COM_GITHUB_JEFFMANZIONE_INTERN_INTERNAL_EPOCH_H_ */
@@ -0,0 +1,83 @@
+extern "C" {
+#include "intern/internal/epoch.h"
+}
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+int owner;
+
+TEST(EpochTest, EnterExit) {
+  ASSERT_TRUE(epoch_enter());
+  epoch_exit();
+  ASSERT_TRUE(epoch_enter());
+  epoch_exit();
+}
+
+TEST(EpochTest, RetireWithoutReadersFreesImmediately) {
+  epoch_retire(&owner, malloc(16));
+  EXPECT_EQ(0, epoch_num_pending());
+}
+
+TEST(EpochTest, RetireWaitsForActiveReader) {
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool reader_entered = false;
+  bool retired = false;
+
+  std::thread reader([&]() {
+    ASSERT_TRUE(epoch_enter());
+    std::unique_lock<std::mutex> lock(mutex);
+    reader_entered = true;
+    cv.notify_all();
+    cv.wait(lock, [&]() { return retired; });
+    epoch_exit();
+  });
+
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&]() { return reader_entered; });
+  }
+  epoch_retire(&owner, malloc(16));
+  // The reader may still hold a reference.
+  EXPECT_EQ(1, epoch_num_pending());
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    retired = true;
+  }
+  cv.notify_all();
+  reader.join();
+
+  epoch_reclaim();
+  EXPECT_EQ(0, epoch_num_pending());
+}
+
+TEST(EpochTest, ReaderEnteringAfterRetireDoesNotBlockReclaim) {
+  ASSERT_TRUE(epoch_enter());
+  epoch_retire(&owner, malloc(16));
+  EXPECT_EQ(1, epoch_num_pending());
+  epoch_exit();
+
+  // A new read section cannot observe the retired block.
+  ASSERT_TRUE(epoch_enter());
+  epoch_reclaim();
+  EXPECT_EQ(0, epoch_num_pending());
+  epoch_exit();
+}
+
+TEST(EpochTest, Drain) {
+  ASSERT_TRUE(epoch_enter());
+  epoch_retire(&owner, malloc(16));
+  EXPECT_EQ(1, epoch_num_pending());
+  epoch_drain(&owner);
+  EXPECT_EQ(0, epoch_num_pending());
+  epoch_exit();
+}
+
+}  // namespace
@@ -3,21 +3,115 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "intern/internal/atomics.h"
+#include "intern/internal/epoch.h"
+#include "intern/internal/intern_helpers.h"
+#include "intern/internal/platform.h"
+#include "intern/internal/stats.h"
 
 // A decent small prime number to use as the starting size for the hashtable
 #define DEFAULT_TABLE_SIZE 31
 
+// Control byte mode keeps a dense array of one-byte hash fragments next to the
+// slot array so that probes only touch a slot when its fragment matches. Its
+// probe sequence relies on power-of-2 tables.
+//
+// Group probing matches a whole group of control bytes at a time (see
+// CTRL_GROUP_WIDTH) and builds on control byte mode.
+#if defined(HASH_SET_GROUP_PROBING) && !defined(HASH_SET_CONTROL_BYTES)
+#define HASH_SET_CONTROL_BYTES
+#endif
+
+#if defined(HASH_SET_CONTROL_BYTES) && !defined(HASH_SET_POW2_TABLES)
+#define HASH_SET_POW2_TABLES
+#endif
+
+// Without the insertion-order list, entries carry no links and resizing scans
+// the table linearly. Control byte mode never keeps the list.
+#if defined(HASH_SET_CONTROL_BYTES) && !defined(HASH_SET_NO_INSERTION_ORDER)
+#define HASH_SET_NO_INSERTION_ORDER
+#endif
+
+// Tables never grow beyond about 2^HASH_SET_MAX_TABLE_BITS slots, so that slot
+// positions and resize thresholds fit in an int.
+#ifndef HASH_SET_MAX_TABLE_BITS
+#define HASH_SET_MAX_TABLE_BITS 31
+#endif
+
+#if defined(HASH_SET_POW2_TABLES)
+// Power-of-2 table mode: positions are computed with a mask instead of a
+// division. Must be defined consistently for every translation unit that uses a
+// given hash set.
+
+// Rounds a requested table size up to the nearest power of 2.
+#if defined(HASH_SET_CONTROL_BYTES)
+// Tables hold at least one group of control bytes.
+#define NORMALIZE_TABLE_SIZE(size)                                      \
+  compute_nearest_pow2_gte((size) < CTRL_GROUP_WIDTH ? CTRL_GROUP_WIDTH \
+                                                     : (size))
+#else
+#define NORMALIZE_TABLE_SIZE(size) compute_nearest_pow2_gte(size)
+#endif
+
+// Find the table position of a hash value. Triangular probing visits every slot
+// of a power-of-2 table.
+#define LOOKUP_HASH_POSITION(hval, num_probes, table_size) \
+  (((hval) + (((num_probes) * ((num_probes) + 1)) >> 1)) & ((table_size)-1))
+
+// Largest table size.
+#define HASH_SET_MAX_TABLE_SIZE ((uint32_t)1 << HASH_SET_MAX_TABLE_BITS)
+
+// Calculates a new reasonable size of the hash table given a current size,
+// saturating at HASH_SET_MAX_TABLE_SIZE.
+#define CALCULATE_NEW_TABLE_SIZE(current_size)   \
+  ((current_size) >= HASH_SET_MAX_TABLE_SIZE / 2 \
+       ? HASH_SET_MAX_TABLE_SIZE                 \
+       : (current_size)*2)
+
+// Smallest table size that holds num_entries without resizing, or the largest
+// table size if none does.
+#define TABLE_SIZE_FOR_ENTRIES(num_entries)                                   \
+  NORMALIZE_TABLE_SIZE(2 * (uint64_t)(num_entries) >= HASH_SET_MAX_TABLE_SIZE \
+                           ? HASH_SET_MAX_TABLE_SIZE                          \
+                           : 2 * (uint32_t)(num_entries))
+
+// Masking only uses the low bits, so user hashes are finalized to spread
+// entropy from the high bits.
+#define MIX_HASH(hval) mix_hash32(hval)
+#else
+#define NORMALIZE_TABLE_SIZE(size) (size)
+
 // Find the table position of a hash value.
 #define LOOKUP_HASH_POSITION(hval, num_probes, table_size) \
   (((hval) + ((num_probes) * (num_probes))) % (table_size))
 
-// Calculates a new reasonable size of the hash table given a current size.
-#define CALCULATE_NEW_TABLE_SIZE(current_size) (((current_size)*2) + 1)
+// Largest table size, which is odd.
+#define HASH_SET_MAX_TABLE_SIZE (((uint32_t)1 << HASH_SET_MAX_TABLE_BITS) - 1)
+
+// Calculates a new reasonable size of the hash table given a current size,
+// saturating at HASH_SET_MAX_TABLE_SIZE.
+#define CALCULATE_NEW_TABLE_SIZE(current_size)   \
+  ((current_size) >= HASH_SET_MAX_TABLE_SIZE / 2 \
+       ? HASH_SET_MAX_TABLE_SIZE                 \
+       : ((current_size)*2) + 1)
+
+// Smallest odd table size that holds num_entries without resizing, or the
+// largest table size if none does.
+#define TABLE_SIZE_FOR_ENTRIES(num_entries)                   \
+  (2 * (uint64_t)(num_entries) + 1 >= HASH_SET_MAX_TABLE_SIZE \
+       ? HASH_SET_MAX_TABLE_SIZE                              \
+       : 2 * (uint32_t)(num_entries) + 1)
+
+#define MIX_HASH(hval) (hval)
+#endif
 
 // Calculates the threshold for number of entries in the given hash table size
 // before it efficieny starts to diminish and the table should be
 // resized/rehashed.
-#define CALCULATE_RESIZE_THRESHOLD(table_size) ((int)((table_size) / 2.f))
+#define CALCULATE_RESIZE_THRESHOLD(table_size) ((uint32_t)(table_size) / 2)
 
 // Value for num_probes on a hash table entry when it has been tombstoned, i.e.,
 // previously contained a value that was subsquently removed.
@@ -35,6 +129,298 @@
 // a clear performance bottleneck w.r.t. the size of the hash table.
 #define MAX_PROBES_THRESHOLD(table_size) ((int)((table_size) / 2))
 
+#if defined(HASH_SET_CONTROL_BYTES)
+// Control byte of a slot that has never held a value.
+#define CTRL_EMPTY ((int8_t)-128)
+
+// Control byte of a slot whose value was removed.
+#define CTRL_DELETED ((int8_t)-2)
+
+// Control byte of a slot holding a value: the top 7 bits of its hash. The low
+// bits already select the position, so the fragment is independent of them.
+#define CTRL_FRAGMENT(hval) ((int8_t)((hval) >> 25))
+
+// True if the control byte belongs to a slot holding a value.
+#define IS_CTRL_FULL(ctrl) ((ctrl) >= 0)
+
+// The control bytes of a table are stored directly after its table_size slots
+// in the same allocation.
+#define CTRL_BYTES(table, table_size) ((int8_t *)((table) + (table_size)))
+#endif
+
+#if defined(HASH_SET_NO_INSERTION_ORDER)
+#define INSERTION_ORDER_FIELDS(name)
+#define INSERTION_ORDER_LINKS(name)
+#define RESET_INSERTION_ORDER(hash_set) ((void)0)
+#else
+// Head and tail of the list of entries in insertion order.
+#define INSERTION_ORDER_FIELDS(name) name##Entry *first, *last;
+
+// Links of an entry in the insertion-order list.
+#define INSERTION_ORDER_LINKS(name) name##Entry *prev, *next;
+
+#define RESET_INSERTION_ORDER(hash_set) \
+  ((hash_set)->first = (hash_set)->last = NULL)
+#endif
+
+// Whether entries store the size of their value, selected by the size_mode
+// argument (SIZED, UNSIZED or SIZED_SMALL) of IMPL_HASH_SET_SIZE_MODE.
+//
+// UNSIZED sets hold values of a single size and pass other_size, the size of
+// the value being looked up, for their values instead (or 0 when rehashing).
+//
+// SIZED_SMALL entries also hold a copy of values of up to SMALL_VALUE_MAX_SIZE
+// bytes (see pack_small_value), so the value type must point to them. Such
+// values are matched against the copy, without dereferencing the entry.
+#define ENTRY_SIZE_FIELD_SIZED uint32_t value_size;
+#define ENTRY_SIZE_FIELD_UNSIZED
+#define ENTRY_SIZE_FIELD_SIZED_SMALL \
+  uint64_t small_value;              \
+  uint32_t value_size;
+#define ENTRY_SIZE_SIZED(entry, other_size) ((entry)->value_size)
+#define ENTRY_SIZE_UNSIZED(entry, other_size) (other_size)
+#define ENTRY_SIZE_SIZED_SMALL(entry, other_size) ((entry)->value_size)
+#define SET_ENTRY_SIZE_SIZED(entry, stored, size) ((entry)->value_size = (size))
+#define SET_ENTRY_SIZE_UNSIZED(entry, stored, size) ((void)(size))
+#define SET_ENTRY_SIZE_SIZED_SMALL(entry, stored, size) \
+  ((entry)->value_size = (size),                        \
+   (entry)->small_value = pack_small_value((stored), (size)))
+
+// True if entry holds a value equal to other, which has other_size bytes.
+#define ENTRY_MATCHES_SIZED(entry, other, other_size, compare_fn) \
+  (compare_fn((other), (other_size), (entry)->value,              \
+              (entry)->value_size) == 0)
+#define ENTRY_MATCHES_UNSIZED(entry, other, other_size, compare_fn) \
+  (compare_fn((other), (other_size), (entry)->value, (other_size)) == 0)
+#define ENTRY_MATCHES_SIZED_SMALL(entry, other, other_size, compare_fn)      \
+  ((entry)->value_size == (other_size) &&                                    \
+   ((other_size) <= SMALL_VALUE_MAX_SIZE                                     \
+        ? (entry)->small_value == pack_small_value((other), (other_size))    \
+        : compare_fn((other), (other_size), (entry)->value, (other_size)) == \
+              0))
+
+// Largest value, in bytes, that SIZED_SMALL entries hold a copy of.
+#define SMALL_VALUE_MAX_SIZE 8
+
+// Incremental resize mode keeps the previous table live after a resize and
+// migrates HASH_SET_MIGRATION_SLOTS_PER_WRITE of its slots on each later write,
+// instead of rehashing every value at once. Lookups check both tables until
+// migration finishes.
+#if defined(HASH_SET_INCREMENTAL_RESIZE)
+// Must be at least 2, so that migration finishes before the new table fills up
+// to its own resize threshold.
+#ifndef HASH_SET_MIGRATION_SLOTS_PER_WRITE
+#define HASH_SET_MIGRATION_SLOTS_PER_WRITE 16
+#endif
+
+// The previous table while a resize is in progress, and its next slot to
+// migrate.
+#define INCREMENTAL_RESIZE_FIELDS(name) \
+  name##Entry *old_table;               \
+  uint32_t old_table_size, migrate_position;
+
+// Readers load old_table_size first, so a nonzero size is never paired with a
+// released table.
+#define RESET_INCREMENTAL_RESIZE(hash_set)                \
+  (ATOMIC_STORE_RELAXED(&(hash_set)->old_table, NULL),    \
+   ATOMIC_STORE_RELEASE(&(hash_set)->old_table_size, 0u), \
+   (hash_set)->migrate_position = 0)
+#else
+#define INCREMENTAL_RESIZE_FIELDS(name)
+#define RESET_INCREMENTAL_RESIZE(hash_set) ((void)0)
+#endif
+
+// Finalization step of MurmurHash3. Every input bit affects every output bit.
+static inline uint32_t mix_hash32(uint32_t hval) {
+  hval ^= hval >> 16;
+  hval *= 0x85EBCA6B;
+  hval ^= hval >> 13;
+  hval *= 0xC2B2AE35;
+  hval ^= hval >> 16;
+  return hval;
+}
+
+// Packs the bytes of a value of at most SMALL_VALUE_MAX_SIZE bytes into a word
+// without a variable-length copy. Values of the same size pack to the same
+// word exactly when their bytes are equal. Larger values are not read.
+static inline uint64_t pack_small_value(const void *value, uint32_t size) {
+  const unsigned char *bytes = (const unsigned char *)value;
+  if (size > SMALL_VALUE_MAX_SIZE || size == 0) {
+    return 0;
+  }
+  if (size < 4) {
+    return ((uint64_t)bytes[0] << 16) | ((uint64_t)bytes[size / 2] << 8) |
+           bytes[size - 1];
+  }
+  // The two words overlap unless size is 8.
+  uint32_t low, high;
+  memcpy(&low, bytes, sizeof(low));
+  memcpy(&high, bytes + size - sizeof(high), sizeof(high));
+  return ((uint64_t)high << 32) | low;
+}
+
+#if defined(HASH_SET_CONTROL_BYTES)
+// Index of the lowest set bit of a non-zero mask.
+static inline uint32_t lowest_bit_index(uint64_t mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  unsigned long index;
+  _BitScanForward64(&index, mask);
+  return (uint32_t)index;
+#else
+  return (uint32_t)__builtin_ctzll(mask);
+#endif
+}
+
+// Probes visit aligned groups of CTRL_GROUP_WIDTH control bytes. Matching a
+// group yields a mask with one bit (or byte) per matching control byte, which
+// is walked from the lowest set bit with CTRL_MASK_INDEX and mask &= mask - 1.
+#if defined(HASH_SET_GROUP_PROBING) &&                            \
+    (defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || \
+     (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+
+#define CTRL_GROUP_WIDTH 16
+#define CTRL_MASK_INDEX(mask) lowest_bit_index(mask)
+
+// Mask of the control bytes in group equal to ctrl.
+static inline uint64_t ctrl_group_match(const int8_t *group, int8_t ctrl) {
+  const __m128i bytes = _mm_loadu_si128((const __m128i *)group);
+  return (uint32_t)_mm_movemask_epi8(
+      _mm_cmpeq_epi8(bytes, _mm_set1_epi8((char)ctrl)));
+}
+
+// Mask of the empty or deleted control bytes in group, i.e. those with the sign
+// bit set.
+static inline uint64_t ctrl_group_match_vacant(const int8_t *group) {
+  return (uint32_t)_mm_movemask_epi8(
+      _mm_loadu_si128((const __m128i *)group));
+}
+
+static inline uint64_t ctrl_group_match_empty(const int8_t *group) {
+  return ctrl_group_match(group, CTRL_EMPTY);
+}
+#elif defined(HASH_SET_GROUP_PROBING)
+// Portable fallback that matches 8 control bytes held in a uint64_t. Each
+// matching byte sets its high bit in the mask.
+#define CTRL_GROUP_WIDTH 8
+#define CTRL_MASK_INDEX(mask) (lowest_bit_index(mask) >> 3)
+
+#define CTRL_LSBS 0x0101010101010101ull
+#define CTRL_MSBS 0x8080808080808080ull
+
+static inline uint64_t ctrl_group_load(const int8_t *group) {
+  uint64_t bytes;
+  memcpy(&bytes, group, sizeof(bytes));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  bytes = __builtin_bswap64(bytes);
+#endif
+  return bytes;
+}
+
+// May report a byte directly above a true match as matching, so slots found
+// this way must still have their hash compared.
+static inline uint64_t ctrl_group_match(const int8_t *group, int8_t ctrl) {
+  const uint64_t bytes = ctrl_group_load(group) ^ (CTRL_LSBS * (uint8_t)ctrl);
+  return (bytes - CTRL_LSBS) & ~bytes & CTRL_MSBS;
+}
+
+static inline uint64_t ctrl_group_match_vacant(const int8_t *group) {
+  return ctrl_group_load(group) & CTRL_MSBS;
+}
+
+// CTRL_EMPTY and CTRL_DELETED only differ in bit 1.
+static inline uint64_t ctrl_group_match_empty(const int8_t *group) {
+  const uint64_t bytes = ctrl_group_load(group);
+  return bytes & ~(bytes << 6) & CTRL_MSBS;
+}
+#else
+// Without group probing every control byte is its own group.
+#define CTRL_GROUP_WIDTH 1
+#define CTRL_MASK_INDEX(mask) 0
+
+static inline uint64_t ctrl_group_match(const int8_t *group, int8_t ctrl) {
+  return *group == ctrl;
+}
+
+static inline uint64_t ctrl_group_match_vacant(const int8_t *group) {
+  return !IS_CTRL_FULL(*group);
+}
+
+static inline uint64_t ctrl_group_match_empty(const int8_t *group) {
+  return *group == CTRL_EMPTY;
+}
+#endif
+#endif
+
+// Snapshot of a hash set returned by name##_get_stats().
+typedef struct {
+  uint32_t table_size;
+  uint32_t num_entries;
+  // Slots of removed values that probes still have to skip.
+  uint32_t num_tombstones;
+  double load_factor;  // num_entries / table_size
+  // The counters below are only kept with INTERN_ENABLE_STATS and are 0
+  // otherwise.
+  uint64_t hits;    // Lookups that found the value, including by remove
+  uint64_t misses;  // Lookups that did not
+  uint64_t inserts;
+  uint64_t resizes;
+  // Slots probed by lookups, or groups of control bytes in control byte mode.
+  uint64_t total_probes;
+  uint64_t max_probes;
+} HashSetStats;
+
+#if defined(INTERN_ENABLE_STATS)
+// Counters kept by every hash set. Lookups may run concurrently, so they are
+// striped (see stats.h).
+enum {
+  HASH_SET_STAT_HITS,
+  HASH_SET_STAT_MISSES,
+  HASH_SET_STAT_INSERTS,
+  HASH_SET_STAT_RESIZES,
+  HASH_SET_STAT_PROBES,
+  HASH_SET_STAT_MAX_PROBES,
+};
+
+#define HASH_SET_STATS_FIELDS StripedCounters stats;
+
+#define HASH_SET_INIT_STATS(hash_set) striped_counters_init(&(hash_set)->stats)
+
+// Adds n to a counter. Lookups count through const pointers.
+#define HASH_SET_COUNT(hash_set, counter, n)                  \
+  striped_counters_add((StripedCounters *)&(hash_set)->stats, \
+                       HASH_SET_STAT_##counter, (n))
+
+// Counts a lookup that made num_probes probes.
+#define HASH_SET_COUNT_LOOKUP(hash_set, found, num_probes)                   \
+  do {                                                                       \
+    StripedCounters *counters_ = (StripedCounters *)&(hash_set)->stats;      \
+    striped_counters_add(                                                    \
+        counters_, (found) ? HASH_SET_STAT_HITS : HASH_SET_STAT_MISSES, 1);  \
+    striped_counters_add(counters_, HASH_SET_STAT_PROBES, (num_probes));     \
+    striped_counters_max(counters_, HASH_SET_STAT_MAX_PROBES, (num_probes)); \
+  } while (0)
+
+#define HASH_SET_READ_STATS(hash_set, out)                                   \
+  do {                                                                       \
+    const StripedCounters *counters_ = &(hash_set)->stats;                   \
+    (out)->hits = striped_counters_sum(counters_, HASH_SET_STAT_HITS);       \
+    (out)->misses = striped_counters_sum(counters_, HASH_SET_STAT_MISSES);   \
+    (out)->inserts = striped_counters_sum(counters_, HASH_SET_STAT_INSERTS); \
+    (out)->resizes = striped_counters_sum(counters_, HASH_SET_STAT_RESIZES); \
+    (out)->total_probes =                                                    \
+        striped_counters_sum(counters_, HASH_SET_STAT_PROBES);               \
+    (out)->max_probes =                                                      \
+        striped_counters_max_of(counters_, HASH_SET_STAT_MAX_PROBES);        \
+  } while (0)
+#else
+#define HASH_SET_STATS_FIELDS
+#define HASH_SET_INIT_STATS(hash_set) ((void)0)
+#define HASH_SET_COUNT(hash_set, counter, n) ((void)0)
+#define HASH_SET_COUNT_LOOKUP(hash_set, found, num_probes) ((void)0)
+#define HASH_SET_READ_STATS(hash_set, out) ((void)0)
+#endif
+
 // Expands to the header definitions for a hash set with the given name and
 // value type.
 //
@@ -49,10 +435,21 @@
 //                                 CatHashSetCompareFn);
 //   void CatHashSet_finalize(CatHashSet*);
 //   void CatHashSet_delete(CatHashSet*);
+//   void CatHashSet_reserve(CatHashSet*, uint32_t num_values);
 //   bool CatHashSet_insert(CatHashSet*, const Cat, uint32_t);
 //   Cat CatHashSet_remove(CatHashSet*, const Cat, uint32_t);
 //   bool CatHashSet_contains(CatHashSet*, const Cat, uint32_t);
+//   Cat CatHashSet_find(CatHashSet*, const Cat, uint32_t, Cat default_value);
+//   bool CatHashSet_insert_prehashed(CatHashSet*, const Cat, uint32_t,
+//                                    uint32_t hash);
+//   Cat CatHashSet_find_prehashed(CatHashSet*, const Cat, uint32_t,
+//                                 uint32_t hash, Cat default_value);
 //   uint32_t CatHashSet_size(CatHashSet*);
+//   void CatHashSet_clear(CatHashSet*);
+//   void CatHashSet_get_stats(const CatHashSet*, HashSetStats*);
+//   void CatHashSet_enable_concurrent_reads(CatHashSet*);
+//   bool CatHashSet_try_find_concurrent(const CatHashSet*, const Cat, uint32_t,
+//                                       Cat default_value, Cat *result);
 #define DEFINE_HASH_SET(name, value_type)                                  \
                                                                            \
   typedef uint32_t (*name##HashFn)(const value_type, uint32_t size);       \
@@ -65,7 +462,17 @@
     name##HashFn hash;                                                     \
     name##CompareFn compare;                                               \
     uint32_t table_size, num_entries, resize_threshold;                    \
-    name##Entry *table, *first, *last;                                     \
+    /* Slots erased since the table was allocated, which bounds the        \
+     * tombstones it holds. */                                             \
+    uint32_t num_erased;                                                   \
+    name##Entry *table;                                                    \
+    INSERTION_ORDER_FIELDS(name)                                           \
+    INCREMENTAL_RESIZE_FIELDS(name)                                        \
+    /* Odd while a writer is modifying the table. */                       \
+    uint32_t seq;                                                          \
+    /* If true, replaced tables are freed through epoch_retire(). */       \
+    bool concurrent_reads;                                                 \
+    HASH_SET_STATS_FIELDS                                                  \
   } name;                                                                  \
                                                                            \
   void name##_init(name *hash_set, uint32_t start_size, name##HashFn,      \
@@ -77,6 +484,10 @@
                                                                            \
   void name##_delete(name *);                                              \
                                                                            \
+  /* Grows the table so that num_values values fit without resizing. Never \
+   * shrinks it. */                                                        \
+  void name##_reserve(name *, uint32_t num_values);                        \
+                                                                           \
   bool name##_insert(name *, const value_type value, uint32_t value_size); \
                                                                            \
   bool name##_remove(name *, const value_type value, uint32_t value_size); \
@@ -87,42 +498,369 @@
   value_type name##_find(const name *hash_set, const value_type value,     \
                          uint32_t value_size, value_type default_value);   \
                                                                            \
-  uint32_t name##_size(const name *)
+  /* Like name_insert and name_find, but hash must be the value returned   \
+   * by the set's hash function for value, which is then not called. */    \
+  bool name##_insert_prehashed(name *, const value_type value,             \
+                               uint32_t value_size, uint32_t hash);        \
+                                                                           \
+  value_type name##_find_prehashed(const name *hash_set,                   \
+                                   const value_type value,                 \
+                                   uint32_t value_size, uint32_t hash,     \
+                                   value_type default_value);              \
+                                                                           \
+  uint32_t name##_size(const name *);                                      \
+                                                                           \
+  void name##_clear(name *);                                               \
+                                                                           \
+  void name##_get_stats(const name *hash_set, HashSetStats *stats);        \
+                                                                           \
+  void name##_enable_concurrent_reads(name *);                             \
+                                                                           \
+  bool name##_try_find_concurrent(                                         \
+      const name *hash_set, const value_type value, uint32_t value_size,   \
+      value_type default_value, value_type *result)
 
-// Expands to the impleemtation for a hash set with the given name and value
-// type.
+#if defined(HASH_SET_CONTROL_BYTES)
+// Expands to the table layout used by IMPL_HASH_SET_INLINE.
 //
-// Generates the following for name=CatHashSet and value_type=Cat:
+// Slots only hold the payload. Each slot has a matching control byte (see
+// CTRL_FRAGMENT) and probes scan the control bytes one group at a time, so a
+// slot is only read when its fragment matches. Values have no insertion order;
+// resizing walks the control bytes instead.
 //
-//   void CatHashSet_init(CatHashSet*, uint32_t start_size, CatHashSetHashFn,
-//                        CatHashSetCompareFn) { ... }
-//   CatHashSet* CatHashSet_create(uint32_t start_size, CatHashSetHashFn,
-//                                 CatHashSetCompareFn) { ... }
-//   void CatHashSet_finalize(CatHashSet*) { ... }
-//   void CatHashSet_delete(CatHashSet*) { ... }
-//   bool CatHashSet_insert(CatHashSet*, const Cat, uint32_t value_size) { ... }
-//   bool CatHashSet_remove(CatHashSet*, const Cat, uint32_t value_size) { ... }
-//   bool CatHashSet_contains(CatHashSet*, const Cat, uint32_t) { ... }
-//   Cat CatHashSet_find(CatHashSet*, const Cat, uint32_t value_size) { ... }
-//   uint32_t CatHashSet_size(CatHashSet*) { ... }
-#define IMPL_HASH_SET(name, value_type)                                        \
+// A value is stored in the first vacant slot along its probe sequence of
+// groups, and a group that has an empty slot has never been full. Lookups can
+// therefore stop at the first group with an empty slot.
+#define IMPL_HASH_SET_LAYOUT(name, value_type, hash_fn, compare_fn, size_mode) \
                                                                                \
   struct name##Entry_ {                                                        \
     value_type value;                                                          \
-    uint32_t value_size;                                                       \
+    ENTRY_SIZE_FIELD_##size_mode                                               \
     uint32_t hash_value;                                                       \
-    int32_t num_probes;                                                        \
-    name##Entry *prev, *next;                                                  \
   };                                                                           \
                                                                                \
+  static name##Entry *name##_allocate_table(uint32_t table_size) {             \
+    name##Entry *table = (name##Entry *)malloc(                                \
+        (sizeof(name##Entry) + sizeof(int8_t)) * table_size);                  \
+    memset(CTRL_BYTES(table, table_size), CTRL_EMPTY, table_size);             \
+    return table;                                                              \
+  }                                                                            \
+                                                                               \
+  static void name##_fill_slot(name##Entry *table, uint32_t table_size,        \
+                               uint32_t position, value_type value,            \
+                               uint32_t value_size, uint32_t hval) {           \
+    table[position].value = value;                                             \
+    SET_ENTRY_SIZE_##size_mode(&table[position], value, value_size);           \
+    table[position].hash_value = hval;                                         \
+    CTRL_BYTES(table, table_size)[position] = CTRL_FRAGMENT(hval);             \
+  }                                                                            \
+                                                                               \
+  /* Places a value known to be absent from table in the first vacant slot. */ \
+  static void name##_insert_unique(name##Entry *table, uint32_t table_size,    \
+                                   value_type value, uint32_t value_size,      \
+                                   uint32_t hval) {                            \
+    const int8_t *ctrl = CTRL_BYTES(table, table_size);                        \
+    const uint32_t num_groups = table_size / CTRL_GROUP_WIDTH;                 \
+    for (uint32_t num_probes = 0;; ++num_probes) {                             \
+      const uint32_t group =                                                   \
+          LOOKUP_HASH_POSITION(hval, num_probes, num_groups) *                 \
+          CTRL_GROUP_WIDTH;                                                    \
+      const uint64_t vacant = ctrl_group_match_vacant(ctrl + group);           \
+      if (vacant != 0) {                                                       \
+        name##_fill_slot(table, table_size, group + CTRL_MASK_INDEX(vacant),   \
+                         value, value_size, hval);                             \
+        return;                                                                \
+      }                                                                        \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
   static bool name##_attempt_insert_internal(                                  \
       name *hash_set, value_type value, uint32_t value_size, uint32_t hval,    \
-      name##Entry *table, uint32_t table_size, name##Entry **first,            \
-      name##Entry **last, bool *probe_limit_exceeded) {                        \
+      name##Entry *table, uint32_t table_size, bool *probe_limit_exceeded) {   \
+    const int8_t *ctrl = CTRL_BYTES(table, table_size);                        \
+    const int8_t fragment = CTRL_FRAGMENT(hval);                               \
+    const uint32_t num_groups = table_size / CTRL_GROUP_WIDTH;                 \
+    int64_t first_vacant = -1;                                                 \
+    for (uint32_t num_probes = 0; num_probes < num_groups; ++num_probes) {     \
+      const uint32_t group =                                                   \
+          LOOKUP_HASH_POSITION(hval, num_probes, num_groups) *                 \
+          CTRL_GROUP_WIDTH;                                                    \
+      for (uint64_t match = ctrl_group_match(ctrl + group, fragment);          \
+           match != 0; match &= match - 1) {                                   \
+        name##Entry *entry = table + group + CTRL_MASK_INDEX(match);           \
+        if (entry->hash_value == hval &&                                       \
+            ENTRY_MATCHES_##size_mode(entry, value, value_size, compare_fn)) { \
+          entry->value = value;                                                \
+          return false;                                                        \
+        }                                                                      \
+      }                                                                        \
+      /* Reuse the first removed slot if the value is not present. */          \
+      if (first_vacant < 0) {                                                  \
+        const uint64_t vacant = ctrl_group_match_vacant(ctrl + group);         \
+        if (vacant != 0) {                                                     \
+          first_vacant = group + CTRL_MASK_INDEX(vacant);                      \
+        }                                                                      \
+      }                                                                        \
+      if (ctrl_group_match_empty(ctrl + group) != 0) {                         \
+        name##_fill_slot(table, table_size, (uint32_t)first_vacant, value,     \
+                         value_size, hval);                                    \
+        return true;                                                           \
+      }                                                                        \
+      /* Returns early if removed slots make probing slow so the table can be  \
+       * rehashed. */                                                          \
+      if ((int)num_probes >= MAX_PROBES_THRESHOLD(num_groups)) {               \
+        break;                                                                 \
+      }                                                                        \
+    }                                                                          \
+    *probe_limit_exceeded = true;                                              \
+    return false;                                                              \
+  }                                                                            \
+                                                                               \
+  static void name##_resize_table(name *hash_set, uint32_t new_table_size) {   \
+    name##Entry *new_table = name##_allocate_table(new_table_size);            \
+    const int8_t *ctrl =                                                       \
+        CTRL_BYTES(hash_set->table, hash_set->table_size);                     \
+    for (uint32_t i = 0; i < hash_set->table_size; ++i) {                      \
+      if (IS_CTRL_FULL(ctrl[i])) {                                             \
+        const name##Entry *entry = hash_set->table + i;                        \
+        name##_insert_unique(new_table, new_table_size, entry->value,          \
+                             ENTRY_SIZE_##size_mode(entry, 0),                 \
+                             entry->hash_value);                               \
+      }                                                                        \
+    }                                                                          \
+    name##_publish_table(hash_set, new_table, new_table_size);                 \
+  }                                                                            \
+                                                                               \
+  static name##Entry *name##_find_entry(                                       \
+      const name *hash_set, const value_type value, uint32_t value_size,       \
+      uint32_t hval, name##Entry *table, uint32_t table_size) {                \
+    const int8_t *ctrl = CTRL_BYTES(table, table_size);                        \
+    const int8_t fragment = CTRL_FRAGMENT(hval);                               \
+    const uint32_t num_groups = table_size / CTRL_GROUP_WIDTH;                 \
+    for (uint32_t num_probes = 0; num_probes < num_groups; ++num_probes) {     \
+      const uint32_t group =                                                   \
+          LOOKUP_HASH_POSITION(hval, num_probes, num_groups) *                 \
+          CTRL_GROUP_WIDTH;                                                    \
+      for (uint64_t match = ctrl_group_match(ctrl + group, fragment);          \
+           match != 0; match &= match - 1) {                                   \
+        name##Entry *entry = table + group + CTRL_MASK_INDEX(match);           \
+        if (entry->hash_value == hval &&                                       \
+            ENTRY_MATCHES_##size_mode(entry, value, value_size, compare_fn)) { \
+          HASH_SET_COUNT_LOOKUP(hash_set, true, num_probes + 1);               \
+          return entry;                                                        \
+        }                                                                      \
+      }                                                                        \
+      if (ctrl_group_match_empty(ctrl + group) != 0) {                         \
+        HASH_SET_COUNT_LOOKUP(hash_set, false, num_probes + 1);                \
+        return NULL;                                                           \
+      }                                                                        \
+    }                                                                          \
+    HASH_SET_COUNT_LOOKUP(hash_set, false, num_groups);                        \
+    return NULL;                                                               \
+  }                                                                            \
+                                                                               \
+  /* Prefetches the first group probed for hval. */                            \
+  static inline void name##_prefetch(const name *hash_set, uint32_t hval) {    \
+    if (hash_set->table == NULL) {                                             \
+      return;                                                                  \
+    }                                                                          \
+    const uint32_t group =                                                     \
+        LOOKUP_HASH_POSITION(hval, 0,                                          \
+                             hash_set->table_size / CTRL_GROUP_WIDTH) *        \
+        CTRL_GROUP_WIDTH;                                                      \
+    PREFETCH(CTRL_BYTES(hash_set->table, hash_set->table_size) + group);       \
+    PREFETCH(hash_set->table + group);                                         \
+  }                                                                            \
+                                                                               \
+  static void name##_erase_entry(name *hash_set, name##Entry *table,           \
+                                 uint32_t table_size, name##Entry *entry) {    \
+    const uint32_t position = (uint32_t)(entry - table);                       \
+    int8_t *ctrl = CTRL_BYTES(table, table_size);                              \
+    /* No probe has passed a group that still has an empty slot, so the slot   \
+     * can be made empty again instead of deleted. */                          \
+    const uint32_t group = position - position % CTRL_GROUP_WIDTH;             \
+    ctrl[position] =                                                           \
+        ctrl_group_match_empty(ctrl + group) != 0 ? CTRL_EMPTY : CTRL_DELETED; \
+  }                                                                            \
+                                                                               \
+  /* Moves the value in slot position of table, if any, into the current       \
+   * table, which does not hold it yet. */                                     \
+  static inline void name##_migrate_slot(name *hash_set, name##Entry *table,   \
+                                         uint32_t table_size,                  \
+                                         uint32_t position) {                  \
+    if (!IS_CTRL_FULL(CTRL_BYTES(table, table_size)[position])) {              \
+      return;                                                                  \
+    }                                                                          \
+    name##Entry *entry = table + position;                                     \
+    name##_insert_unique(hash_set->table, hash_set->table_size, entry->value,  \
+                         ENTRY_SIZE_##size_mode(entry, 0), entry->hash_value); \
+    name##_erase_entry(hash_set, table, table_size, entry);                    \
+  }                                                                            \
+                                                                               \
+  /* Probes table for value while at most one writer modifies the set.         \
+   * Returns false if a writer started since seq was read. Otherwise sets      \
+   * *found, and *result if value was found. */                                \
+  static bool name##_probe_concurrent(                                         \
+      const name *hash_set, uint32_t seq, const name##Entry *table,            \
+      uint32_t table_size, const value_type value, uint32_t value_size,        \
+      uint32_t hval, value_type *result, bool *found) {                        \
+    const int8_t *ctrl = CTRL_BYTES(table, table_size);                        \
+    const int8_t fragment = CTRL_FRAGMENT(hval);                               \
+    const uint32_t num_groups = table_size / CTRL_GROUP_WIDTH;                 \
+    uint32_t num_probes = 0;                                                   \
+    while (num_probes < num_groups) {                                          \
+      const uint32_t group =                                                   \
+          LOOKUP_HASH_POSITION(hval, num_probes, num_groups) *                 \
+          CTRL_GROUP_WIDTH;                                                    \
+      ++num_probes;                                                            \
+      for (uint64_t match = ctrl_group_match(ctrl + group, fragment);          \
+           match != 0; match &= match - 1) {                                   \
+        const name##Entry *entry = table + group + CTRL_MASK_INDEX(match);     \
+        if (entry->hash_value != hval) {                                       \
+          continue;                                                            \
+        }                                                                      \
+        const name##Entry candidate = *entry;                                  \
+        /* The copy may be torn by a writer, so check before dereferencing. */ \
+        if (!name##_validate_read(hash_set, seq)) {                            \
+          return false;                                                        \
+        }                                                                      \
+        if (ENTRY_MATCHES_##size_mode(&candidate, value, value_size,           \
+                                      compare_fn)) {                           \
+          HASH_SET_COUNT_LOOKUP(hash_set, true, num_probes);                   \
+          *result = candidate.value;                                           \
+          *found = true;                                                       \
+          return true;                                                         \
+        }                                                                      \
+      }                                                                        \
+      if (ctrl_group_match_empty(ctrl + group) != 0) {                         \
+        break;                                                                 \
+      }                                                                        \
+    }                                                                          \
+    if (!name##_validate_read(hash_set, seq)) {                                \
+      return false;                                                            \
+    }                                                                          \
+    HASH_SET_COUNT_LOOKUP(hash_set, false, num_probes);                        \
+    *found = false;                                                            \
+    return true;                                                               \
+  }                                                                            \
+                                                                               \
+  static uint32_t name##_count_tombstones(const name *hash_set) {              \
+    const int8_t *ctrl = CTRL_BYTES(hash_set->table, hash_set->table_size);    \
+    uint32_t num_tombstones = 0;                                               \
+    for (uint32_t i = 0; i < hash_set->table_size; ++i) {                      \
+      num_tombstones += ctrl[i] == CTRL_DELETED;                               \
+    }                                                                          \
+    return num_tombstones;                                                     \
+  }
+#else
+#if defined(HASH_SET_NO_INSERTION_ORDER)
+// Expands to insertion-order helpers that keep no list. Entries are visited in
+// table order.
+#define IMPL_HASH_SET_INSERTION_ORDER(name)                                   \
+                                                                              \
+  static inline void name##_link_entry(name *hash_set, name##Entry *entry) {} \
+                                                                              \
+  static inline void name##_unlink_entry(name *hash_set,                      \
+                                         name##Entry *entry) {}               \
+                                                                              \
+  /* Returns the occupied entry after entry (or the first if NULL). */        \
+  static name##Entry *name##_next_entry(const name *hash_set,                 \
+                                        name##Entry *entry) {                 \
+    name##Entry *end = hash_set->table + hash_set->table_size;                \
+    for (entry = entry == NULL ? hash_set->table : entry + 1; entry < end;    \
+         ++entry) {                                                           \
+      if (entry->num_probes > 0) {                                            \
+        return entry;                                                         \
+      }                                                                       \
+    }                                                                         \
+    return NULL;                                                              \
+  }
+#else
+// Expands to helpers maintaining the list of entries in insertion order.
+#define IMPL_HASH_SET_INSERTION_ORDER(name)                                    \
+                                                                               \
+  static inline void name##_link_entry(name *hash_set, name##Entry *entry) {   \
+    entry->prev = hash_set->last;                                              \
+    entry->next = NULL;                                                        \
+    if (hash_set->last != NULL) {                                              \
+      hash_set->last->next = entry;                                            \
+    }                                                                          \
+    hash_set->last = entry;                                                    \
+    if (hash_set->first == NULL) {                                             \
+      hash_set->first = entry;                                                 \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  static inline void name##_unlink_entry(name *hash_set, name##Entry *entry) { \
+    if (hash_set->last == entry) {                                             \
+      hash_set->last = entry->prev;                                            \
+    } else {                                                                   \
+      entry->next->prev = entry->prev;                                         \
+    }                                                                          \
+    if (hash_set->first == entry) {                                            \
+      hash_set->first = entry->next;                                           \
+    } else {                                                                   \
+      entry->prev->next = entry->next;                                         \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  /* Returns the entry inserted after entry (or the first if NULL). */         \
+  static name##Entry *name##_next_entry(const name *hash_set,                  \
+                                        name##Entry *entry) {                  \
+    return entry == NULL ? hash_set->first : entry->next;                      \
+  }
+#endif
+
+// Expands to the table layout used by IMPL_HASH_SET_INLINE.
+//
+// Entries are kept in a single array and, unless HASH_SET_NO_INSERTION_ORDER is
+// defined, threaded onto a list in insertion order. Collisions are resolved
+// with Robin Hood displacement.
+#define IMPL_HASH_SET_LAYOUT(name, value_type, hash_fn, compare_fn, size_mode) \
+                                                                               \
+  struct name##Entry_ {                                                        \
+    value_type value;                                                          \
+    ENTRY_SIZE_FIELD_##size_mode                                               \
+    uint32_t hash_value;                                                       \
+    int32_t num_probes;                                                        \
+    INSERTION_ORDER_LINKS(name)                                                \
+  };                                                                           \
+                                                                               \
+  static name##Entry *name##_allocate_table(uint32_t table_size) {             \
+    return (name##Entry *)calloc(sizeof(name##Entry), table_size);             \
+  }                                                                            \
+                                                                               \
+  IMPL_HASH_SET_INSERTION_ORDER(name)                                          \
+                                                                               \
+  /* Continues probing for value from probe num_probes on. */                  \
+  static name##Entry *name##_find_entry_from(                                  \
+      const name *hash_set, const value_type value, uint32_t value_size,       \
+      uint32_t hval, name##Entry *table, uint32_t table_size,                  \
+      int num_probes) {                                                        \
+    while (true) {                                                             \
+      name##Entry *entry =                                                     \
+          table + LOOKUP_HASH_POSITION(hval, num_probes, table_size);          \
+      ++num_probes;                                                            \
+      if (IS_EMPTY(entry)) {                                                   \
+        return NULL;                                                           \
+      }                                                                        \
+      if (!IS_TOMBSTONE(entry) && hval == entry->hash_value &&                 \
+          ENTRY_MATCHES_##size_mode(entry, value, value_size, compare_fn)) {   \
+        return entry;                                                          \
+      }                                                                        \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  /* Returns the previously vacant entry that was filled, or NULL if value was \
+   * already present or the probe limit was exceeded. */                       \
+  static name##Entry *name##_attempt_insert_robin_hood(                        \
+      name *hash_set, value_type value, uint32_t value_size, uint32_t hval,    \
+      name##Entry *table, uint32_t table_size, bool *probe_limit_exceeded) {   \
     int num_probes = 0;                                                        \
     int num_tombstones_encountered = 0;                                        \
     name##Entry *first_empty = NULL;                                           \
     int num_probes_at_first_empty = -1;                                        \
+    bool displaced = false;                                                    \
     while (true) {                                                             \
       const int hash_position =                                                \
           LOOKUP_HASH_POSITION(hval, num_probes, table_size);                  \
@@ -137,19 +875,10 @@
         }                                                                      \
         /* Take the vacant spot. */                                            \
         entry->value = (value_type)value;                                      \
-        entry->value_size = value_size;                                        \
+        SET_ENTRY_SIZE_##size_mode(entry, value, value_size);                  \
         entry->hash_value = hval;                                              \
         entry->num_probes = num_probes;                                        \
-        entry->prev = *last;                                                   \
-        entry->next = NULL;                                                    \
-        if (*last != NULL) {                                                   \
-          entry->prev->next = entry;                                           \
-        }                                                                      \
-        *last = entry;                                                         \
-        if (*first == NULL) {                                                  \
-          *first = entry;                                                      \
-        }                                                                      \
-        return true;                                                           \
+        return entry;                                                          \
       }                                                                        \
       /* Spot is vacant but previously used, mark it so we can use it later.   \
        */                                                                      \
@@ -159,7 +888,7 @@
          * table can be rehashed. */                                           \
         if (num_tombstones_encountered > MAX_PROBES_THRESHOLD(table_size)) {   \
           *probe_limit_exceeded = true;                                        \
-          return false;                                                        \
+          return NULL;                                                         \
         }                                                                      \
         if (first_empty == NULL) {                                             \
           first_empty = entry;                                                 \
@@ -170,23 +899,35 @@
       /* Pair is already present in the table, so the mission is accomplished. \
        */                                                                      \
       if (hval == entry->hash_value) {                                         \
-        if (hash_set->compare(value, value_size, entry->value,                 \
-                              entry->value_size) == 0) {                       \
+        if (ENTRY_MATCHES_##size_mode(entry, value, value_size,                \
+                                      compare_fn)) {                           \
           entry->value = (value_type)value;                                    \
-          return false;                                                        \
+          return NULL;                                                         \
         }                                                                      \
       }                                                                        \
       /* Rob this entry if it did fewer probes. */                             \
       if (entry->num_probes < num_probes) {                                    \
+        /* Entries placed in reused tombstones may have fewer probes than      \
+         * entries after them, so value may still be further along. */         \
+        if (!displaced) {                                                      \
+          name##Entry *existing =                                              \
+              name##_find_entry_from(hash_set, value, value_size, hval,        \
+                                     table, table_size, num_probes);           \
+          if (existing != NULL) {                                              \
+            existing->value = (value_type)value;                               \
+            return NULL;                                                       \
+          }                                                                    \
+          displaced = true;                                                    \
+        }                                                                      \
         name##Entry tmp_entry = *entry;                                        \
         /* Take its spot. */                                                   \
         entry->value = (value_type)value;                                      \
-        entry->value_size = value_size;                                        \
+        SET_ENTRY_SIZE_##size_mode(entry, value, value_size);                  \
         entry->hash_value = hval;                                              \
         entry->num_probes = num_probes;                                        \
         /* It is the new insertion. */                                         \
         value = tmp_entry.value;                                               \
-        value_size = tmp_entry.value_size;                                     \
+        value_size = ENTRY_SIZE_##size_mode(&tmp_entry, value_size);           \
         hval = tmp_entry.hash_value;                                           \
         num_probes = tmp_entry.num_probes;                                     \
         first_empty = NULL;                                                    \
@@ -195,32 +936,418 @@
     }                                                                          \
   }                                                                            \
                                                                                \
-  static void name##_resize_table(name *hash_set) {                            \
-    const uint32_t new_table_size =                                            \
-        CALCULATE_NEW_TABLE_SIZE(hash_set->table_size);                        \
-    name##Entry *new_table =                                                   \
-        (name##Entry *)calloc(sizeof(name##Entry), new_table_size);            \
-    name##Entry *new_first = NULL;                                             \
-    name##Entry *new_last = NULL;                                              \
+  static bool name##_attempt_insert_internal(                                  \
+      name *hash_set, value_type value, uint32_t value_size, uint32_t hval,    \
+      name##Entry *table, uint32_t table_size, bool *probe_limit_exceeded) {   \
+    name##Entry *entry = name##_attempt_insert_robin_hood(                     \
+        hash_set, value, value_size, hval, table, table_size,                  \
+        probe_limit_exceeded);                                                 \
+    if (entry == NULL) {                                                       \
+      return false;                                                            \
+    }                                                                          \
+    name##_link_entry(hash_set, entry);                                        \
+    return true;                                                               \
+  }                                                                            \
                                                                                \
-    for (name##Entry *entry = hash_set->first; entry != NULL;                  \
-         entry = entry->next) {                                                \
+  static void name##_resize_table(name *hash_set, uint32_t new_table_size) {   \
+    name##Entry *new_table = name##_allocate_table(new_table_size);            \
+                                                                               \
+    /* Entries are relinked as they are moved into new_table. */               \
+    name##Entry *entry = name##_next_entry(hash_set, NULL);                    \
+    RESET_INSERTION_ORDER(hash_set);                                           \
+    for (; entry != NULL; entry = name##_next_entry(hash_set, entry)) {        \
       bool probe_limit_exceeded = false;                                       \
-      name##_attempt_insert_internal(hash_set, entry->value,                   \
-                                     entry->value_size, entry->hash_value,     \
-                                     new_table, new_table_size, &new_first,    \
-                                     &new_last, &probe_limit_exceeded);        \
+      name##_attempt_insert_internal(                                          \
+          hash_set, entry->value, ENTRY_SIZE_##size_mode(entry, 0),            \
+          entry->hash_value, new_table, new_table_size,                        \
+          &probe_limit_exceeded);                                              \
       if (probe_limit_exceeded) {                                              \
         /* Should never happen */                                              \
       }                                                                        \
     }                                                                          \
                                                                                \
-    free(hash_set->table);                                                     \
-    hash_set->table = new_table;                                               \
-    hash_set->table_size = new_table_size;                                     \
-    hash_set->first = new_first;                                               \
-    hash_set->last = new_last;                                                 \
+    name##_publish_table(hash_set, new_table, new_table_size);                 \
+  }                                                                            \
+                                                                               \
+  static name##Entry *name##_find_entry(                                       \
+      const name *hash_set, const value_type value, uint32_t value_size,       \
+      uint32_t hval, name##Entry *table, uint32_t table_size) {                \
+    int num_probes = 0;                                                        \
+    while (true) {                                                             \
+      int table_index = LOOKUP_HASH_POSITION(hval, num_probes, table_size);    \
+      ++num_probes;                                                            \
+      name##Entry *entry = table + table_index;                                \
+      if (IS_EMPTY(entry)) {                                                   \
+        HASH_SET_COUNT_LOOKUP(hash_set, false, num_probes);                    \
+        return NULL;                                                           \
+      }                                                                        \
+      if (IS_TOMBSTONE(entry)) {                                               \
+        continue;                                                              \
+      }                                                                        \
+      if (hval == entry->hash_value) {                                         \
+        if (ENTRY_MATCHES_##size_mode(entry, value, value_size,                \
+                                      compare_fn)) {                           \
+          HASH_SET_COUNT_LOOKUP(hash_set, true, num_probes);                   \
+          return entry;                                                        \
+        }                                                                      \
+      }                                                                        \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  /* Prefetches the first entry probed for hval. */                            \
+  static inline void name##_prefetch(const name *hash_set, uint32_t hval) {    \
+    if (hash_set->table == NULL) {                                             \
+      return;                                                                  \
+    }                                                                          \
+    PREFETCH(hash_set->table +                                                 \
+             LOOKUP_HASH_POSITION(hval, 0, hash_set->table_size));             \
+  }                                                                            \
+                                                                               \
+  static void name##_erase_entry(name *hash_set, name##Entry *table,           \
+                                 uint32_t table_size, name##Entry *entry) {    \
+    name##_unlink_entry(hash_set, entry);                                      \
+    entry->num_probes = TOMBSTONE;                                             \
+  }                                                                            \
+                                                                               \
+  /* Moves the value in slot position of table, if any, into the current       \
+   * table, which does not hold it yet. The slot becomes a tombstone so that   \
+   * probes for the values left in table still pass it. */                     \
+  static inline void name##_migrate_slot(name *hash_set, name##Entry *table,   \
+                                         uint32_t table_size,                  \
+                                         uint32_t position) {                  \
+    name##Entry *entry = table + position;                                     \
+    if (entry->num_probes <= 0) {                                              \
+      return;                                                                  \
+    }                                                                          \
+    bool probe_limit_exceeded = false;                                         \
+    name##_attempt_insert_internal(                                            \
+        hash_set, entry->value, ENTRY_SIZE_##size_mode(entry, 0),              \
+        entry->hash_value, hash_set->table, hash_set->table_size,              \
+        &probe_limit_exceeded);                                                \
+    name##_erase_entry(hash_set, table, table_size, entry);                    \
+  }                                                                            \
+                                                                               \
+  /* Probes table for value while at most one writer modifies the set.         \
+   * Returns false if a writer started since seq was read. Otherwise sets      \
+   * *found, and *result if value was found. */                                \
+  static bool name##_probe_concurrent(                                         \
+      const name *hash_set, uint32_t seq, const name##Entry *table,            \
+      uint32_t table_size, const value_type value, uint32_t value_size,        \
+      uint32_t hval, value_type *result, bool *found) {                        \
+    uint32_t num_probes = 0;                                                   \
+    while (num_probes < table_size) {                                          \
+      const name##Entry *entry =                                               \
+          table + LOOKUP_HASH_POSITION(hval, num_probes, table_size);          \
+      ++num_probes;                                                            \
+      const int32_t entry_num_probes = entry->num_probes;                      \
+      if (entry_num_probes == 0) {                                             \
+        break;                                                                 \
+      }                                                                        \
+      if (entry_num_probes == TOMBSTONE || entry->hash_value != hval) {        \
+        continue;                                                              \
+      }                                                                        \
+      const name##Entry candidate = *entry;                                    \
+      /* The copy may be torn by a writer, so check before dereferencing. */   \
+      if (!name##_validate_read(hash_set, seq)) {                              \
+        return false;                                                          \
+      }                                                                        \
+      if (ENTRY_MATCHES_##size_mode(&candidate, value, value_size,             \
+                                    compare_fn)) {                             \
+        HASH_SET_COUNT_LOOKUP(hash_set, true, num_probes);                     \
+        *result = candidate.value;                                             \
+        *found = true;                                                         \
+        return true;                                                           \
+      }                                                                        \
+    }                                                                          \
+    if (!name##_validate_read(hash_set, seq)) {                                \
+      return false;                                                            \
+    }                                                                          \
+    HASH_SET_COUNT_LOOKUP(hash_set, false, num_probes);                        \
+    *found = false;                                                            \
+    return true;                                                               \
+  }                                                                            \
+                                                                               \
+  static uint32_t name##_count_tombstones(const name *hash_set) {              \
+    uint32_t num_tombstones = 0;                                               \
+    for (uint32_t i = 0; i < hash_set->table_size; ++i) {                      \
+      num_tombstones += IS_TOMBSTONE(hash_set->table + i);                     \
+    }                                                                          \
+    return num_tombstones;                                                     \
+  }
+#endif
+
+#if defined(HASH_SET_INCREMENTAL_RESIZE)
+// Expands to resizing that leaves the values in the previous table, from which
+// every write migrates HASH_SET_MIGRATION_SLOTS_PER_WRITE slots. No single
+// write rehashes the whole set, so write latency stays flat as the set grows.
+#define IMPL_HASH_SET_RESIZE(name)                                            \
+                                                                              \
+  /* Returns the table still being migrated, or NULL. */                      \
+  static inline name##Entry *name##_migrating_table(const name *hash_set,     \
+                                                    uint32_t *table_size) {   \
+    *table_size = ATOMIC_LOAD_ACQUIRE(&hash_set->old_table_size);             \
+    return *table_size == 0 ? NULL                                            \
+                            : ATOMIC_LOAD_RELAXED(&hash_set->old_table);      \
+  }                                                                           \
+                                                                              \
+  /* Migrates up to num_slots slots of the previous table, releasing it once  \
+   * every slot has been migrated. */                                         \
+  static void name##_migrate(name *hash_set, uint32_t num_slots) {            \
+    name##Entry *old_table = hash_set->old_table;                             \
+    if (old_table == NULL) {                                                  \
+      return;                                                                 \
+    }                                                                         \
+    const uint32_t old_table_size = hash_set->old_table_size;                 \
+    const uint32_t end =                                                      \
+        old_table_size - hash_set->migrate_position > num_slots               \
+            ? hash_set->migrate_position + num_slots                          \
+            : old_table_size;                                                 \
+    for (; hash_set->migrate_position < end; ++hash_set->migrate_position) {  \
+      name##_migrate_slot(hash_set, old_table, old_table_size,                \
+                          hash_set->migrate_position);                        \
+    }                                                                         \
+    if (end == old_table_size) {                                              \
+      RESET_INCREMENTAL_RESIZE(hash_set);                                     \
+      name##_retire_table(hash_set, old_table);                               \
+    }                                                                         \
+  }                                                                           \
+                                                                              \
+  static inline void name##_migrate_step(name *hash_set) {                    \
+    name##_migrate(hash_set, HASH_SET_MIGRATION_SLOTS_PER_WRITE);             \
+  }                                                                           \
+                                                                              \
+  static inline void name##_finish_migration(name *hash_set) {                \
+    name##_migrate(hash_set, hash_set->old_table_size);                       \
+  }                                                                           \
+                                                                              \
+  /* Switches to an empty table of the next size, finishing a resize still in \
+   * progress first. */                                                       \
+  static void name##_grow(name *hash_set) {                                   \
+    name##_finish_migration(hash_set);                                        \
+    const uint32_t new_table_size =                                           \
+        CALCULATE_NEW_TABLE_SIZE(hash_set->table_size);                       \
+    ATOMIC_STORE_RELAXED(&hash_set->old_table, hash_set->table);              \
+    ATOMIC_STORE_RELEASE(&hash_set->old_table_size, hash_set->table_size);    \
+    /* Readers load table_size first, so they never pair the larger size with \
+     * the old table. */                                                      \
+    ATOMIC_STORE_RELAXED(&hash_set->table,                                    \
+                         name##_allocate_table(new_table_size));              \
+    ATOMIC_STORE_RELEASE(&hash_set->table_size, new_table_size);              \
+    hash_set->resize_threshold = CALCULATE_RESIZE_THRESHOLD(new_table_size);  \
+    hash_set->num_erased = 0;                                                 \
+    HASH_SET_COUNT(hash_set, RESIZES, 1);                                     \
+  }
+#else
+// Expands to resizing that rehashes every value into the new table at once.
+#define IMPL_HASH_SET_RESIZE(name)                                          \
+                                                                            \
+  static inline name##Entry *name##_migrating_table(const name *hash_set,   \
+                                                    uint32_t *table_size) { \
+    *table_size = 0;                                                        \
+    return NULL;                                                            \
+  }                                                                         \
+                                                                            \
+  static inline void name##_migrate_step(name *hash_set) {}                 \
+                                                                            \
+  static inline void name##_finish_migration(name *hash_set) {}             \
+                                                                            \
+  static inline void name##_grow(name *hash_set) {                          \
+    name##_resize_table(hash_set,                                           \
+                        CALCULATE_NEW_TABLE_SIZE(hash_set->table_size));    \
+  }
+#endif
+
+// Expands to the impleemtation for a hash set with the given name and value
+// type.
+//
+// Generates the following for name=CatHashSet and value_type=Cat:
+//
+//   void CatHashSet_init(CatHashSet*, uint32_t start_size, CatHashSetHashFn,
+//                        CatHashSetCompareFn) { ... }
+//   CatHashSet* CatHashSet_create(uint32_t start_size, CatHashSetHashFn,
+//                                 CatHashSetCompareFn) { ... }
+//   void CatHashSet_finalize(CatHashSet*) { ... }
+//   void CatHashSet_delete(CatHashSet*) { ... }
+//   void CatHashSet_reserve(CatHashSet*, uint32_t num_values) { ... }
+//   bool CatHashSet_insert(CatHashSet*, const Cat, uint32_t value_size) { ... }
+//   bool CatHashSet_remove(CatHashSet*, const Cat, uint32_t value_size) { ... }
+//   bool CatHashSet_contains(CatHashSet*, const Cat, uint32_t) { ... }
+//   Cat CatHashSet_find(CatHashSet*, const Cat, uint32_t value_size) { ... }
+//   bool CatHashSet_insert_prehashed(CatHashSet*, const Cat, uint32_t,
+//                                    uint32_t hash) { ... }
+//   Cat CatHashSet_find_prehashed(CatHashSet*, const Cat, uint32_t,
+//                                 uint32_t hash, Cat default_value) { ... }
+//   uint32_t CatHashSet_size(CatHashSet*) { ... }
+//   void CatHashSet_clear(CatHashSet*) { ... }
+//   void CatHashSet_enable_concurrent_reads(CatHashSet*) { ... }
+//   bool CatHashSet_try_find_concurrent(const CatHashSet*, const Cat, uint32_t,
+//                                       Cat default_value, Cat *result) { ... }
+#define IMPL_HASH_SET(name, value_type) \
+  IMPL_HASH_SET_INLINE(name, value_type, hash_set->hash, hash_set->compare)
+
+// Expands to the same implementation as IMPL_HASH_SET, except that hash_fn and
+// compare_fn are called directly instead of through the function pointers
+// passed to name##_init (which may then be NULL). Probe loops can inline both
+// calls, so hash_fn and compare_fn should be defined (e.g. static inline) in
+// the translation unit expanding this macro.
+#define IMPL_HASH_SET_INLINE(name, value_type, hash_fn, compare_fn) \
+  IMPL_HASH_SET_SIZE_MODE(name, value_type, hash_fn, compare_fn, SIZED)
+
+// Like IMPL_HASH_SET_INLINE, for sets whose values all have the same size.
+// Entries do not store sizes, which saves 4 bytes per slot where they are not
+// padding, so hash_fn and compare_fn must ignore their size arguments.
+#define IMPL_HASH_SET_FIXED(name, value_type, hash_fn, compare_fn) \
+  IMPL_HASH_SET_SIZE_MODE(name, value_type, hash_fn, compare_fn, UNSIZED)
+
+// Like IMPL_HASH_SET_INLINE, for sets of pointers to values that are equal
+// exactly when their sizes and bytes are, such as strings. Slots also hold a
+// copy of values of up to SMALL_VALUE_MAX_SIZE bytes, and such values are
+// compared there instead of calling compare_fn, so probes for them never read
+// the values pointed to. This adds 8 bytes to each slot.
+#define IMPL_HASH_SET_SMALL_VALUES(name, value_type, hash_fn, compare_fn) \
+  IMPL_HASH_SET_SIZE_MODE(name, value_type, hash_fn, compare_fn, SIZED_SMALL)
+
+// Implementation shared by IMPL_HASH_SET_INLINE, IMPL_HASH_SET_FIXED and
+// IMPL_HASH_SET_SMALL_VALUES. See ENTRY_SIZE_FIELD_SIZED for size_mode.
+#define IMPL_HASH_SET_SIZE_MODE(name, value_type, hash_fn, compare_fn,         \
+                                size_mode)                                     \
+                                                                               \
+  static inline uint32_t name##_hash(const name *hash_set,                     \
+                                     const value_type value,                   \
+                                     uint32_t value_size) {                    \
+    return MIX_HASH(hash_fn(value, value_size));                               \
+  }                                                                            \
+                                                                               \
+  /* Marks the start of a modification for concurrent readers. */              \
+  static void name##_begin_write(name *hash_set) {                             \
+    ATOMIC_STORE_RELAXED(&hash_set->seq, hash_set->seq + 1);                   \
+    ATOMIC_FENCE_RELEASE();                                                    \
+  }                                                                            \
+                                                                               \
+  static void name##_end_write(name *hash_set) {                               \
+    ATOMIC_STORE_RELEASE(&hash_set->seq, hash_set->seq + 1);                   \
+  }                                                                            \
+                                                                               \
+  /* True if no writer has started since seq was read. */                      \
+  static bool name##_validate_read(const name *hash_set, uint32_t seq) {       \
+    ATOMIC_FENCE_ACQUIRE();                                                    \
+    return ATOMIC_LOAD_RELAXED(&hash_set->seq) == seq;                         \
+  }                                                                            \
+                                                                               \
+  /* Changes whenever a writer starts or finishes modifying the set. A miss    \
+   * observed after reading it still holds while it is unchanged and even. */  \
+  static inline uint32_t name##_write_seq(const name *hash_set) {              \
+    return ATOMIC_LOAD_ACQUIRE(&hash_set->seq);                                \
+  }                                                                            \
+                                                                               \
+  /* Frees a table that is no longer reachable, once concurrent readers are    \
+   * done with it. */                                                          \
+  static void name##_retire_table(name *hash_set, name##Entry *table) {        \
+    if (hash_set->concurrent_reads) {                                          \
+      epoch_retire(hash_set, table);                                           \
+    } else {                                                                   \
+      free(table);                                                             \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  /* Replaces the table with a fully populated new_table. */                   \
+  static void name##_publish_table(name *hash_set, name##Entry *new_table,     \
+                                   uint32_t new_table_size) {                  \
+    name##Entry *old_table = hash_set->table;                                  \
+    /* Readers load table_size first, so they never pair the larger size with  \
+     * the old table. */                                                       \
+    ATOMIC_STORE_RELAXED(&hash_set->table, new_table);                         \
+    ATOMIC_STORE_RELEASE(&hash_set->table_size, new_table_size);               \
+    name##_retire_table(hash_set, old_table);                                  \
     hash_set->resize_threshold = CALCULATE_RESIZE_THRESHOLD(new_table_size);   \
+    hash_set->num_erased = 0;                                                  \
+    HASH_SET_COUNT(hash_set, RESIZES, 1);                                      \
+  }                                                                            \
+                                                                               \
+  IMPL_HASH_SET_LAYOUT(name, value_type, hash_fn, compare_fn, size_mode)       \
+                                                                               \
+  IMPL_HASH_SET_RESIZE(name)                                                   \
+                                                                               \
+  /* Finds the entry holding value given its table hash, also checking the     \
+   * table being migrated while a resize is in progress. Sets *table and       \
+   * *table_size to those of the table searched last. */                       \
+  static name##Entry *name##_find_entry_hashed(                                \
+      const name *hash_set, const value_type value, uint32_t value_size,       \
+      uint32_t hval, name##Entry **table, uint32_t *table_size) {              \
+    *table = hash_set->table;                                                  \
+    *table_size = hash_set->table_size;                                        \
+    if (*table == NULL) {                                                      \
+      HASH_SET_COUNT_LOOKUP(hash_set, false, 0);                               \
+      return NULL;                                                             \
+    }                                                                          \
+    name##Entry *entry = name##_find_entry(hash_set, value, value_size, hval,  \
+                                           *table, *table_size);               \
+    if (entry == NULL) {                                                       \
+      *table = name##_migrating_table(hash_set, table_size);                   \
+      if (*table != NULL) {                                                    \
+        entry = name##_find_entry(hash_set, value, value_size, hval, *table,   \
+                                  *table_size);                                \
+      }                                                                        \
+    }                                                                          \
+    return entry;                                                              \
+  }                                                                            \
+                                                                               \
+  /* Inserts value into the table unless it is already present in either       \
+   * table, in which case the stored value is replaced. */                     \
+  static bool name##_attempt_insert(name *hash_set, value_type value,          \
+                                    uint32_t value_size, uint32_t hval,        \
+                                    bool *probe_limit_exceeded) {              \
+    uint32_t migrating_table_size;                                             \
+    name##Entry *migrating_table =                                             \
+        name##_migrating_table(hash_set, &migrating_table_size);               \
+    if (migrating_table != NULL) {                                             \
+      name##Entry *entry =                                                     \
+          name##_find_entry(hash_set, value, value_size, hval,                 \
+                            migrating_table, migrating_table_size);            \
+      if (entry != NULL) {                                                     \
+        entry->value = value;                                                  \
+        return false;                                                          \
+      }                                                                        \
+    }                                                                          \
+    return name##_attempt_insert_internal(hash_set, value, value_size, hval,   \
+                                          hash_set->table,                     \
+                                          hash_set->table_size,                \
+                                          probe_limit_exceeded);               \
+  }                                                                            \
+                                                                               \
+  /* Like name_try_find_concurrent, given the table hash of value. */          \
+  static bool name##_try_find_concurrent_hashed(                               \
+      const name *hash_set, const value_type value, uint32_t value_size,       \
+      uint32_t hval, value_type default_value, value_type *result) {           \
+    *result = default_value;                                                   \
+    const uint32_t seq = ATOMIC_LOAD_ACQUIRE(&hash_set->seq);                  \
+    if (seq & 1) {                                                             \
+      return false;                                                            \
+    }                                                                          \
+    const uint32_t table_size = ATOMIC_LOAD_ACQUIRE(&hash_set->table_size);    \
+    const name##Entry *table = ATOMIC_LOAD_RELAXED(&hash_set->table);          \
+    if (table == NULL) {                                                       \
+      if (!name##_validate_read(hash_set, seq)) {                              \
+        return false;                                                          \
+      }                                                                        \
+      HASH_SET_COUNT_LOOKUP(hash_set, false, 0);                               \
+      return true;                                                             \
+    }                                                                          \
+    /* Loaded before probing, so the final validation covers it too. */        \
+    uint32_t migrating_table_size;                                             \
+    const name##Entry *migrating_table =                                       \
+        name##_migrating_table(hash_set, &migrating_table_size);               \
+    bool found = false;                                                        \
+    if (!name##_probe_concurrent(hash_set, seq, table, table_size, value,      \
+                                 value_size, hval, result, &found)) {          \
+      return false;                                                            \
+    }                                                                          \
+    if (found || migrating_table == NULL) {                                    \
+      return true;                                                             \
+    }                                                                          \
+    return name##_probe_concurrent(hash_set, seq, migrating_table,             \
+                                   migrating_table_size, value, value_size,    \
+                                   hval, result, &found);                      \
   }                                                                            \
                                                                                \
   name *name##_create(uint32_t start_size, name##HashFn hash,                  \
@@ -234,15 +1361,25 @@
                    name##CompareFn compare) {                                  \
     hash_set->hash = hash;                                                     \
     hash_set->compare = compare;                                               \
-    hash_set->table_size = start_size;                                         \
-    hash_set->resize_threshold = CALCULATE_RESIZE_THRESHOLD(start_size);       \
+    hash_set->table_size = NORMALIZE_TABLE_SIZE(start_size);                   \
+    hash_set->resize_threshold =                                               \
+        CALCULATE_RESIZE_THRESHOLD(hash_set->table_size);                      \
     hash_set->table = NULL;                                                    \
-    hash_set->first = NULL;                                                    \
-    hash_set->last = NULL;                                                     \
+    RESET_INSERTION_ORDER(hash_set);                                           \
+    RESET_INCREMENTAL_RESIZE(hash_set);                                        \
     hash_set->num_entries = 0;                                                 \
+    hash_set->num_erased = 0;                                                  \
+    hash_set->seq = 0;                                                         \
+    hash_set->concurrent_reads = false;                                        \
+    HASH_SET_INIT_STATS(hash_set);                                             \
   }                                                                            \
                                                                                \
   void name##_finalize(name *hash_set) {                                       \
+    if (hash_set->concurrent_reads) {                                          \
+      epoch_drain(hash_set);                                                   \
+    }                                                                          \
+    uint32_t migrating_table_size;                                             \
+    free(name##_migrating_table(hash_set, &migrating_table_size));             \
     if (hash_set->table == NULL) {                                             \
       return;                                                                  \
     }                                                                          \
@@ -254,114 +1391,188 @@
     free(hash_set);                                                            \
   }                                                                            \
                                                                                \
-  bool name##_insert(name *hash_set, const value_type value,                   \
-                     uint32_t value_size) {                                    \
+  void name##_reserve(name *hash_set, uint32_t num_values) {                   \
+    const uint32_t table_size = TABLE_SIZE_FOR_ENTRIES(num_values);            \
+    if (table_size <= hash_set->table_size) {                                  \
+      return;                                                                  \
+    }                                                                          \
+    name##_begin_write(hash_set);                                              \
     if (hash_set->table == NULL) {                                             \
-      hash_set->table =                                                        \
-          (name##Entry *)calloc(sizeof(name##Entry), hash_set->table_size);    \
-    } else if (hash_set->num_entries > hash_set->resize_threshold) {           \
-      name##_resize_table(hash_set);                                           \
+      /* The first insert allocates the table. */                              \
+      ATOMIC_STORE_RELEASE(&hash_set->table_size, table_size);                 \
+      hash_set->resize_threshold = CALCULATE_RESIZE_THRESHOLD(table_size);     \
+    } else {                                                                   \
+      name##_finish_migration(hash_set);                                       \
+      name##_resize_table(hash_set, table_size);                               \
+    }                                                                          \
+    name##_end_write(hash_set);                                                \
+  }                                                                            \
+                                                                               \
+  /* Inserts value given its table hash (see name##_hash). */                  \
+  static bool name##_insert_hashed(name *hash_set, const value_type value,     \
+                                   uint32_t value_size, uint32_t hval) {       \
+    name##_begin_write(hash_set);                                              \
+    if (hash_set->table == NULL) {                                             \
+      ATOMIC_STORE_RELEASE(&hash_set->table,                                   \
+                           name##_allocate_table(hash_set->table_size));       \
+    } else if (hash_set->num_entries > hash_set->resize_threshold &&           \
+               hash_set->table_size < HASH_SET_MAX_TABLE_SIZE) {               \
+      name##_grow(hash_set);                                                   \
+    } else if (hash_set->num_erased > 0 &&                                     \
+               hash_set->num_entries + hash_set->num_erased >                  \
+                   hash_set->resize_threshold) {                               \
+      /* Removes tombstones before they leave probes no empty slot to stop     \
+       * at. */                                                                \
+      name##_finish_migration(hash_set);                                       \
+      name##_resize_table(hash_set, hash_set->table_size);                     \
     }                                                                          \
+    name##_migrate_step(hash_set);                                             \
     bool probe_limit_exceeded = false;                                         \
-    bool was_inserted = name##_attempt_insert_internal(                        \
-        hash_set, (value_type)value, value_size,                               \
-        hash_set->hash(value, value_size), hash_set->table,                    \
-        hash_set->table_size, &hash_set->first, &hash_set->last,               \
-        &probe_limit_exceeded);                                                \
+    bool was_inserted =                                                        \
+        name##_attempt_insert(hash_set, (value_type)value, value_size, hval,   \
+                              &probe_limit_exceeded);                          \
     /* Maps may have a lot of removed spots. If this causes a performance      \
      * slowdown, then it is better to rehash the map. */                       \
     if (probe_limit_exceeded) {                                                \
-      name##_resize_table(hash_set);                                           \
+      name##_grow(hash_set);                                                   \
       probe_limit_exceeded = false;                                            \
-      was_inserted = name##_attempt_insert_internal(                           \
-          hash_set, (value_type)value, value_size,                             \
-          hash_set->hash(value, value_size), hash_set->table,                  \
-          hash_set->table_size, &hash_set->first, &hash_set->last,             \
-          &probe_limit_exceeded);                                              \
+      was_inserted =                                                           \
+          name##_attempt_insert(hash_set, (value_type)value, value_size, hval, \
+                                &probe_limit_exceeded);                        \
       if (probe_limit_exceeded) {                                              \
         /* This should never happen. */                                        \
       }                                                                        \
     }                                                                          \
     if (was_inserted) {                                                        \
       hash_set->num_entries++;                                                 \
+      HASH_SET_COUNT(hash_set, INSERTS, 1);                                    \
     }                                                                          \
+    name##_end_write(hash_set);                                                \
     return was_inserted;                                                       \
   }                                                                            \
                                                                                \
-  static name##Entry *name##_find_entry(                                       \
-      const name *hash_set, const value_type value, uint32_t value_size,       \
-      name##Entry *table, uint32_t table_size) {                               \
-    const uint32_t hval = hash_set->hash(value, value_size);                   \
-    int num_probes = 0;                                                        \
-    while (true) {                                                             \
-      int table_index = LOOKUP_HASH_POSITION(hval, num_probes, table_size);    \
-      ++num_probes;                                                            \
-      name##Entry *entry = table + table_index;                                \
-      if (IS_EMPTY(entry)) {                                                   \
-        return NULL;                                                           \
-      }                                                                        \
-      if (IS_TOMBSTONE(entry)) {                                               \
-        continue;                                                              \
-      }                                                                        \
-      if (hval == entry->hash_value) {                                         \
-        if (hash_set->compare(value, value_size, entry->value,                 \
-                              entry->value_size) == 0) {                       \
-          return entry;                                                        \
-        }                                                                      \
-      }                                                                        \
-    }                                                                          \
+  bool name##_insert(name *hash_set, const value_type value,                   \
+                     uint32_t value_size) {                                    \
+    return name##_insert_hashed(hash_set, value, value_size,                   \
+                                name##_hash(hash_set, value, value_size));     \
   }                                                                            \
                                                                                \
   bool name##_remove(name *hash_set, const value_type value,                   \
                      uint32_t value_size) {                                    \
-    if (hash_set->table == NULL) {                                             \
-      return false;                                                            \
-    }                                                                          \
-    name##Entry *entry = name##_find_entry(                                    \
-        hash_set, value, value_size, hash_set->table, hash_set->table_size);   \
+    name##Entry *table;                                                        \
+    uint32_t table_size;                                                       \
+    name##Entry *entry = name##_find_entry_hashed(                             \
+        hash_set, value, value_size, name##_hash(hash_set, value, value_size), \
+        &table, &table_size);                                                  \
     if (entry == NULL) {                                                       \
       return false;                                                            \
     }                                                                          \
-    if (hash_set->last == entry) {                                             \
-      hash_set->last = entry->prev;                                            \
-    } else {                                                                   \
-      entry->next->prev = entry->prev;                                         \
-    }                                                                          \
-    if (hash_set->first == entry) {                                            \
-      hash_set->first = entry->next;                                           \
-    } else {                                                                   \
-      entry->prev->next = entry->next;                                         \
-    }                                                                          \
-    entry->num_probes = TOMBSTONE;                                             \
+    name##_begin_write(hash_set);                                              \
+    name##_erase_entry(hash_set, table, table_size, entry);                    \
     hash_set->num_entries--;                                                   \
+    hash_set->num_erased++;                                                    \
+    name##_migrate_step(hash_set);                                             \
+    name##_end_write(hash_set);                                                \
     return true;                                                               \
   }                                                                            \
                                                                                \
   bool name##_contains(const name *hash_set, const value_type value,           \
                        uint32_t value_size) {                                  \
-    if (hash_set->table == NULL) {                                             \
-      return false;                                                            \
-    }                                                                          \
-    name##Entry *entry = name##_find_entry(                                    \
-        hash_set, value, value_size, hash_set->table, hash_set->table_size);   \
+    name##Entry *table;                                                        \
+    uint32_t table_size;                                                       \
+    return name##_find_entry_hashed(                                           \
+               hash_set, value, value_size,                                    \
+               name##_hash(hash_set, value, value_size), &table,               \
+               &table_size) != NULL;                                           \
+  }                                                                            \
+                                                                               \
+  /* Finds value given its table hash (see name##_hash). */                    \
+  static value_type name##_find_hashed(const name *hash_set,                   \
+                                       const value_type value,                 \
+                                       uint32_t value_size, uint32_t hval,     \
+                                       value_type default_value) {             \
+    name##Entry *table;                                                        \
+    uint32_t table_size;                                                       \
+    name##Entry *entry = name##_find_entry_hashed(                             \
+        hash_set, value, value_size, hval, &table, &table_size);               \
     if (entry == NULL) {                                                       \
-      return false;                                                            \
+      return default_value;                                                    \
     }                                                                          \
-    return true;                                                               \
+    return entry->value;                                                       \
   }                                                                            \
+                                                                               \
   value_type name##_find(const name *hash_set, const value_type value,         \
                          uint32_t value_size, value_type default_value) {      \
+    return name##_find_hashed(hash_set, value, value_size,                     \
+                              name##_hash(hash_set, value, value_size),        \
+                              default_value);                                  \
+  }                                                                            \
+                                                                               \
+  bool name##_insert_prehashed(name *hash_set, const value_type value,         \
+                               uint32_t value_size, uint32_t hash) {           \
+    return name##_insert_hashed(hash_set, value, value_size, MIX_HASH(hash));  \
+  }                                                                            \
+                                                                               \
+  value_type name##_find_prehashed(const name *hash_set,                       \
+                                   const value_type value,                     \
+                                   uint32_t value_size, uint32_t hash,         \
+                                   value_type default_value) {                 \
+    return name##_find_hashed(hash_set, value, value_size, MIX_HASH(hash),     \
+                              default_value);                                  \
+  }                                                                            \
+                                                                               \
+  /* Looks up value without locking while at most one writer modifies the      \
+   * set. Must be called between epoch_enter() and epoch_exit(), and stored    \
+   * values must stay valid for concurrent readers. Returns false if a writer  \
+   * interfered, in which case the lookup must be retried under a lock. */     \
+  bool name##_try_find_concurrent(                                             \
+      const name *hash_set, const value_type value, uint32_t value_size,       \
+      value_type default_value, value_type *result) {                          \
+    return name##_try_find_concurrent_hashed(                                  \
+        hash_set, value, value_size, name##_hash(hash_set, value, value_size), \
+        default_value, result);                                                \
+  }                                                                            \
+                                                                               \
+  uint32_t name##_size(const name *hash_set) { return hash_set->num_entries; } \
+                                                                               \
+  /* Removes every value and releases the table. The next insert allocates a   \
+   * new table of the current size. */                                         \
+  void name##_clear(name *hash_set) {                                          \
     if (hash_set->table == NULL) {                                             \
-      return default_value;                                                    \
+      return;                                                                  \
     }                                                                          \
-    name##Entry *entry = name##_find_entry(                                    \
-        hash_set, value, value_size, hash_set->table, hash_set->table_size);   \
-    if (entry == NULL) {                                                       \
-      return default_value;                                                    \
+    name##_begin_write(hash_set);                                              \
+    name##Entry *table = hash_set->table;                                      \
+    uint32_t migrating_table_size;                                             \
+    name##Entry *migrating_table =                                             \
+        name##_migrating_table(hash_set, &migrating_table_size);               \
+    ATOMIC_STORE_RELAXED(&hash_set->table, NULL);                              \
+    RESET_INCREMENTAL_RESIZE(hash_set);                                        \
+    name##_retire_table(hash_set, table);                                      \
+    if (migrating_table != NULL) {                                             \
+      name##_retire_table(hash_set, migrating_table);                          \
     }                                                                          \
-    return entry->value;                                                       \
+    RESET_INSERTION_ORDER(hash_set);                                           \
+    hash_set->num_entries = 0;                                                 \
+    hash_set->num_erased = 0;                                                  \
+    name##_end_write(hash_set);                                                \
+  }                                                                            \
+                                                                               \
+  /* Counts tombstones by scanning the table, so takes time linear in its      \
+   * size. */                                                                  \
+  void name##_get_stats(const name *hash_set, HashSetStats *stats) {           \
+    memset(stats, 0, sizeof(HashSetStats));                                    \
+    stats->table_size = hash_set->table_size;                                  \
+    stats->num_entries = hash_set->num_entries;                                \
+    if (hash_set->table != NULL) {                                             \
+      stats->num_tombstones = name##_count_tombstones(hash_set);               \
+    }                                                                          \
+    stats->load_factor = (double)hash_set->num_entries / hash_set->table_size; \
+    HASH_SET_READ_STATS(hash_set, stats);                                      \
   }                                                                            \
                                                                                \
-  uint32_t name##_size(const name *hash_set) { return hash_set->num_entries; }
+  void name##_enable_concurrent_reads(name *hash_set) {                        \
+    hash_set->concurrent_reads = true;                                         \
+  }
 
-#endif /* COM_GITHUB_JEFFMANZIONE_INTERN_INTERNAL_HASH_SET_H_ */
\ No newline at end of file
+#endif /* COM_GITHUB_JEFFMANZIONE_INTERN_INTERNAL_HASH_SET_H_ */
@@ -6,6 +6,7 @@ extern "C" {
 #include <stdint.h>
 
 #include <algorithm>
+#include <string>
 
 namespace {
 
@@ -50,6 +51,24 @@ int32_t compare_strings(const char *ptr1, uint32_t size1, const char *ptr2,
   return memcmp(ptr1, ptr2, std::max(size1, size2));
 }
 
+DEFINE_HASH_SET(InlineInt32HashSet, int32_t);
+IMPL_HASH_SET_INLINE(InlineInt32HashSet, int32_t, hash_int32, compare_int32s);
+
+DEFINE_HASH_SET(FixedInt32HashSet, int32_t);
+IMPL_HASH_SET_FIXED(FixedInt32HashSet, int32_t, hash_int32, compare_int32s);
+
+int32_t compare_sized_strings(const char *ptr1, uint32_t size1,
+                              const char *ptr2, uint32_t size2) {
+  if (size1 != size2) {
+    return (int32_t)size1 - (int32_t)size2;
+  }
+  return memcmp(ptr1, ptr2, size1);
+}
+
+DEFINE_HASH_SET(SmallStringHashSet, char *);
+IMPL_HASH_SET_SMALL_VALUES(SmallStringHashSet, char *, hash_string,
+                           compare_sized_strings);
+
 TEST(Int32HashSetTest, Init) {
   Int32HashSet hash_set;
   Int32HashSet_init(&hash_set, DEFAULT_TABLE_SIZE, hash_int32, compare_int32s);
@@ -202,6 +221,370 @@ TEST(Int32HashSetTest, Size) {
   Int32HashSet_finalize(&hash_set);
 }
 
+TEST(Int32HashSetTest, TryFindConcurrent) {
+  Int32HashSet hash_set;
+  Int32HashSet_init(&hash_set, DEFAULT_TABLE_SIZE, hash_int32, compare_int32s);
+  Int32HashSet_enable_concurrent_reads(&hash_set);
+
+  ASSERT_TRUE(Int32HashSet_insert(&hash_set, 10, sizeof(int32_t)));
+  ASSERT_TRUE(Int32HashSet_insert(&hash_set, 20, sizeof(int32_t)));
+
+  int32_t result = 0;
+  ASSERT_TRUE(epoch_enter());
+  ASSERT_TRUE(Int32HashSet_try_find_concurrent(&hash_set, 10, sizeof(int32_t),
+                                               -1, &result));
+  EXPECT_EQ(10, result);
+  ASSERT_TRUE(Int32HashSet_try_find_concurrent(&hash_set, 50, sizeof(int32_t),
+                                               -1, &result));
+  EXPECT_EQ(-1, result);
+  epoch_exit();
+
+  // Force resizes so that old tables are retired.
+  for (int32_t i = 100; i < 1000; ++i) {
+    ASSERT_TRUE(Int32HashSet_insert(&hash_set, i, sizeof(int32_t)));
+  }
+  ASSERT_TRUE(epoch_enter());
+  for (int32_t i = 100; i < 1000; ++i) {
+    ASSERT_TRUE(Int32HashSet_try_find_concurrent(&hash_set, i,
+                                                 sizeof(int32_t), -1, &result));
+    EXPECT_EQ(i, result);
+  }
+  epoch_exit();
+
+  Int32HashSet_finalize(&hash_set);
+}
+
+TEST(Int32HashSetTest, Prehashed) {
+  Int32HashSet hash_set;
+  Int32HashSet_init(&hash_set, DEFAULT_TABLE_SIZE, hash_int32, compare_int32s);
+
+  for (int32_t i = 0; i < 1000; ++i) {
+    ASSERT_TRUE(Int32HashSet_insert_prehashed(&hash_set, i, sizeof(int32_t),
+                                              hash_int32(i, sizeof(int32_t))));
+  }
+  ASSERT_FALSE(Int32HashSet_insert_prehashed(&hash_set, 10, sizeof(int32_t),
+                                             hash_int32(10, sizeof(int32_t))));
+  ASSERT_EQ(Int32HashSet_size(&hash_set), 1000);
+
+  // Prehashed and regular entry points agree with each other.
+  for (int32_t i = 0; i < 1000; ++i) {
+    ASSERT_EQ(i, Int32HashSet_find_prehashed(&hash_set, i, sizeof(int32_t),
+                                             hash_int32(i, sizeof(int32_t)),
+                                             -1));
+    ASSERT_TRUE(Int32HashSet_contains(&hash_set, i, sizeof(int32_t)));
+  }
+  ASSERT_EQ(-1, Int32HashSet_find_prehashed(&hash_set, 5000, sizeof(int32_t),
+                                            hash_int32(5000, sizeof(int32_t)),
+                                            -1));
+
+  Int32HashSet_finalize(&hash_set);
+}
+
+TEST(Int32HashSetTest, Clear) {
+  Int32HashSet hash_set;
+  Int32HashSet_init(&hash_set, DEFAULT_TABLE_SIZE, hash_int32, compare_int32s);
+
+  Int32HashSet_clear(&hash_set);
+  for (int32_t i = 0; i < 100; ++i) {
+    ASSERT_TRUE(Int32HashSet_insert(&hash_set, i, sizeof(int32_t)));
+  }
+  Int32HashSet_clear(&hash_set);
+  ASSERT_EQ(Int32HashSet_size(&hash_set), 0);
+  ASSERT_FALSE(Int32HashSet_contains(&hash_set, 10, sizeof(int32_t)));
+
+  // The set is usable again after clearing.
+  ASSERT_TRUE(Int32HashSet_insert(&hash_set, 10, sizeof(int32_t)));
+  ASSERT_TRUE(Int32HashSet_contains(&hash_set, 10, sizeof(int32_t)));
+  ASSERT_EQ(Int32HashSet_size(&hash_set), 1);
+
+  Int32HashSet_finalize(&hash_set);
+}
+
+TEST(Int32HashSetTest, Stats) {
+  Int32HashSet hash_set;
+  Int32HashSet_init(&hash_set, DEFAULT_TABLE_SIZE, hash_int32, compare_int32s);
+
+  for (int32_t i = 0; i < 100; ++i) {
+    ASSERT_TRUE(Int32HashSet_insert(&hash_set, i, sizeof(int32_t)));
+  }
+  for (int32_t i = 0; i < 10; ++i) {
+    ASSERT_TRUE(Int32HashSet_remove(&hash_set, i, sizeof(int32_t)));
+  }
+  for (int32_t i = 0; i < 200; ++i) {
+    Int32HashSet_contains(&hash_set, i, sizeof(int32_t));
+  }
+
+  HashSetStats stats;
+  Int32HashSet_get_stats(&hash_set, &stats);
+  EXPECT_EQ(90, stats.num_entries);
+  EXPECT_EQ(hash_set.table_size, stats.table_size);
+  EXPECT_LE(stats.num_tombstones, 10);
+  EXPECT_DOUBLE_EQ((double)90 / stats.table_size, stats.load_factor);
+#if defined(INTERN_ENABLE_STATS)
+  // Removes count as lookups too.
+  EXPECT_EQ(100, stats.hits);
+  EXPECT_EQ(110, stats.misses);
+  EXPECT_EQ(100, stats.inserts);
+  EXPECT_GT(stats.resizes, 0);
+  EXPECT_GE(stats.total_probes, stats.hits + stats.misses);
+  EXPECT_GE(stats.max_probes, 1);
+#else
+  EXPECT_EQ(0, stats.hits);
+  EXPECT_EQ(0, stats.inserts);
+#endif
+
+  Int32HashSet_finalize(&hash_set);
+}
+
+TEST(Int32HashSetTest, ClusteredKeys) {
+  Int32HashSet hash_set;
+  Int32HashSet_init(&hash_set, DEFAULT_TABLE_SIZE, hash_int32, compare_int32s);
+
+  // Identity hashes of multiples of 1024 share all of their low bits.
+  for (int32_t i = 0; i < 1000; ++i) {
+    ASSERT_TRUE(Int32HashSet_insert(&hash_set, i * 1024, sizeof(int32_t)));
+  }
+  for (int32_t i = 0; i < 1000; ++i) {
+    ASSERT_TRUE(Int32HashSet_contains(&hash_set, i * 1024, sizeof(int32_t)));
+    ASSERT_FALSE(
+        Int32HashSet_contains(&hash_set, i * 1024 + 1, sizeof(int32_t)));
+  }
+#if defined(HASH_SET_POW2_TABLES)
+  EXPECT_EQ(0, hash_set.table_size & (hash_set.table_size - 1));
+#endif
+
+  Int32HashSet_finalize(&hash_set);
+}
+
+TEST(Int32HashSetTest, RemoveAllThenReinsert) {
+  Int32HashSet hash_set;
+  Int32HashSet_init(&hash_set, DEFAULT_TABLE_SIZE, hash_int32, compare_int32s);
+
+  // Leaves every used slot removed, so probes must skip over them.
+  for (int round = 0; round < 4; ++round) {
+    for (int32_t i = 0; i < 500; ++i) {
+      ASSERT_TRUE(Int32HashSet_insert(&hash_set, i, sizeof(int32_t)));
+    }
+    ASSERT_FALSE(Int32HashSet_insert(&hash_set, 250, sizeof(int32_t)));
+    for (int32_t i = 0; i < 500; ++i) {
+      ASSERT_TRUE(Int32HashSet_remove(&hash_set, i, sizeof(int32_t)));
+    }
+    ASSERT_EQ(Int32HashSet_size(&hash_set), 0);
+    ASSERT_FALSE(Int32HashSet_contains(&hash_set, 250, sizeof(int32_t)));
+  }
+
+  Int32HashSet_finalize(&hash_set);
+}
+
+TEST(Int32HashSetTest, ChurnDoesNotFillTableWithTombstones) {
+  Int32HashSet hash_set;
+  Int32HashSet_init(&hash_set, DEFAULT_TABLE_SIZE, hash_int32, compare_int32s);
+
+  // Keeps few values while always inserting new ones, so removed slots would
+  // eventually leave misses no empty slot to stop at.
+  for (int32_t i = 0; i < 100000; ++i) {
+    ASSERT_TRUE(Int32HashSet_insert(&hash_set, i, sizeof(int32_t)));
+    if (i >= 100) {
+      ASSERT_TRUE(Int32HashSet_remove(&hash_set, i - 100, sizeof(int32_t)));
+    }
+    ASSERT_FALSE(Int32HashSet_contains(&hash_set, -i - 1, sizeof(int32_t)));
+  }
+  ASSERT_EQ(Int32HashSet_size(&hash_set), 100);
+
+  HashSetStats stats;
+  Int32HashSet_get_stats(&hash_set, &stats);
+  EXPECT_LE(stats.num_entries + stats.num_tombstones, stats.table_size / 2 + 1);
+
+  Int32HashSet_finalize(&hash_set);
+}
+
+TEST(Int32HashSetTest, RemoveWhileGrowing) {
+  Int32HashSet hash_set;
+  Int32HashSet_init(&hash_set, DEFAULT_TABLE_SIZE, hash_int32, compare_int32s);
+
+  // Interleaves removes and repeated inserts of older values with growth, so
+  // they also hit values that a resize has not moved yet.
+  for (int32_t i = 0; i < 10000; ++i) {
+    ASSERT_TRUE(Int32HashSet_insert(&hash_set, i, sizeof(int32_t)));
+    if (i >= 2) {
+      ASSERT_FALSE(Int32HashSet_insert(&hash_set, i / 2 + 1, sizeof(int32_t)));
+    }
+    if (i % 2 == 0) {
+      ASSERT_TRUE(Int32HashSet_remove(&hash_set, i / 2, sizeof(int32_t)));
+    }
+  }
+  ASSERT_EQ(Int32HashSet_size(&hash_set), 5000);
+  for (int32_t i = 0; i < 10000; ++i) {
+    ASSERT_EQ(Int32HashSet_contains(&hash_set, i, sizeof(int32_t)), i >= 5000);
+  }
+
+  Int32HashSet_finalize(&hash_set);
+}
+
+TEST(Int32HashSetTest, Reserve) {
+  Int32HashSet hash_set;
+  Int32HashSet_init(&hash_set, DEFAULT_TABLE_SIZE, hash_int32, compare_int32s);
+
+  Int32HashSet_reserve(&hash_set, 10000);
+  const uint32_t table_size = hash_set.table_size;
+  EXPECT_GE(table_size, 20000);
+  EXPECT_TRUE(hash_set.table == NULL);
+
+  // Reserving less never shrinks the table.
+  Int32HashSet_reserve(&hash_set, 100);
+  EXPECT_EQ(table_size, hash_set.table_size);
+
+  for (int32_t i = 0; i < 10000; ++i) {
+    ASSERT_TRUE(Int32HashSet_insert(&hash_set, i, sizeof(int32_t)));
+  }
+  EXPECT_EQ(table_size, hash_set.table_size);
+
+  Int32HashSet_finalize(&hash_set);
+}
+
+TEST(Int32HashSetTest, ReserveClampsHugeRequests) {
+  // Growth saturates, and the threshold of the largest table is reachable.
+  EXPECT_EQ(HASH_SET_MAX_TABLE_SIZE,
+            CALCULATE_NEW_TABLE_SIZE(HASH_SET_MAX_TABLE_SIZE));
+  EXPECT_EQ(HASH_SET_MAX_TABLE_SIZE / 2,
+            CALCULATE_RESIZE_THRESHOLD(HASH_SET_MAX_TABLE_SIZE));
+
+  Int32HashSet hash_set;
+  Int32HashSet_init(&hash_set, DEFAULT_TABLE_SIZE, hash_int32, compare_int32s);
+
+  // Twice these counts does not fit in 32 bits. The table is not allocated
+  // until the first insert, so nothing of that size is allocated here.
+  Int32HashSet_reserve(&hash_set, 1u << 31);
+  EXPECT_EQ(HASH_SET_MAX_TABLE_SIZE, hash_set.table_size);
+  Int32HashSet_reserve(&hash_set, UINT32_MAX);
+  EXPECT_EQ(HASH_SET_MAX_TABLE_SIZE, hash_set.table_size);
+  EXPECT_TRUE(hash_set.table == NULL);
+
+#if HASH_SET_MAX_TABLE_BITS <= 20
+  // The largest table is small enough to fill past its resize threshold, both
+  // after the clamped reserve and when growing into it.
+  Int32HashSet grown_set;
+  Int32HashSet_init(&grown_set, DEFAULT_TABLE_SIZE, hash_int32,
+                    compare_int32s);
+  const int32_t num_values = HASH_SET_MAX_TABLE_SIZE / 10 * 6;
+  for (int32_t i = 0; i < num_values; ++i) {
+    ASSERT_TRUE(Int32HashSet_insert(&hash_set, i, sizeof(int32_t)));
+    ASSERT_TRUE(Int32HashSet_insert(&grown_set, i, sizeof(int32_t)));
+  }
+  EXPECT_EQ(HASH_SET_MAX_TABLE_SIZE, hash_set.table_size);
+  EXPECT_EQ(HASH_SET_MAX_TABLE_SIZE, grown_set.table_size);
+  for (int32_t i = 0; i < num_values; ++i) {
+    ASSERT_TRUE(Int32HashSet_contains(&hash_set, i, sizeof(int32_t)));
+    ASSERT_TRUE(Int32HashSet_contains(&grown_set, i, sizeof(int32_t)));
+  }
+  EXPECT_FALSE(Int32HashSet_contains(&hash_set, -1, sizeof(int32_t)));
+  Int32HashSet_finalize(&grown_set);
+#endif
+
+  Int32HashSet_finalize(&hash_set);
+}
+
+TEST(Int32HashSetTest, ReserveKeepsValues) {
+  Int32HashSet hash_set;
+  Int32HashSet_init(&hash_set, DEFAULT_TABLE_SIZE, hash_int32, compare_int32s);
+
+  for (int32_t i = 0; i < 1000; ++i) {
+    ASSERT_TRUE(Int32HashSet_insert(&hash_set, i, sizeof(int32_t)));
+  }
+  for (int32_t i = 0; i < 1000; i += 2) {
+    ASSERT_TRUE(Int32HashSet_remove(&hash_set, i, sizeof(int32_t)));
+  }
+  Int32HashSet_reserve(&hash_set, 100000);
+  EXPECT_GE(hash_set.table_size, 200000);
+  ASSERT_EQ(Int32HashSet_size(&hash_set), 500);
+  for (int32_t i = 0; i < 1000; ++i) {
+    ASSERT_EQ(Int32HashSet_contains(&hash_set, i, sizeof(int32_t)), i % 2 == 1);
+  }
+
+  Int32HashSet_finalize(&hash_set);
+}
+
+#if defined(HASH_SET_INCREMENTAL_RESIZE)
+TEST(Int32HashSetTest, ResizeMigratesIncrementally) {
+  Int32HashSet hash_set;
+  Int32HashSet_init(&hash_set, 1024, hash_int32, compare_int32s);
+
+  int32_t num_values = 0;
+  while (hash_set.old_table == NULL) {
+    ASSERT_TRUE(Int32HashSet_insert(&hash_set, num_values++, sizeof(int32_t)));
+  }
+  const uint32_t old_table_size = hash_set.old_table_size;
+  EXPECT_EQ(HASH_SET_MIGRATION_SLOTS_PER_WRITE, hash_set.migrate_position);
+  for (int32_t i = 0; i < num_values; ++i) {
+    ASSERT_TRUE(Int32HashSet_contains(&hash_set, i, sizeof(int32_t)));
+  }
+
+  // Each write migrates the same number of slots, until none are left.
+  int num_writes = 0;
+  while (hash_set.old_table != NULL) {
+    ASSERT_TRUE(Int32HashSet_insert(&hash_set, num_values++, sizeof(int32_t)));
+    ++num_writes;
+  }
+  EXPECT_EQ(old_table_size / HASH_SET_MIGRATION_SLOTS_PER_WRITE - 1,
+            num_writes);
+  for (int32_t i = 0; i < num_values; ++i) {
+    ASSERT_TRUE(Int32HashSet_contains(&hash_set, i, sizeof(int32_t)));
+  }
+
+  Int32HashSet_finalize(&hash_set);
+}
+#endif
+
+TEST(InlineInt32HashSetTest, InsertRemove) {
+  InlineInt32HashSet hash_set;
+  // Bound at expansion time, so no function pointers are needed.
+  InlineInt32HashSet_init(&hash_set, DEFAULT_TABLE_SIZE, NULL, NULL);
+
+  for (int32_t i = 0; i < 100; ++i) {
+    ASSERT_TRUE(InlineInt32HashSet_insert(&hash_set, i, sizeof(int32_t)));
+  }
+  ASSERT_EQ(InlineInt32HashSet_size(&hash_set), 100);
+  ASSERT_TRUE(InlineInt32HashSet_contains(&hash_set, 50, sizeof(int32_t)));
+  ASSERT_FALSE(InlineInt32HashSet_contains(&hash_set, 150, sizeof(int32_t)));
+
+  ASSERT_TRUE(InlineInt32HashSet_remove(&hash_set, 50, sizeof(int32_t)));
+  ASSERT_FALSE(InlineInt32HashSet_contains(&hash_set, 50, sizeof(int32_t)));
+  ASSERT_EQ(InlineInt32HashSet_size(&hash_set), 99);
+
+  InlineInt32HashSet_finalize(&hash_set);
+}
+
+TEST(FixedInt32HashSetTest, EntriesHoldNoSizes) {
+#if defined(HASH_SET_NO_INSERTION_ORDER)
+  EXPECT_EQ(sizeof(FixedInt32HashSetEntry) + sizeof(uint32_t),
+            sizeof(InlineInt32HashSetEntry));
+#else
+  // The insertion-order links may pad both to the same size.
+  EXPECT_LE(sizeof(FixedInt32HashSetEntry), sizeof(InlineInt32HashSetEntry));
+#endif
+}
+
+TEST(FixedInt32HashSetTest, InsertRemove) {
+  FixedInt32HashSet hash_set;
+  FixedInt32HashSet_init(&hash_set, DEFAULT_TABLE_SIZE, NULL, NULL);
+
+  // Grows the table several times.
+  for (int32_t i = 0; i < 10000; ++i) {
+    ASSERT_TRUE(FixedInt32HashSet_insert(&hash_set, i, sizeof(int32_t)));
+  }
+  ASSERT_FALSE(FixedInt32HashSet_insert(&hash_set, 5000, sizeof(int32_t)));
+  for (int32_t i = 0; i < 10000; i += 3) {
+    ASSERT_TRUE(FixedInt32HashSet_remove(&hash_set, i, sizeof(int32_t)));
+  }
+  ASSERT_EQ(FixedInt32HashSet_size(&hash_set), 6666);
+  for (int32_t i = 0; i < 10000; ++i) {
+    ASSERT_EQ(FixedInt32HashSet_contains(&hash_set, i, sizeof(int32_t)),
+              i % 3 != 0);
+  }
+
+  FixedInt32HashSet_finalize(&hash_set);
+}
+
 TEST(StringHashSetTest, Init) {
   StringHashSet hash_set;
   StringHashSet_init(&hash_set, DEFAULT_TABLE_SIZE, hash_string,
@@ -361,4 +744,61 @@ TEST(StringHashSetTest, Size) {
   StringHashSet_finalize(&hash_set);
 }
 
+TEST(PackSmallValueTest, EveryByteMatters) {
+  for (uint32_t size = 1; size <= SMALL_VALUE_MAX_SIZE; ++size) {
+    char value[SMALL_VALUE_MAX_SIZE] = {0};
+    const uint64_t packed = pack_small_value(value, size);
+    for (uint32_t i = 0; i < size; ++i) {
+      value[i] = 1;
+      EXPECT_NE(packed, pack_small_value(value, size)) << size << ", " << i;
+      value[i] = 0;
+    }
+  }
+  EXPECT_EQ(0, pack_small_value("123456789", 9));
+}
+
+TEST(SmallStringHashSetTest, InsertFindRemove) {
+  SmallStringHashSet hash_set;
+  SmallStringHashSet_init(&hash_set, DEFAULT_TABLE_SIZE, NULL, NULL);
+  const char *alphabet = "abcdefghijklmnopqrstuvwxyz";
+
+  // Every prefix, so small and large values share hashes' neighborhoods.
+  for (uint32_t size = 0; size <= 26; ++size) {
+    ASSERT_TRUE(
+        SmallStringHashSet_insert(&hash_set, (char *)alphabet, size));
+  }
+  for (uint32_t size = 0; size <= 26; ++size) {
+    std::string copy(alphabet, size);
+    ASSERT_EQ(alphabet, SmallStringHashSet_find(&hash_set, (char *)copy.data(),
+                                                size, NULL));
+    if (size > 0 && size < 26) {
+      copy.back() = 'z';
+      ASSERT_FALSE(SmallStringHashSet_contains(&hash_set, (char *)copy.data(),
+                                               size));
+    }
+  }
+  ASSERT_TRUE(SmallStringHashSet_remove(&hash_set, (char *)"abc", 3));
+  ASSERT_FALSE(SmallStringHashSet_contains(&hash_set, (char *)"abc", 3));
+  ASSERT_EQ(SmallStringHashSet_size(&hash_set), 26);
+
+  SmallStringHashSet_finalize(&hash_set);
+}
+
+TEST(SmallStringHashSetTest, SmallValuesAreComparedInSlot) {
+  SmallStringHashSet hash_set;
+  SmallStringHashSet_init(&hash_set, DEFAULT_TABLE_SIZE, NULL, NULL);
+  char small[] = "cat";
+  char large[] = "catalogue";
+  ASSERT_TRUE(SmallStringHashSet_insert(&hash_set, small, 3));
+  ASSERT_TRUE(SmallStringHashSet_insert(&hash_set, large, 9));
+
+  // Only values too large for their slot are read through the pointer.
+  small[0] = large[0] = 'h';
+  EXPECT_EQ(small, SmallStringHashSet_find(&hash_set, (char *)"cat", 3, NULL));
+  EXPECT_EQ(NULL,
+            SmallStringHashSet_find(&hash_set, (char *)"catalogue", 9, NULL));
+
+  SmallStringHashSet_finalize(&hash_set);
+}
+
 }  // namespace
\ No newline at end of file
@@ -11,4 +11,31 @@ uint32_t compute_nearest_pow2_gte(uint32_t num) {
   num |= num >> 8;
   num |= num >> 16;
   return num + 1;
-}
\ No newline at end of file
+}
+uint32_t compute_floor_log2(uint64_t num) {
+  uint32_t log2 = 0;
+  if (num >> 32) {
+    num >>= 32;
+    log2 += 32;
+  }
+  if (num >> 16) {
+    num >>= 16;
+    log2 += 16;
+  }
+  if (num >> 8) {
+    num >>= 8;
+    log2 += 8;
+  }
+  if (num >> 4) {
+    num >>= 4;
+    log2 += 4;
+  }
+  if (num >> 2) {
+    num >>= 2;
+    log2 += 2;
+  }
+  if (num >> 1) {
+    log2 += 1;
+  }
+  return log2;
+}
@@ -6,4 +6,8 @@
 // Returns the nearest power of 2 greater than or equal to num.
 uint32_t compute_nearest_pow2_gte(uint32_t num);
 
+// Returns the index of the highest set bit of num, i.e., floor(log2(num)), or 0
+// if num is 0.
+uint32_t compute_floor_log2(uint64_t num);
+
 #endif /* COM_GITHUB_JEFFMANZIONE_INTERN_INTERNAL_INTERN_HELPERS_H_ */
@@ -113,4 +113,15 @@ TEST(ComputeNearestPow2Gte, PowsOf2Plus1) {
   EXPECT_EQ((1u << 31), compute_nearest_pow2_gte((1u << 30) + 1));
 }
 
+TEST(ComputeFloorLog2, Zero) { EXPECT_EQ(0, compute_floor_log2(0)); }
+
+TEST(ComputeFloorLog2, PowsOf2AndNeighbors) {
+  for (uint32_t i = 1; i < 64; ++i) {
+    EXPECT_EQ(i, compute_floor_log2(1ull << i));
+    EXPECT_EQ(i - 1, compute_floor_log2((1ull << i) - 1));
+    EXPECT_EQ(i, compute_floor_log2((1ull << i) + 1));
+  }
+  EXPECT_EQ(63, compute_floor_log2(UINT64_MAX));
+}
+
 }  // namespace
\ No newline at end of file
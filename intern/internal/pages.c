@@ -0,0 +1,46 @@
+#include "intern/internal/pages.h"
+
+#include <stdint.h>
+
+#include "intern/internal/platform.h"
+
+#if defined(SYSTEM_WINDOWS)
+#include <windows.h>
+#elif defined(SYSTEM_POSIX)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+size_t page_size(void) {
+#if defined(SYSTEM_WINDOWS)
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwPageSize;
+#elif defined(SYSTEM_POSIX)
+  return (size_t)sysconf(_SC_PAGESIZE);
+#else
+  return 4096;
+#endif
+}
+
+size_t discard_pages(void *addr, size_t size) {
+  const uintptr_t page_mask = (uintptr_t)page_size() - 1;
+  const uintptr_t start = ((uintptr_t)addr + page_mask) & ~page_mask;
+  const uintptr_t end = ((uintptr_t)addr + size) & ~page_mask;
+  if (start >= end) {
+    return 0;
+  }
+#if defined(SYSTEM_WINDOWS)
+  if (VirtualAlloc((void *)start, end - start, MEM_RESET, PAGE_READWRITE) ==
+      NULL) {
+    return 0;
+  }
+#elif defined(SYSTEM_POSIX)
+  if (madvise((void *)start, end - start, MADV_DONTNEED) != 0) {
+    return 0;
+  }
+#else
+  return 0;
+#endif
+  return end - start;
+}
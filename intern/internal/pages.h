@@ -0,0 +1,23 @@
+#ifndef COM_GITHUB_JEFFMANZIONE_INTERN_INTERNAL_PAGES_H_
+#define COM_GITHUB_JEFFMANZIONE_INTERN_INTERNAL_PAGES_H_
+
+/**
+ * @file pages.h
+ * @brief Returning unused pages of live allocations to the operating system.
+ *
+ * Discarded pages stay mapped, so reading or writing them never faults. Their
+ * contents are unspecified afterwards (zero on Linux), and they only take up
+ * physical memory again once written.
+ */
+
+#include <stddef.h>
+
+// Size in bytes of a virtual memory page.
+size_t page_size(void);
+
+// Discards every whole page inside [addr, addr + size), which must be owned by
+// the caller. Returns the number of bytes discarded, or 0 where discarding is
+// unsupported.
+size_t discard_pages(void *addr, size_t size);
+
+#endif /* COM_GITHUB_JEFFMANZIONE_INTERN_INTERNAL_PAGES_H_ */
@@ -0,0 +1,39 @@
+extern "C" {
+#include "intern/internal/pages.h"
+}
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+TEST(PageSize, IsPowerOf2) {
+  const size_t size = page_size();
+  EXPECT_GE(size, 4096u);
+  EXPECT_EQ(0u, size & (size - 1));
+}
+
+TEST(DiscardPages, OnlyWholePagesInRange) {
+  const size_t size = page_size();
+  char *block = static_cast<char *>(aligned_alloc(size, 4 * size));
+  ASSERT_NE(nullptr, block);
+  memset(block, 'x', 4 * size);
+
+  EXPECT_EQ(0u, discard_pages(block + 1, size));
+  EXPECT_EQ(2 * size, discard_pages(block + size - 1, 3 * size));
+
+  // Bytes outside the discarded pages are untouched, and discarded pages can
+  // be written again.
+  EXPECT_EQ('x', block[size - 1]);
+  EXPECT_EQ('x', block[3 * size]);
+  memset(block + size, 'y', 2 * size);
+  EXPECT_EQ('y', block[2 * size]);
+  free(block);
+}
+
+TEST(DiscardPages, EmptyRange) { EXPECT_EQ(0u, discard_pages(nullptr, 0)); }
+
+}  // namespace
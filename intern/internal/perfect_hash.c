@@ -0,0 +1,182 @@
+#include "intern/internal/perfect_hash.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Seeds tried before construction gives up */
+#define PERFECT_HASH_MAX_SEEDS 16
+
+/* Scratch space shared by every construction attempt */
+typedef struct {
+  uint64_t *key_hashes;    /* Grouped by bucket */
+  uint32_t *bucket_starts; /* num_buckets + 1 offsets into key_hashes */
+  uint32_t *order;         /* Buckets by decreasing size */
+  uint32_t *sizes;         /* Number of buckets of each size */
+  uint32_t *positions;     /* Positions claimed by the current bucket */
+  uint64_t *taken;         /* Bitmap of claimed positions */
+} PerfectHashScratch;
+
+static bool is_taken(const uint64_t *taken, uint32_t position) {
+  return (taken[position / 64] >> (position % 64)) & 1;
+}
+
+static void flip_taken(uint64_t *taken, uint32_t position) {
+  taken[position / 64] ^= (uint64_t)1 << (position % 64);
+}
+
+/* Groups the key hashes by bucket. Returns the size of the largest bucket. */
+static uint32_t group_by_bucket(const PerfectHash *perfect_hash,
+                                const uint32_t *keys,
+                                PerfectHashScratch *scratch) {
+  const uint32_t num_buckets = perfect_hash->num_buckets;
+  uint32_t *starts = scratch->bucket_starts;
+  memset(starts, 0, (num_buckets + 1) * sizeof(uint32_t));
+  for (uint32_t i = 0; i < perfect_hash->num_keys; ++i) {
+    const uint64_t key_hash = perfect_hash_mix64(keys[i] ^ perfect_hash->seed);
+    starts[perfect_hash_reduce(key_hash, num_buckets) + 1]++;
+  }
+  uint32_t max_size = 0;
+  for (uint32_t b = 0; b < num_buckets; ++b) {
+    if (starts[b + 1] > max_size) {
+      max_size = starts[b + 1];
+    }
+    starts[b + 1] += starts[b];
+  }
+  /* Advances starts[b] to the end of bucket b, then shifts it back. */
+  for (uint32_t i = 0; i < perfect_hash->num_keys; ++i) {
+    const uint64_t key_hash = perfect_hash_mix64(keys[i] ^ perfect_hash->seed);
+    scratch->key_hashes[starts[perfect_hash_reduce(key_hash, num_buckets)]++] =
+        key_hash;
+  }
+  for (uint32_t b = num_buckets; b > 0; --b) {
+    starts[b] = starts[b - 1];
+  }
+  starts[0] = 0;
+  return max_size;
+}
+
+/* Orders buckets by decreasing size with a counting sort. */
+static void order_buckets(const PerfectHash *perfect_hash, uint32_t max_size,
+                          PerfectHashScratch *scratch) {
+  const uint32_t *starts = scratch->bucket_starts;
+  uint32_t *sizes = scratch->sizes;
+  memset(sizes, 0, (max_size + 1) * sizeof(uint32_t));
+  for (uint32_t b = 0; b < perfect_hash->num_buckets; ++b) {
+    sizes[starts[b + 1] - starts[b]]++;
+  }
+  uint32_t offset = 0;
+  for (uint32_t size = max_size + 1; size > 0; --size) {
+    const uint32_t count = sizes[size - 1];
+    sizes[size - 1] = offset;
+    offset += count;
+  }
+  for (uint32_t b = 0; b < perfect_hash->num_buckets; ++b) {
+    scratch->order[sizes[starts[b + 1] - starts[b]]++] = b;
+  }
+}
+
+/* Finds a pilot for every bucket. Returns false if some bucket could not be
+ * placed with the current seed. */
+static bool assign_pilots(PerfectHash *perfect_hash,
+                          PerfectHashScratch *scratch) {
+  const uint32_t num_keys = perfect_hash->num_keys;
+  /* A singleton bucket placed last needs about num_keys attempts. */
+  uint64_t max_pilots = 16 * (uint64_t)num_keys + 1024;
+  if (max_pilots > UINT32_MAX) {
+    max_pilots = UINT32_MAX;
+  }
+  memset(scratch->taken, 0, ((num_keys + 63) / 64) * sizeof(uint64_t));
+  for (uint32_t i = 0; i < perfect_hash->num_buckets; ++i) {
+    const uint32_t bucket = scratch->order[i];
+    const uint64_t *key_hashes =
+        scratch->key_hashes + scratch->bucket_starts[bucket];
+    const uint32_t size = scratch->bucket_starts[bucket + 1] -
+                          scratch->bucket_starts[bucket];
+    if (size == 0) {
+      /* Buckets are sorted by size, so every remaining bucket is empty. */
+      return true;
+    }
+    uint64_t pilot = 0;
+    for (; pilot < max_pilots; ++pilot) {
+      uint32_t num_placed = 0;
+      for (; num_placed < size; ++num_placed) {
+        const uint32_t position =
+            perfect_hash_position(key_hashes[num_placed], (uint32_t)pilot,
+                                  perfect_hash->seed, num_keys);
+        if (is_taken(scratch->taken, position)) {
+          break;
+        }
+        flip_taken(scratch->taken, position);
+        scratch->positions[num_placed] = position;
+      }
+      if (num_placed == size) {
+        break;
+      }
+      for (uint32_t j = 0; j < num_placed; ++j) {
+        flip_taken(scratch->taken, scratch->positions[j]);
+      }
+    }
+    if (pilot == max_pilots) {
+      return false;
+    }
+    perfect_hash->pilots[bucket] = (uint32_t)pilot;
+  }
+  return true;
+}
+
+static void free_scratch(PerfectHashScratch *scratch) {
+  free(scratch->key_hashes);
+  free(scratch->bucket_starts);
+  free(scratch->order);
+  free(scratch->sizes);
+  free(scratch->positions);
+  free(scratch->taken);
+}
+
+bool perfect_hash_build(PerfectHash *perfect_hash, const uint32_t *keys,
+                        uint32_t num_keys) {
+  perfect_hash->num_keys = num_keys;
+  perfect_hash->num_buckets = num_keys / PERFECT_HASH_KEYS_PER_BUCKET + 1;
+  perfect_hash->pilots =
+      (uint32_t *)calloc(perfect_hash->num_buckets, sizeof(uint32_t));
+
+  PerfectHashScratch scratch;
+  memset(&scratch, 0, sizeof(scratch));
+  scratch.key_hashes = (uint64_t *)malloc((num_keys + 1) * sizeof(uint64_t));
+  scratch.bucket_starts =
+      (uint32_t *)malloc((perfect_hash->num_buckets + 1) * sizeof(uint32_t));
+  scratch.order =
+      (uint32_t *)malloc(perfect_hash->num_buckets * sizeof(uint32_t));
+  scratch.taken = (uint64_t *)malloc(((num_keys + 63) / 64 + 1) *
+                                     sizeof(uint64_t));
+
+  bool built = false;
+  if (perfect_hash->pilots != NULL && scratch.key_hashes != NULL &&
+      scratch.bucket_starts != NULL && scratch.order != NULL &&
+      scratch.taken != NULL) {
+    for (uint64_t i = 0; i < PERFECT_HASH_MAX_SEEDS && !built; ++i) {
+      perfect_hash->seed = perfect_hash_mix64(i + 1);
+      const uint32_t max_size = group_by_bucket(perfect_hash, keys, &scratch);
+      free(scratch.sizes);
+      free(scratch.positions);
+      scratch.sizes = (uint32_t *)malloc((max_size + 1) * sizeof(uint32_t));
+      scratch.positions =
+          (uint32_t *)malloc((max_size + 1) * sizeof(uint32_t));
+      if (scratch.sizes == NULL || scratch.positions == NULL) {
+        break;
+      }
+      order_buckets(perfect_hash, max_size, &scratch);
+      built = assign_pilots(perfect_hash, &scratch);
+    }
+  }
+  free_scratch(&scratch);
+  if (!built) {
+    perfect_hash_finalize(perfect_hash);
+  }
+  return built;
+}
+
+void perfect_hash_finalize(PerfectHash *perfect_hash) {
+  free(perfect_hash->pilots);
+  perfect_hash->pilots = NULL;
+}
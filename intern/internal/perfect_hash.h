@@ -0,0 +1,74 @@
+#ifndef COM_GITHUB_JEFFMANZIONE_INTERN_INTERNAL_PERFECT_HASH_H_
+#define COM_GITHUB_JEFFMANZIONE_INTERN_INTERNAL_PERFECT_HASH_H_
+
+/**
+ * @file perfect_hash.h
+ * @brief Minimal perfect hash over a static set of 32-bit keys.
+ *
+ * Follows the PTHash construction: keys are split into buckets of about
+ * PERFECT_HASH_KEYS_PER_BUCKET keys, and each bucket stores a "pilot" chosen
+ * so that its keys land on positions no other bucket uses. A lookup is one
+ * pilot load and two multiplicative mixes, and the index costs about one byte
+ * per key.
+ *
+ * Usage assumptions:
+ *   - Keys passed to perfect_hash_build() must be distinct.
+ *   - perfect_hash_lookup() returns an arbitrary position in [0, num_keys) for
+ *     keys outside the set, so callers must verify the key stored there.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Average number of keys per bucket. Larger buckets shrink the index but make
+// construction slower.
+#define PERFECT_HASH_KEYS_PER_BUCKET 4
+
+typedef struct {
+  uint64_t seed;
+  uint32_t num_keys;
+  uint32_t num_buckets;
+  uint32_t *pilots; /* One per bucket */
+} PerfectHash;
+
+// Builds a minimal perfect hash mapping keys[0..num_keys) onto [0, num_keys).
+// Returns false if memory could not be allocated.
+bool perfect_hash_build(PerfectHash *perfect_hash, const uint32_t *keys,
+                        uint32_t num_keys);
+
+void perfect_hash_finalize(PerfectHash *perfect_hash);
+
+// splitmix64 finalizer.
+static inline uint64_t perfect_hash_mix64(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ull;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebull;
+  x ^= x >> 31;
+  return x;
+}
+
+// Maps the high 32 bits of x onto [0, range) without a division.
+static inline uint32_t perfect_hash_reduce(uint64_t x, uint32_t range) {
+  return (uint32_t)(((x >> 32) * (uint64_t)range) >> 32);
+}
+
+static inline uint32_t perfect_hash_position(uint64_t key_hash, uint32_t pilot,
+                                             uint64_t seed, uint32_t num_keys) {
+  return perfect_hash_reduce(
+      perfect_hash_mix64(key_hash ^ perfect_hash_mix64(pilot + seed)),
+      num_keys);
+}
+
+// Returns the position of key, which is in [0, num_keys) for every key in the
+// set. Must not be called on an index with no keys.
+static inline uint32_t perfect_hash_lookup(const PerfectHash *perfect_hash,
+                                           uint32_t key) {
+  const uint64_t key_hash = perfect_hash_mix64(key ^ perfect_hash->seed);
+  const uint32_t bucket =
+      perfect_hash_reduce(key_hash, perfect_hash->num_buckets);
+  return perfect_hash_position(key_hash, perfect_hash->pilots[bucket],
+                               perfect_hash->seed, perfect_hash->num_keys);
+}
+
+#endif /* COM_GITHUB_JEFFMANZIONE_INTERN_INTERNAL_PERFECT_HASH_H_ */
@@ -0,0 +1,58 @@
+extern "C" {
+#include "intern/internal/perfect_hash.h"
+}
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace {
+
+// Builds an index over keys and verifies that it maps them onto [0, n)
+// without collisions.
+void ExpectMinimalPerfect(const std::vector<uint32_t> &keys) {
+  PerfectHash perfect_hash;
+  ASSERT_TRUE(perfect_hash_build(&perfect_hash, keys.data(), keys.size()));
+
+  std::vector<bool> seen(keys.size(), false);
+  for (uint32_t key : keys) {
+    const uint32_t position = perfect_hash_lookup(&perfect_hash, key);
+    ASSERT_LT(position, keys.size());
+    ASSERT_FALSE(seen[position]) << "Collision for key " << key;
+    seen[position] = true;
+  }
+
+  perfect_hash_finalize(&perfect_hash);
+}
+
+TEST(PerfectHashTest, Empty) {
+  PerfectHash perfect_hash;
+  ASSERT_TRUE(perfect_hash_build(&perfect_hash, NULL, 0));
+  perfect_hash_finalize(&perfect_hash);
+}
+
+TEST(PerfectHashTest, SingleKey) { ExpectMinimalPerfect({42}); }
+
+TEST(PerfectHashTest, SequentialKeys) {
+  std::vector<uint32_t> keys;
+  for (uint32_t i = 0; i < 1000; ++i) {
+    keys.push_back(i);
+  }
+  ExpectMinimalPerfect(keys);
+}
+
+TEST(PerfectHashTest, ManyKeys) {
+  std::vector<uint32_t> keys;
+  uint32_t key = 1;
+  for (uint32_t i = 0; i < 200000; ++i) {
+    // xorshift32 never repeats within its period.
+    key ^= key << 13;
+    key ^= key >> 17;
+    key ^= key << 5;
+    keys.push_back(key);
+  }
+  ExpectMinimalPerfect(keys);
+}
+
+}  // namespace
@@ -10,4 +10,43 @@
 #define SYSTEM_POSIX
 #endif
 
-#endif /* COM_GITHUB_JEFFMANZIONE_INTERN_INTERNAL_PLATFORM_H_ */
\ No newline at end of file
+// Size in bytes of a cache line on all supported targets.
+#define CACHE_LINE_SIZE 64
+
+// Aligns a struct to a cache line so that adjacent instances written by
+// different threads do not share a line. Place after the struct keyword.
+#if defined(_MSC_VER)
+#define CACHE_ALIGNED __declspec(align(CACHE_LINE_SIZE))
+#else
+#define CACHE_ALIGNED __attribute__((aligned(CACHE_LINE_SIZE)))
+#endif
+
+// Storage class for variables with one instance per thread.
+#if defined(__cplusplus)
+#define THREAD_LOCAL thread_local
+#elif defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL _Thread_local
+#endif
+
+// Alignment requirement in bytes of a type.
+#if defined(__cplusplus)
+#define ALIGN_OF(type) alignof(type)
+#elif defined(_MSC_VER)
+#define ALIGN_OF(type) __alignof(type)
+#else
+#define ALIGN_OF(type) _Alignof(type)
+#endif
+
+// Hints that the cache line holding addr will be read soon. Never faults.
+#if defined(__GNUC__) || defined(__clang__)
+#define PREFETCH(addr) __builtin_prefetch((addr))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#define PREFETCH(addr) _mm_prefetch((const char *)(addr), _MM_HINT_T0)
+#else
+#define PREFETCH(addr) ((void)(addr))
+#endif
+
+#endif /* COM_GITHUB_JEFFMANZIONE_INTERN_INTERNAL_PLATFORM_H_ */
@@ -0,0 +1,164 @@
+#include "intern/internal/snapshot.h"
+
+#include <string.h>
+
+#include "intern/internal/platform.h"
+
+#if defined(SYSTEM_WINDOWS)
+#include <windows.h>
+#elif defined(SYSTEM_POSIX)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool snapshot_writer_open(SnapshotWriter *writer, const char *path) {
+  writer->file = fopen(path, "wb");
+  writer->position = 0;
+  writer->failed = writer->file == NULL;
+  return !writer->failed;
+}
+
+void snapshot_write_at(SnapshotWriter *writer, uint64_t offset,
+                       const void *data, size_t size) {
+  static const char zeros[SNAPSHOT_ALIGNMENT] = {0};
+  if (writer->failed || offset < writer->position) {
+    writer->failed = true;
+    return;
+  }
+  while (writer->position < offset) {
+    uint64_t gap = offset - writer->position;
+    if (gap > sizeof(zeros)) {
+      gap = sizeof(zeros);
+    }
+    if (fwrite(zeros, 1, (size_t)gap, writer->file) != gap) {
+      writer->failed = true;
+      return;
+    }
+    writer->position += gap;
+  }
+  if (size > 0 && fwrite(data, 1, size, writer->file) != size) {
+    writer->failed = true;
+    return;
+  }
+  writer->position += size;
+}
+
+bool snapshot_writer_close(SnapshotWriter *writer) {
+  if (writer->file != NULL && fclose(writer->file) != 0) {
+    writer->failed = true;
+  }
+  writer->file = NULL;
+  return !writer->failed;
+}
+
+#if defined(SYSTEM_WINDOWS)
+bool mapped_file_open(MappedFile *mapped_file, const char *path) {
+  memset(mapped_file, 0, sizeof(MappedFile));
+  HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  LARGE_INTEGER size;
+  HANDLE mapping = NULL;
+  if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  }
+  /* The mapping keeps the file open. */
+  CloseHandle(file);
+  if (mapping == NULL) {
+    return false;
+  }
+  const void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (data == NULL) {
+    CloseHandle(mapping);
+    return false;
+  }
+  mapped_file->data = (const char *)data;
+  mapped_file->size = (size_t)size.QuadPart;
+  mapped_file->handle = mapping;
+  return true;
+}
+
+void mapped_file_close(MappedFile *mapped_file) {
+  if (mapped_file->data == NULL) {
+    return;
+  }
+  UnmapViewOfFile(mapped_file->data);
+  CloseHandle((HANDLE)mapped_file->handle);
+  memset(mapped_file, 0, sizeof(MappedFile));
+}
+#elif defined(SYSTEM_POSIX)
+bool mapped_file_open(MappedFile *mapped_file, const char *path) {
+  memset(mapped_file, 0, sizeof(MappedFile));
+  const int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat file_stat;
+  void *data = MAP_FAILED;
+  if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+    data = mmap(NULL, (size_t)file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  /* The mapping keeps the file open. */
+  close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+  mapped_file->data = (const char *)data;
+  mapped_file->size = (size_t)file_stat.st_size;
+  return true;
+}
+
+void mapped_file_close(MappedFile *mapped_file) {
+  if (mapped_file->data == NULL) {
+    return;
+  }
+  munmap((void *)mapped_file->data, mapped_file->size);
+  memset(mapped_file, 0, sizeof(MappedFile));
+}
+#else
+bool mapped_file_open(MappedFile *mapped_file, const char *path) {
+  /* Memory mapping is not supported on unknown platforms. */
+  memset(mapped_file, 0, sizeof(MappedFile));
+  return false;
+}
+
+void mapped_file_close(MappedFile *mapped_file) {}
+#endif
+
+/* True if the section [offset, offset + count * element_size) is aligned and
+ * lies within a file of file_size bytes. */
+static bool section_valid(uint64_t offset, uint64_t count,
+                          uint64_t element_size, uint64_t file_size) {
+  return offset % SNAPSHOT_ALIGNMENT == 0 && offset <= file_size &&
+         count * element_size <= file_size - offset;
+}
+
+bool snapshot_header_valid(const MappedFile *mapped_file,
+                           uint32_t value_type_size, uint32_t hash_mix_check,
+                           uint32_t slot_size) {
+  if (mapped_file->size < sizeof(SnapshotHeader)) {
+    return false;
+  }
+  const SnapshotHeader *header = (const SnapshotHeader *)mapped_file->data;
+  return header->magic == SNAPSHOT_MAGIC &&
+         header->version == SNAPSHOT_VERSION &&
+         header->value_type_size == value_type_size &&
+         header->hash_mix_check == hash_mix_check &&
+         header->slot_size == slot_size &&
+         header->size == mapped_file->size &&
+         header->num_keys + (uint64_t)header->num_overflow <=
+             header->num_values &&
+         header->num_buckets > 0 &&
+         section_valid(header->ids_offset, header->num_values,
+                       sizeof(SnapshotId), header->size) &&
+         section_valid(header->pilots_offset, header->num_buckets,
+                       sizeof(uint32_t), header->size) &&
+         section_valid(header->slots_offset, header->num_keys, slot_size,
+                       header->size) &&
+         section_valid(header->overflow_offset, header->num_overflow,
+                       slot_size, header->size);
+}
@@ -0,0 +1,107 @@
+#ifndef COM_GITHUB_JEFFMANZIONE_INTERN_INTERNAL_SNAPSHOT_H_
+#define COM_GITHUB_JEFFMANZIONE_INTERN_INTERNAL_SNAPSHOT_H_
+
+/**
+ * @file snapshot.h
+ * @brief On-disk format and file I/O for intern pool snapshots.
+ *
+ * A snapshot is a single file that is mapped read-only and used in place:
+ *
+ *   SnapshotHeader
+ *   SnapshotId[num_values]            Value offset and size, indexed by ID
+ *   uint32_t[num_buckets]             Perfect hash pilots
+ *   slot[num_keys]                    Perfect hash slots (ID and table hash)
+ *   slot[num_overflow]                Slots whose table hash is not unique
+ *   values                            ID header + bytes, as in pool chunks
+ *
+ * Every section starts at an offset aligned to SNAPSHOT_ALIGNMENT, and all
+ * references are byte offsets from the start of the file, so the mapping may
+ * be placed at any address. Integers are stored in host byte order; a file
+ * written on a host of the other endianness fails the magic check.
+ *
+ * Usage assumptions:
+ *   - Snapshots are trusted input. Headers are validated, but value offsets
+ *     are not checked when the file is opened.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// "INTNSNAP" read as a host-order integer.
+#define SNAPSHOT_MAGIC 0x50414e534e544e49ull
+#define SNAPSHOT_VERSION 1
+
+// Alignment of every section of a snapshot.
+#define SNAPSHOT_ALIGNMENT 64
+
+// Rounds offset up to a multiple of alignment, which must be a power of 2.
+#define SNAPSHOT_ALIGN_UP(offset, alignment) \
+  (((offset) + (alignment)-1) & ~((uint64_t)(alignment)-1))
+
+typedef struct {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t value_type_size;
+  /* MIX_HASH(1) of the writer, since table hashes depend on build flags */
+  uint32_t hash_mix_check;
+  uint32_t num_values; /* Number of IDs, including released ones */
+  uint32_t num_keys;
+  uint32_t num_buckets;
+  uint32_t num_overflow;
+  uint32_t slot_size;
+  uint64_t seed;
+  uint64_t ids_offset;
+  uint64_t pilots_offset;
+  uint64_t slots_offset;
+  uint64_t overflow_offset;
+  uint64_t size; /* Size of the whole file */
+} SnapshotHeader;
+
+typedef struct {
+  uint64_t offset; /* Of the value, past its ID header. 0 if released */
+  uint32_t value_size;
+  uint32_t reserved;
+} SnapshotId;
+
+/* Writing */
+
+typedef struct {
+  FILE *file;
+  uint64_t position;
+  bool failed;
+} SnapshotWriter;
+
+bool snapshot_writer_open(SnapshotWriter *writer, const char *path);
+
+// Writes size bytes of data at offset, zero-filling any gap since the previous
+// write. offset must not be behind the end of the previous write. Errors are
+// reported by snapshot_writer_close().
+void snapshot_write_at(SnapshotWriter *writer, uint64_t offset,
+                       const void *data, size_t size);
+
+// Closes the file. Returns false if any write failed.
+bool snapshot_writer_close(SnapshotWriter *writer);
+
+/* Reading */
+
+typedef struct {
+  const char *data; /* NULL if nothing is mapped */
+  size_t size;
+  void *handle; /* Mapping handle on Windows */
+} MappedFile;
+
+// Maps path read-only. Returns false if it could not be opened or mapped.
+bool mapped_file_open(MappedFile *mapped_file, const char *path);
+
+void mapped_file_close(MappedFile *mapped_file);
+
+// Returns true if the header at the start of mapped_file describes a snapshot
+// written for values of value_type_size bytes and slots of slot_size bytes,
+// and every section lies within the file.
+bool snapshot_header_valid(const MappedFile *mapped_file,
+                           uint32_t value_type_size, uint32_t hash_mix_check,
+                           uint32_t slot_size);
+
+#endif /* COM_GITHUB_JEFFMANZIONE_INTERN_INTERNAL_SNAPSHOT_H_ */
@@ -0,0 +1,75 @@
+#include "intern/internal/stats.h"
+
+#include <string.h>
+
+#if defined(SYSTEM_WINDOWS)
+#include <windows.h>
+#elif defined(SYSTEM_POSIX)
+#include <time.h>
+#endif
+
+/* Stripe of a thread that has not counted anything yet */
+#define STATS_NO_STRIPE UINT32_MAX
+
+static uint64_t next_stripe = 0;
+static THREAD_LOCAL uint32_t thread_stripe = STATS_NO_STRIPE;
+
+void striped_counters_init(StripedCounters *counters) {
+  memset(counters, 0, sizeof(StripedCounters));
+}
+
+uint32_t stats_thread_stripe(void) {
+  if (thread_stripe == STATS_NO_STRIPE) {
+    /* Round-robin, so the first STATS_NUM_STRIPES threads never share */
+    thread_stripe =
+        (uint32_t)(ATOMIC_FETCH_ADD_U64(&next_stripe, 1) % STATS_NUM_STRIPES);
+  }
+  return thread_stripe;
+}
+
+#if defined(SYSTEM_WINDOWS)
+uint64_t stats_now_ns(void) {
+  static LARGE_INTEGER frequency;
+  LARGE_INTEGER now;
+  if (frequency.QuadPart == 0) {
+    QueryPerformanceFrequency(&frequency);
+  }
+  QueryPerformanceCounter(&now);
+  return (uint64_t)(now.QuadPart / frequency.QuadPart) * 1000000000ull +
+         (uint64_t)(now.QuadPart % frequency.QuadPart) * 1000000000ull /
+             (uint64_t)frequency.QuadPart;
+}
+#elif defined(SYSTEM_POSIX)
+uint64_t stats_now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+#else
+uint64_t stats_now_ns(void) {
+  /* Timing is not supported on unknown platforms. */
+  return 0;
+}
+#endif
+
+uint64_t striped_counters_sum(const StripedCounters *counters,
+                              uint32_t counter) {
+  uint64_t sum = 0;
+  for (uint32_t i = 0; i < STATS_NUM_STRIPES; ++i) {
+    sum += ATOMIC_LOAD_RELAXED(&counters->stripes[i].counters[counter]);
+  }
+  return sum;
+}
+
+uint64_t striped_counters_max_of(const StripedCounters *counters,
+                                 uint32_t counter) {
+  uint64_t max = 0;
+  for (uint32_t i = 0; i < STATS_NUM_STRIPES; ++i) {
+    const uint64_t value =
+        ATOMIC_LOAD_RELAXED(&counters->stripes[i].counters[counter]);
+    if (value > max) {
+      max = value;
+    }
+  }
+  return max;
+}
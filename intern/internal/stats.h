@@ -0,0 +1,70 @@
+#ifndef COM_GITHUB_JEFFMANZIONE_INTERN_INTERNAL_STATS_H_
+#define COM_GITHUB_JEFFMANZIONE_INTERN_INTERNAL_STATS_H_
+
+/**
+ * @file stats.h
+ * @brief Low-contention counters for builds with INTERN_ENABLE_STATS.
+ *
+ * Each counter is spread over STATS_NUM_STRIPES stripes of one cache line.
+ * A thread is assigned a stripe on first use and only updates that stripe,
+ * with relaxed atomics, so threads counting concurrently rarely write the same
+ * line. Reading a counter combines its stripes.
+ *
+ * Usage assumptions:
+ *   - A set of counters holds at most STATS_COUNTERS_PER_STRIPE counters.
+ *   - Reads are not synchronized with updates, so a value read while other
+ *     threads are counting is approximate.
+ */
+
+#include <stdint.h>
+
+#include "intern/internal/atomics.h"
+#include "intern/internal/platform.h"
+
+// Number of stripes per set of counters. More threads than stripes share them.
+#define STATS_NUM_STRIPES 8
+
+#define STATS_COUNTERS_PER_STRIPE (CACHE_LINE_SIZE / sizeof(uint64_t))
+
+typedef struct {
+  uint64_t counters[STATS_COUNTERS_PER_STRIPE];
+} StatsStripe;
+
+typedef struct {
+  StatsStripe stripes[STATS_NUM_STRIPES];
+} StripedCounters;
+
+void striped_counters_init(StripedCounters *counters);
+
+// Returns the stripe assigned to the calling thread.
+uint32_t stats_thread_stripe(void);
+
+// Returns a monotonic timestamp in nanoseconds.
+uint64_t stats_now_ns(void);
+
+// Returns the sum of counter over all stripes.
+uint64_t striped_counters_sum(const StripedCounters *counters,
+                              uint32_t counter);
+
+// Returns the largest value of counter over all stripes, for counters updated
+// with striped_counters_max().
+uint64_t striped_counters_max_of(const StripedCounters *counters,
+                                 uint32_t counter);
+
+static inline void striped_counters_add(StripedCounters *counters,
+                                        uint32_t counter, uint64_t n) {
+  ATOMIC_ADD_RELAXED_U64(
+      &counters->stripes[stats_thread_stripe()].counters[counter], n);
+}
+
+// Raises counter to value if it is larger. Threads sharing a stripe may race,
+// in which case the smaller value can win.
+static inline void striped_counters_max(StripedCounters *counters,
+                                        uint32_t counter, uint64_t value) {
+  uint64_t *max = &counters->stripes[stats_thread_stripe()].counters[counter];
+  if (value > ATOMIC_LOAD_RELAXED(max)) {
+    ATOMIC_STORE_RELAXED(max, value);
+  }
+}
+
+#endif /* COM_GITHUB_JEFFMANZIONE_INTERN_INTERNAL_STATS_H_ */
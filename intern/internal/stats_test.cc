@@ -0,0 +1,55 @@
+extern "C" {
+#include "intern/internal/stats.h"
+}
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+namespace {
+
+enum { COUNT, MAX };
+
+TEST(StatsTest, AddAndMax) {
+  StripedCounters counters;
+  striped_counters_init(&counters);
+  EXPECT_EQ(0, striped_counters_sum(&counters, COUNT));
+
+  striped_counters_add(&counters, COUNT, 3);
+  striped_counters_add(&counters, COUNT, 4);
+  striped_counters_max(&counters, MAX, 5);
+  striped_counters_max(&counters, MAX, 2);
+  EXPECT_EQ(7, striped_counters_sum(&counters, COUNT));
+  EXPECT_EQ(5, striped_counters_max_of(&counters, MAX));
+}
+
+TEST(StatsTest, CountsFromManyThreads) {
+  StripedCounters counters;
+  striped_counters_init(&counters);
+
+  // More threads than stripes, so some share a stripe.
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 2 * STATS_NUM_STRIPES; ++t) {
+    threads.emplace_back([&counters, t]() {
+      for (int i = 0; i < 10000; ++i) {
+        striped_counters_add(&counters, COUNT, 1);
+      }
+      striped_counters_max(&counters, MAX, t);
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(2 * STATS_NUM_STRIPES * 10000,
+            striped_counters_sum(&counters, COUNT));
+  EXPECT_LE(striped_counters_max_of(&counters, MAX), 2 * STATS_NUM_STRIPES - 1);
+}
+
+TEST(StatsTest, ClockIsMonotonic) {
+  const uint64_t start = stats_now_ns();
+  EXPECT_GE(stats_now_ns(), start);
+}
+
+}  // namespace
@@ -0,0 +1,143 @@
+#ifndef COM_GITHUB_JEFFMANZIONE_INTERN_INTERNAL_STRING_HASH_H_
+#define COM_GITHUB_JEFFMANZIONE_INTERN_INTERNAL_STRING_HASH_H_
+
+/**
+ * @file string_hash.h
+ * @brief Fast hash and comparison of byte strings.
+ *
+ * The hash follows wyhash (final version 4): the input is consumed 16 bytes
+ * (48 bytes for long inputs, in three independent lanes) per step, and each
+ * step folds two 64-bit words with one 64x64->128-bit multiply. Inputs of up
+ * to 16 bytes take one or two unaligned loads and a single multiply, with no
+ * loop. One wide multiply mixes more state per cycle than SSE2 or AVX2 lanes,
+ * which lack a 64-bit multiply-high, so no vector path is needed.
+ *
+ * Usage assumptions:
+ *   - Hashes are only stable on hosts of the same byte order.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#pragma intrinsic(_umul128)
+#endif
+
+#define STRING_HASH_SECRET0 0x2d358dccaa6c78a5ull
+#define STRING_HASH_SECRET1 0x8bb84b93962eacc9ull
+#define STRING_HASH_SECRET2 0x4b33a62ed433d4a3ull
+#define STRING_HASH_SECRET3 0x4d5a2da51de1aa47ull
+
+// Multiplies a and b into a 128-bit product, and replaces a with its low and b
+// with its high 64 bits.
+static inline void string_hash_mum(uint64_t *a, uint64_t *b) {
+#if defined(__SIZEOF_INT128__)
+  const __uint128_t product = (__uint128_t)*a * *b;
+  *a = (uint64_t)product;
+  *b = (uint64_t)(product >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+  *a = _umul128(*a, *b, b);
+#else
+  const uint64_t ha = *a >> 32, hb = *b >> 32;
+  const uint64_t la = (uint32_t)*a, lb = (uint32_t)*b;
+  const uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  const uint64_t t = rl + (rm0 << 32);
+  uint64_t lo = t + (rm1 << 32);
+  uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + (t < rl) + (lo < t);
+  *a = lo;
+  *b = hi;
+#endif
+}
+
+// Folds the 128-bit product of a and b into 64 bits.
+static inline uint64_t string_hash_mix(uint64_t a, uint64_t b) {
+  string_hash_mum(&a, &b);
+  return a ^ b;
+}
+
+static inline uint64_t string_hash_read64(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint64_t string_hash_read32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+// Reads 1 to 3 bytes, covering the first, middle and last byte.
+static inline uint64_t string_hash_read_small(const uint8_t *p, uint32_t size) {
+  return ((uint64_t)p[0] << 16) | ((uint64_t)p[size >> 1] << 8) | p[size - 1];
+}
+
+// Returns the hash of the size bytes at str.
+static inline uint32_t string_hash(const char *str, uint32_t size) {
+  const uint8_t *p = (const uint8_t *)str;
+  uint64_t seed = string_hash_mix(STRING_HASH_SECRET0, STRING_HASH_SECRET1);
+  uint64_t a, b;
+  if (size <= 16) {
+    if (size >= 4) {
+      // Two overlapping pairs of 4-byte reads cover every byte.
+      const uint32_t offset = (size >> 3) << 2;
+      a = (string_hash_read32(p) << 32) | string_hash_read32(p + offset);
+      b = (string_hash_read32(p + size - 4) << 32) |
+          string_hash_read32(p + size - 4 - offset);
+    } else if (size > 0) {
+      a = string_hash_read_small(p, size);
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    uint32_t remaining = size;
+    if (remaining > 48) {
+      uint64_t seed1 = seed, seed2 = seed;
+      do {
+        seed = string_hash_mix(string_hash_read64(p) ^ STRING_HASH_SECRET1,
+                               string_hash_read64(p + 8) ^ seed);
+        seed1 = string_hash_mix(
+            string_hash_read64(p + 16) ^ STRING_HASH_SECRET2,
+            string_hash_read64(p + 24) ^ seed1);
+        seed2 = string_hash_mix(
+            string_hash_read64(p + 32) ^ STRING_HASH_SECRET3,
+            string_hash_read64(p + 40) ^ seed2);
+        p += 48;
+        remaining -= 48;
+      } while (remaining > 48);
+      seed ^= seed1 ^ seed2;
+    }
+    while (remaining > 16) {
+      seed = string_hash_mix(string_hash_read64(p) ^ STRING_HASH_SECRET1,
+                             string_hash_read64(p + 8) ^ seed);
+      p += 16;
+      remaining -= 16;
+    }
+    // The last 16 bytes, which may overlap bytes already consumed.
+    a = string_hash_read64(p + remaining - 16);
+    b = string_hash_read64(p + remaining - 8);
+  }
+  a ^= STRING_HASH_SECRET1;
+  b ^= seed;
+  string_hash_mum(&a, &b);
+  const uint64_t hash =
+      string_hash_mix(a ^ STRING_HASH_SECRET0 ^ size, b ^ STRING_HASH_SECRET1);
+  return (uint32_t)(hash ^ (hash >> 32));
+}
+
+// Orders strings by size first, so strings of different sizes are told apart
+// without reading them.
+static inline int32_t string_compare(const char *str1, uint32_t size1,
+                                     const char *str2, uint32_t size2) {
+  if (size1 != size2) {
+    return size1 < size2 ? -1 : 1;
+  }
+  if (str1 == str2) {
+    return 0;
+  }
+  return memcmp(str1, str2, size1);
+}
+
+#endif /* COM_GITHUB_JEFFMANZIONE_INTERN_INTERNAL_STRING_HASH_H_ */
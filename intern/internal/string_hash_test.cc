@@ -0,0 +1,74 @@
+extern "C" {
+#include "intern/internal/string_hash.h"
+}
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Hashes a copy of str in an allocation of exactly its size, so that reads
+// past its end are caught by the address sanitizer.
+uint32_t HashExact(const std::string &str) {
+  std::unique_ptr<char[]> copy(new char[str.size()]);
+  memcpy(copy.get(), str.data(), str.size());
+  return string_hash(copy.get(), (uint32_t)str.size());
+}
+
+TEST(StringHashTest, DependsOnlyOnBytes) {
+  const std::string str = "the quick brown fox jumps over the lazy dog";
+  for (size_t size = 0; size <= str.size(); ++size) {
+    const std::string prefix = str.substr(0, size);
+    EXPECT_EQ(string_hash(str.data(), (uint32_t)size), HashExact(prefix));
+  }
+}
+
+TEST(StringHashTest, EveryByteAffectsHash) {
+  // Covers the short, 16-byte and 48-byte paths and their boundaries.
+  for (size_t size = 1; size <= 200; ++size) {
+    std::string str(size, 'a');
+    const uint32_t hash = HashExact(str);
+    for (size_t i = 0; i < size; ++i) {
+      str[i] = 'b';
+      EXPECT_NE(hash, HashExact(str)) << "size " << size << ", byte " << i;
+      str[i] = 'a';
+    }
+  }
+}
+
+TEST(StringHashTest, SizeAffectsHash) {
+  std::set<uint32_t> hashes;
+  for (size_t size = 0; size <= 200; ++size) {
+    hashes.insert(HashExact(std::string(size, '\0')));
+  }
+  EXPECT_EQ(201, hashes.size());
+}
+
+TEST(StringHashTest, LowBitsAreUniform) {
+  // Tables index with the low bits, so sequential keys must spread over them.
+  constexpr int kNumKeys = 1 << 16;
+  constexpr int kNumBuckets = 1 << 8;
+  std::vector<int> counts(kNumBuckets);
+  for (int i = 0; i < kNumKeys; ++i) {
+    counts[HashExact("key" + std::to_string(i)) % kNumBuckets]++;
+  }
+  for (int count : counts) {
+    EXPECT_GT(count, kNumKeys / kNumBuckets / 2);
+    EXPECT_LT(count, kNumKeys / kNumBuckets * 2);
+  }
+}
+
+TEST(StringCompareTest, OrdersBySizeFirst) {
+  EXPECT_EQ(0, string_compare("cat", 3, "cat", 3));
+  EXPECT_LT(string_compare("zz", 2, "aaa", 3), 0);
+  EXPECT_GT(string_compare("aaa", 3, "zz", 2), 0);
+  EXPECT_LT(string_compare("cat", 3, "hat", 3), 0);
+  // Strings of different sizes are never read.
+  EXPECT_NE(0, string_compare(nullptr, 1, nullptr, 2));
+}
+
+}  // namespace
@@ -0,0 +1,9 @@
+#include "intern/internal/thread_cache.h"
+
+#include "intern/internal/atomics.h"
+
+static uint64_t last_owner = THREAD_CACHE_NO_OWNER;
+
+uint64_t thread_cache_new_owner(void) {
+  return ATOMIC_FETCH_ADD_U64(&last_owner, 1) + 1;
+}
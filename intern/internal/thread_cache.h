@@ -0,0 +1,25 @@
+#ifndef COM_GITHUB_JEFFMANZIONE_INTERN_INTERNAL_THREAD_CACHE_H_
+#define COM_GITHUB_JEFFMANZIONE_INTERN_INTERNAL_THREAD_CACHE_H_
+
+/**
+ * @file thread_cache.h
+ * @brief Owner tags for per-thread caches of interned values.
+ *
+ * With INTERN_THREAD_CACHE, each thread keeps a small direct-mapped cache of
+ * recently interned values in front of a pool's hash set (see intern.h). One
+ * cache is shared by every pool of a type, so each entry is tagged with the
+ * owner ID of the pool that filled it. Owner IDs are never reused, so entries
+ * left behind in other threads by a finalized pool can never match again and
+ * their dangling pointers are never followed.
+ */
+
+#include <stdint.h>
+
+// Owner ID of no pool. Marks unused cache entries.
+#define THREAD_CACHE_NO_OWNER 0
+
+// Returns an owner ID that has not been returned before. Never returns
+// THREAD_CACHE_NO_OWNER.
+uint64_t thread_cache_new_owner(void);
+
+#endif /* COM_GITHUB_JEFFMANZIONE_INTERN_INTERNAL_THREAD_CACHE_H_ */
@@ -0,0 +1,38 @@
+extern "C" {
+#include "intern/internal/thread_cache.h"
+}
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace {
+
+TEST(ThreadCacheTest, OwnersAreNeverReused) {
+  constexpr int kNumThreads = 8;
+  constexpr int kOwnersPerThread = 10000;
+  std::vector<std::vector<uint64_t>> owners(kNumThreads);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; ++t) {
+    threads.emplace_back([&owners, t]() {
+      for (int i = 0; i < kOwnersPerThread; ++i) {
+        owners[t].push_back(thread_cache_new_owner());
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  std::vector<uint64_t> all;
+  for (const std::vector<uint64_t> &thread_owners : owners) {
+    all.insert(all.end(), thread_owners.begin(), thread_owners.end());
+  }
+  std::sort(all.begin(), all.end());
+  EXPECT_EQ(all.end(), std::adjacent_find(all.begin(), all.end()));
+  EXPECT_NE(THREAD_CACHE_NO_OWNER, all.front());
+}
+
+}  // namespace
@@ -0,0 +1,190 @@
+#ifndef COM_GITHUB_JEFFMANZIONE_INTERN_SHARDED_INTERN_H_
+#define COM_GITHUB_JEFFMANZIONE_INTERN_SHARDED_INTERN_H_
+
+/**
+ * @file sharded_intern.h
+ * @brief Intern pool split into independently locked shards.
+ *
+ * Each shard is a complete intern pool (hash set, chunk chain, allocation
+ * cursor and RWLock). A value is routed to a shard by a separately seeded mix
+ * of its hash, so threads interning unrelated values rarely touch the same lock
+ * or chunk. Equal values always hash to the same shard, so pointer equality of
+ * interned values is preserved across the whole pool.
+ *
+ * Usage:
+ *    DEFINE_SHARDED_INTERN_POOL(MyStrings, char, 4)
+ *    IMPL_SHARDED_INTERN_POOL(MyStrings, char, 4)
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "intern/intern.h"
+#include "intern/internal/platform.h"
+
+// A reasonable number of shard bits (16 shards) for most multi-core hosts.
+#define DEFAULT_NUM_SHARD_BITS 4
+
+// Seeds the mix that selects shards, so that it is independent of the mix
+// done by each shard's hash set.
+#define SHARD_HASH_SEED 0x9E3779B9u
+
+// Selects the shard for a hash value using the low bits of a separately seeded
+// mix. User hashes whose bits barely vary still spread over every shard, and
+// all bits of the mix the shard's hash set computes from the unmixed hash keep
+// varying within a shard, including the high bits of control byte fragments.
+#define LOOKUP_SHARD_POSITION(hval, num_shard_bits) \
+  (mix_hash32((hval) ^ SHARD_HASH_SEED) & ((1u << (num_shard_bits)) - 1))
+
+/**
+ * DEFINE_SHARDED_INTERN_POOL(name, value_type, num_shard_bits)
+ *
+ * Generates:
+ *   - An intern pool type name##Shard used for each shard
+ *   - Sharded pool struct containing:
+ *       hash function used for shard selection
+ *       1 << num_shard_bits cache-line aligned shards
+ *   - Functions:
+ *       name_init, name_init_with_capacity, name_finalize, name_intern,
+ *       name_intern_prehashed, name_lookup, name_freeze
+ *
+ * num_shard_bits must be in [1, 16].
+ */
+#define DEFINE_SHARDED_INTERN_POOL(name, value_type, num_shard_bits)   \
+  DEFINE_INTERN_POOL(name##Shard, value_type);                         \
+                                                                       \
+  typedef name##ShardHashFn name##HashFn;                              \
+  typedef name##ShardCompareFn name##CompareFn;                        \
+                                                                       \
+  /* Padded so that no two shards share a cache line. */               \
+  typedef struct CACHE_ALIGNED {                                       \
+    name##Shard pool;                                                  \
+  } name##ShardSlot;                                                   \
+                                                                       \
+  typedef struct {                                                     \
+    name##HashFn hash;                                                 \
+    name##ShardSlot shards[1 << (num_shard_bits)];                     \
+  } name;                                                              \
+                                                                       \
+  void name##_init(name *pool, bool threadsafe, name##HashFn hash,     \
+                   name##CompareFn compare);                           \
+  /* Presizes each shard for an even share of the expected values */   \
+  void name##_init_with_capacity(                                      \
+      name *pool, uint32_t expected_values, uint64_t expected_bytes,   \
+      bool threadsafe, name##HashFn hash, name##CompareFn compare);    \
+  void name##_finalize(name *pool);                                    \
+  const value_type *name##_intern(name *pool, const value_type *value, \
+                                  uint32_t value_size);                \
+  const value_type *name##_intern_prehashed(                           \
+      name *pool, const value_type *value, uint32_t value_size,        \
+      uint32_t hash);                                                  \
+  const value_type *name##_lookup(name *pool, const value_type *value, \
+                                  uint32_t value_size);                \
+  bool name##_freeze(name *pool);
+
+/**
+ * IMPL_SHARDED_INTERN_POOL(name, value_type, num_shard_bits)
+ *
+ * Defines functions generated by DEFINE_SHARDED_INTERN_POOL. num_shard_bits
+ * must match the value given to DEFINE_SHARDED_INTERN_POOL.
+ */
+#define IMPL_SHARDED_INTERN_POOL(name, value_type, num_shard_bits)     \
+  IMPL_INTERN_POOL(name##Shard, value_type);                           \
+  IMPL_SHARDED_INTERN_POOL_FUNCTIONS(name, value_type, num_shard_bits, \
+                                     pool->hash)
+
+/**
+ * IMPL_SHARDED_INTERN_POOL_INLINE(name, value_type, num_shard_bits, hash_fn,
+ *                                 compare_fn)
+ *
+ * Like IMPL_SHARDED_INTERN_POOL, but binds hash_fn and compare_fn at expansion
+ * time (see IMPL_INTERN_POOL_INLINE).
+ */
+#define IMPL_SHARDED_INTERN_POOL_INLINE(name, value_type, num_shard_bits, \
+                                        hash_fn, compare_fn)              \
+  IMPL_INTERN_POOL_INLINE(name##Shard, value_type, hash_fn, compare_fn);  \
+  IMPL_SHARDED_INTERN_POOL_FUNCTIONS(name, value_type, num_shard_bits,    \
+                                     hash_fn)
+
+/**
+ * IMPL_SHARDED_INTERN_POOL_FUNCTIONS(name, value_type, num_shard_bits, hash_fn)
+ *
+ * Pool functions shared by IMPL_SHARDED_INTERN_POOL and
+ * IMPL_SHARDED_INTERN_POOL_INLINE.
+ */
+#define IMPL_SHARDED_INTERN_POOL_FUNCTIONS(name, value_type, num_shard_bits, \
+                                           hash_fn)                          \
+  void name##_init(name *pool, bool threadsafe, name##HashFn hash,           \
+                   name##CompareFn compare) {                                \
+    pool->hash = hash;                                                       \
+    for (uint32_t i = 0; i < (1u << (num_shard_bits)); ++i) {                \
+      name##Shard_init(&pool->shards[i].pool, threadsafe, hash, compare);    \
+    }                                                                        \
+  }                                                                          \
+                                                                             \
+  void name##_init_with_capacity(                                            \
+      name *pool, uint32_t expected_values, uint64_t expected_bytes,         \
+      bool threadsafe, name##HashFn hash, name##CompareFn compare) {         \
+    pool->hash = hash;                                                       \
+    /* Rounded up, so that an even split fits without growing */             \
+    const uint32_t num_shards = 1u << (num_shard_bits);                      \
+    const uint32_t shard_values = (uint32_t)(                                \
+        ((uint64_t)expected_values + num_shards - 1) / num_shards);          \
+    const uint64_t shard_bytes =                                             \
+        (expected_bytes + num_shards - 1) / num_shards;                      \
+    for (uint32_t i = 0; i < (1u << (num_shard_bits)); ++i) {                \
+      name##Shard_init_with_capacity(&pool->shards[i].pool, shard_values,    \
+                                     shard_bytes, threadsafe, hash,          \
+                                     compare);                               \
+    }                                                                        \
+  }                                                                          \
+                                                                             \
+  void name##_finalize(name *pool) {                                         \
+    for (uint32_t i = 0; i < (1u << (num_shard_bits)); ++i) {                \
+      name##Shard_finalize(&pool->shards[i].pool);                           \
+    }                                                                        \
+  }                                                                          \
+                                                                             \
+  /* The hash selects the shard and is reused by the shard's hash set */     \
+  const value_type *name##_intern_prehashed(name *pool,                      \
+                                            const value_type *value,         \
+                                            uint32_t value_size,             \
+                                            uint32_t hash) {                 \
+    const uint32_t shard_position =                                          \
+        LOOKUP_SHARD_POSITION(hash, num_shard_bits);                         \
+    return name##Shard_intern_prehashed(&pool->shards[shard_position].pool,  \
+                                        value, value_size, hash);            \
+  }                                                                          \
+                                                                             \
+  const value_type *name##_intern(name *pool, const value_type *value,       \
+                                  uint32_t value_size) {                     \
+    return name##_intern_prehashed(pool, value, value_size,                  \
+                                   hash_fn(value, value_size));              \
+  }                                                                          \
+                                                                             \
+  const value_type *name##_lookup(name *pool, const value_type *value,       \
+                                  uint32_t value_size) {                     \
+    const uint32_t hash = hash_fn(value, value_size);                        \
+    const uint32_t shard_position =                                          \
+        LOOKUP_SHARD_POSITION(hash, num_shard_bits);                         \
+    return name##Shard_lookup_hashed(&pool->shards[shard_position].pool,     \
+                                     value, value_size, MIX_HASH(hash));     \
+  }                                                                          \
+                                                                             \
+  /* Freezes every shard. Returns false if any shard could not be frozen */  \
+  bool name##_freeze(name *pool) {                                           \
+    bool frozen = true;                                                      \
+    for (uint32_t i = 0; i < (1u << (num_shard_bits)); ++i) {                \
+      frozen &= name##Shard_freeze(&pool->shards[i].pool);                   \
+    }                                                                        \
+    return frozen;                                                           \
+  }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COM_GITHUB_JEFFMANZIONE_INTERN_SHARDED_INTERN_H_ */
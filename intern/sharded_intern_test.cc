@@ -0,0 +1,256 @@
+#include "intern/sharded_intern.h"
+
+#include <gmock/gmock-matchers.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using namespace testing;
+
+DEFINE_SHARDED_INTERN_POOL(ShardedStringInternPool, char,
+                           DEFAULT_NUM_SHARD_BITS);
+IMPL_SHARDED_INTERN_POOL(ShardedStringInternPool, char,
+                         DEFAULT_NUM_SHARD_BITS);
+
+// https://en.wikipedia.org/wiki/Fowler%E2%80%93Noll%E2%80%93Vo_hash_function
+#define FNV_32_PRIME (0x01000193)
+#define FNV_1A_32_OFFSET (0x811C9DC5)
+
+uint32_t hash_string(const char *ptr, uint32_t size) {
+  unsigned char *s = (unsigned char *)ptr;
+  uint32_t hval = FNV_1A_32_OFFSET;
+  for (uint32_t i = 0; i < size; ++i) {
+    hval *= FNV_32_PRIME;
+    hval ^= (uint32_t)*s++;
+  }
+  return hval;
+}
+
+int32_t compare_strings(const char *ptr1, uint32_t size1, const char *ptr2,
+                        uint32_t size2) {
+  if (size1 != size2) {
+    return (int32_t)size1 - (int32_t)size2;
+  }
+  return memcmp(ptr1, ptr2, size1);
+}
+
+DEFINE_SHARDED_INTERN_POOL(InlineShardedStringInternPool, char, 2);
+IMPL_SHARDED_INTERN_POOL_INLINE(InlineShardedStringInternPool, char, 2,
+                                hash_string, compare_strings);
+
+DEFINE_SHARDED_INTERN_POOL(ShardedInt32InternPool, int32_t,
+                           DEFAULT_NUM_SHARD_BITS);
+IMPL_SHARDED_INTERN_POOL(ShardedInt32InternPool, int32_t,
+                         DEFAULT_NUM_SHARD_BITS);
+
+uint32_t hash_int32(const int32_t *num, uint32_t size) { return *num; }
+
+int32_t compare_int32s(const int32_t *num1, uint32_t size1,
+                       const int32_t *num2, uint32_t size2) {
+  return (*num1 > *num2) - (*num1 < *num2);
+}
+
+class ShardedStringInternPoolTest : public Test {
+ protected:
+  ShardedStringInternPoolTest() {
+    ShardedStringInternPool_init(&intern_pool, /*threadsafe=*/true,
+                                 hash_string, compare_strings);
+  }
+  ~ShardedStringInternPoolTest() {
+    ShardedStringInternPool_finalize(&intern_pool);
+  }
+  ShardedStringInternPool intern_pool;
+};
+
+TEST_F(ShardedStringInternPoolTest, Init) {
+  // Just test setup/teardown.
+}
+
+TEST_F(ShardedStringInternPoolTest, InternPoolN) {
+  // Insert
+  const char *cat =
+      ShardedStringInternPool_intern(&intern_pool, "cat", sizeof("cat"));
+  const char *in =
+      ShardedStringInternPool_intern(&intern_pool, "in", sizeof("in"));
+  const char *the =
+      ShardedStringInternPool_intern(&intern_pool, "the", sizeof("the"));
+  const char *hat =
+      ShardedStringInternPool_intern(&intern_pool, "hat", sizeof("hat"));
+
+  // Verify it returns same string
+  ASSERT_THAT(cat, NotNull());
+  ASSERT_THAT(in, NotNull());
+  ASSERT_THAT(the, NotNull());
+  ASSERT_THAT(hat, NotNull());
+  ASSERT_STREQ("cat", cat);
+
+  // Verify uniqueness of equivalent strings
+  ASSERT_EQ(cat,
+            ShardedStringInternPool_intern(&intern_pool, "cat", sizeof("cat")));
+  ASSERT_EQ(in,
+            ShardedStringInternPool_intern(&intern_pool, "in", sizeof("in")));
+  ASSERT_EQ(the,
+            ShardedStringInternPool_intern(&intern_pool, "the", sizeof("the")));
+  ASSERT_EQ(hat,
+            ShardedStringInternPool_intern(&intern_pool, "hat", sizeof("hat")));
+}
+
+TEST_F(ShardedStringInternPoolTest, InternPrehashed) {
+  const char *cat = ShardedStringInternPool_intern_prehashed(
+      &intern_pool, "cat", sizeof("cat"), hash_string("cat", sizeof("cat")));
+
+  ASSERT_STREQ("cat", cat);
+  ASSERT_EQ(cat,
+            ShardedStringInternPool_intern(&intern_pool, "cat", sizeof("cat")));
+  ASSERT_EQ(cat, ShardedStringInternPool_intern_prehashed(
+                     &intern_pool, "cat", sizeof("cat"),
+                     hash_string("cat", sizeof("cat"))));
+}
+
+TEST_F(ShardedStringInternPoolTest, Lookup) {
+  const char *cat =
+      ShardedStringInternPool_intern(&intern_pool, "cat", sizeof("cat"));
+
+  ASSERT_EQ(cat,
+            ShardedStringInternPool_lookup(&intern_pool, "cat", sizeof("cat")));
+  ASSERT_THAT(
+      ShardedStringInternPool_lookup(&intern_pool, "hat", sizeof("hat")),
+      IsNull());
+}
+
+TEST_F(ShardedStringInternPoolTest, Freeze) {
+  const char *cat =
+      ShardedStringInternPool_intern(&intern_pool, "cat", sizeof("cat"));
+  ASSERT_TRUE(ShardedStringInternPool_freeze(&intern_pool));
+
+  ASSERT_EQ(cat,
+            ShardedStringInternPool_lookup(&intern_pool, "cat", sizeof("cat")));
+  ASSERT_THAT(
+      ShardedStringInternPool_intern(&intern_pool, "hat", sizeof("hat")),
+      IsNull());
+}
+
+TEST_F(ShardedStringInternPoolTest, InternFromManyThreads) {
+  constexpr int kNumThreads = 8;
+  constexpr int kValuesPerThread = 1000;
+  std::vector<std::vector<const char *>> interned(kNumThreads);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; ++t) {
+    threads.emplace_back([&, t]() {
+      for (int i = 0; i < kValuesPerThread; ++i) {
+        std::string value = std::to_string(t) + ":" + std::to_string(i);
+        interned[t].push_back(ShardedStringInternPool_intern(
+            &intern_pool, value.c_str(), value.size() + 1));
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  // Verify every value kept its canonical pointer.
+  for (int t = 0; t < kNumThreads; ++t) {
+    for (int i = 0; i < kValuesPerThread; ++i) {
+      std::string value = std::to_string(t) + ":" + std::to_string(i);
+      ASSERT_STREQ(value.c_str(), interned[t][i]);
+      ASSERT_EQ(interned[t][i],
+                ShardedStringInternPool_intern(&intern_pool, value.c_str(),
+                                               value.size() + 1));
+    }
+  }
+}
+
+TEST(ShardedInt32InternPoolTest, IdentityHashesReachEveryShard) {
+  ShardedInt32InternPool intern_pool;
+  ShardedInt32InternPool_init(&intern_pool, /*threadsafe=*/false, hash_int32,
+                              compare_int32s);
+
+  // Small integers hash to themselves, so their high bits are all zero.
+  for (int32_t i = 0; i < 100000; ++i) {
+    ASSERT_THAT(ShardedInt32InternPool_intern(&intern_pool, &i, sizeof(i)),
+                NotNull());
+  }
+  for (uint32_t i = 0; i < (1u << DEFAULT_NUM_SHARD_BITS); ++i) {
+    EXPECT_GT(intern_pool.shards[i].pool.num_ids, 0u) << "shard " << i;
+  }
+  const int32_t value = 1234;
+  EXPECT_EQ(value, *ShardedInt32InternPool_lookup(&intern_pool, &value,
+                                                  sizeof(value)));
+
+  ShardedInt32InternPool_finalize(&intern_pool);
+}
+
+#if defined(HASH_SET_CONTROL_BYTES)
+TEST(ShardedInt32InternPoolTest, FragmentsVaryWithinShards) {
+  ShardedInt32InternPool intern_pool;
+  ShardedInt32InternPool_init(&intern_pool, /*threadsafe=*/false, hash_int32,
+                              compare_int32s);
+  for (int32_t i = 0; i < 100000; ++i) {
+    ASSERT_THAT(ShardedInt32InternPool_intern(&intern_pool, &i, sizeof(i)),
+                NotNull());
+  }
+
+  // Shard selection must not fix any of the 7 fragment bits, or probes would
+  // match the fragments of unrelated values far more often.
+  for (uint32_t i = 0; i < (1u << DEFAULT_NUM_SHARD_BITS); ++i) {
+    const ShardedInt32InternPoolShardHashSet *hash_set =
+        &intern_pool.shards[i].pool.hash_set;
+    const int8_t *ctrl = CTRL_BYTES(hash_set->table, hash_set->table_size);
+    std::set<int8_t> fragments;
+    for (uint32_t slot = 0; slot < hash_set->table_size; ++slot) {
+      if (IS_CTRL_FULL(ctrl[slot])) {
+        fragments.insert(ctrl[slot]);
+      }
+    }
+    EXPECT_EQ(128, fragments.size()) << "shard " << i;
+  }
+
+  ShardedInt32InternPool_finalize(&intern_pool);
+}
+#endif
+
+TEST(ShardedStringInternPoolCapacityTest, InitWithCapacity) {
+  ShardedStringInternPool intern_pool;
+  ShardedStringInternPool_init_with_capacity(&intern_pool, 16000, 160000,
+                                             /*threadsafe=*/true, hash_string,
+                                             compare_strings);
+  for (uint32_t i = 0; i < (1u << DEFAULT_NUM_SHARD_BITS); ++i) {
+    EXPECT_GE(intern_pool.shards[i].pool.hash_set.table_size, 2000);
+  }
+
+  const char *cat =
+      ShardedStringInternPool_intern(&intern_pool, "cat", sizeof("cat"));
+  ASSERT_THAT(cat, NotNull());
+  EXPECT_EQ(cat,
+            ShardedStringInternPool_intern(&intern_pool, "cat", sizeof("cat")));
+  ShardedStringInternPool_finalize(&intern_pool);
+}
+
+TEST(InlineShardedStringInternPoolTest, InternPoolN) {
+  InlineShardedStringInternPool intern_pool;
+  InlineShardedStringInternPool_init(&intern_pool, /*threadsafe=*/false, NULL,
+                                     NULL);
+
+  const char *cat =
+      InlineShardedStringInternPool_intern(&intern_pool, "cat", sizeof("cat"));
+  const char *hat =
+      InlineShardedStringInternPool_intern(&intern_pool, "hat", sizeof("hat"));
+
+  ASSERT_THAT(cat, NotNull());
+  ASSERT_THAT(hat, NotNull());
+  ASSERT_NE(cat, hat);
+  ASSERT_EQ(cat, InlineShardedStringInternPool_intern(&intern_pool, "cat",
+                                                      sizeof("cat")));
+  ASSERT_EQ(hat, InlineShardedStringInternPool_intern(&intern_pool, "hat",
+                                                      sizeof("hat")));
+
+  InlineShardedStringInternPool_finalize(&intern_pool);
+}
+
+}  // namespace
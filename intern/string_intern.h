@@ -0,0 +1,49 @@
+#ifndef COM_GITHUB_JEFFMANZIONE_INTERN_STRING_INTERN_H_
+#define COM_GITHUB_JEFFMANZIONE_INTERN_STRING_INTERN_H_
+
+/**
+ * @file string_intern.h
+ * @brief Intern pool of strings with a built-in hash and comparison.
+ *
+ * A string pool is an intern pool of char whose hash and compare functions are
+ * bound at expansion time (see IMPL_INTERN_POOL_INLINE) to string_hash and
+ * string_compare from internal/string_hash.h, so users need not write their
+ * own and probes can inline both. The hash and compare arguments of name_init
+ * are ignored and may be NULL. Strings of up to SMALL_VALUE_MAX_SIZE bytes are
+ * also copied into their hash set slots and compared there.
+ *
+ * Value sizes are in bytes and may or may not count a terminating NUL, as long
+ * as every call for a pool counts it the same way.
+ *
+ * Usage:
+ *    DEFINE_STRING_INTERN_POOL(MyStrings)
+ *    IMPL_STRING_INTERN_POOL(MyStrings)
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "intern/intern.h"
+#include "intern/internal/string_hash.h"
+
+/**
+ * DEFINE_STRING_INTERN_POOL(name)
+ *
+ * Generates the same types and functions as DEFINE_INTERN_POOL(name, char).
+ */
+#define DEFINE_STRING_INTERN_POOL(name) DEFINE_INTERN_POOL(name, char)
+
+/**
+ * IMPL_STRING_INTERN_POOL(name)
+ *
+ * Defines functions generated by DEFINE_STRING_INTERN_POOL.
+ */
+#define IMPL_STRING_INTERN_POOL(name) \
+  IMPL_INTERN_POOL_SMALL_VALUES(name, char, string_hash, string_compare)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COM_GITHUB_JEFFMANZIONE_INTERN_STRING_INTERN_H_ */
@@ -0,0 +1,79 @@
+#include "intern/string_intern.h"
+
+#include <gmock/gmock-matchers.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+namespace {
+
+using namespace testing;
+
+DEFINE_STRING_INTERN_POOL(StringPool);
+IMPL_STRING_INTERN_POOL(StringPool);
+
+class StringPoolTest : public Test {
+ protected:
+  StringPoolTest() {
+    StringPool_init(&intern_pool, /*threadsafe=*/false, NULL, NULL);
+  }
+  ~StringPoolTest() { StringPool_finalize(&intern_pool); }
+  StringPool intern_pool;
+};
+
+TEST_F(StringPoolTest, InternPoolN) {
+  const char *cat = StringPool_intern(&intern_pool, "cat", sizeof("cat"));
+  const char *hat = StringPool_intern(&intern_pool, "hat", sizeof("hat"));
+  ASSERT_THAT(cat, NotNull());
+  ASSERT_THAT(hat, NotNull());
+  EXPECT_NE(cat, hat);
+  EXPECT_STREQ("cat", cat);
+  EXPECT_EQ(cat, StringPool_intern(&intern_pool, "cat", sizeof("cat")));
+  EXPECT_EQ(hat, StringPool_intern(&intern_pool, "hat", sizeof("hat")));
+}
+
+TEST_F(StringPoolTest, SizeIsPartOfValue) {
+  // A prefix of an interned value is a different value.
+  const char *with_nul = StringPool_intern(&intern_pool, "cat", sizeof("cat"));
+  const char *without_nul = StringPool_intern(&intern_pool, "cat", 3);
+  const char *prefix = StringPool_intern(&intern_pool, "cat", 2);
+  EXPECT_NE(with_nul, without_nul);
+  EXPECT_NE(without_nul, prefix);
+  EXPECT_EQ(prefix, StringPool_intern(&intern_pool, "ca", 2));
+}
+
+TEST_F(StringPoolTest, SmallAndLargeValues) {
+  // Prefixes of each other, on both sides of the size copied into slots.
+  const std::string value = "0123456789abcdef";
+  std::vector<const char *> interned;
+  for (uint32_t size = 0; size <= value.size(); ++size) {
+    interned.push_back(StringPool_intern(&intern_pool, value.data(), size));
+  }
+  for (uint32_t size = 0; size <= value.size(); ++size) {
+    const std::string copy = value.substr(0, size);
+    EXPECT_EQ(interned[size],
+              StringPool_intern(&intern_pool, copy.data(), size));
+  }
+  EXPECT_EQ(value.size() + 1, intern_pool.num_ids);
+}
+
+TEST_F(StringPoolTest, InternMany) {
+  std::vector<std::string> values;
+  std::vector<const char *> interned;
+  for (int i = 0; i < 10000; ++i) {
+    // Sizes cross every path of the hash.
+    values.push_back(std::string(i % 100, 'x') + std::to_string(i));
+    interned.push_back(StringPool_intern(
+        &intern_pool, values.back().data(), (uint32_t)values.back().size()));
+  }
+  for (int i = 0; i < 10000; ++i) {
+    EXPECT_EQ(interned[i],
+              StringPool_lookup(&intern_pool, values[i].data(),
+                                (uint32_t)values[i].size()));
+  }
+  EXPECT_EQ(10000, intern_pool.num_ids);
+}
+
+}  // namespace